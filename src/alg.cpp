@@ -21,6 +21,7 @@
 #include "camera.hpp"
 #include "draw.hpp"
 #include "logger.hpp"
+#include "alg_simd.hpp"
 #include "alg.hpp"
 
 #define MAX2(x, y) ((x) > (y) ? (x) : (y))
@@ -45,35 +46,56 @@ typedef struct {
 } Segment;
 
 
-void cls_alg::noise_tune()
+/* Add count pixels beginning at start to the histogram of differences */
+void cls_alg::noise_tune_hist(int start, int count, int *hist)
 {
     ctx_images *imgs = &cam->imgs;
     int i;
-    u_char *ref = imgs->ref;
-    int diff, sum = 0, count = 0;
-    u_char *mask = imgs->mask;
-    u_char *mask_final = smartmask_final;
-    u_char *new_img = cam->imgs.image_vprvcy;
-
-
-    i = imgs->motionsize;
-
-    for (; i > 0; i--) {
-        diff = ABS(*ref - *new_img);
-
-        if (mask) {
-            diff = ((diff * *mask++) / 255);
-        }
+    u_char *ref = imgs->ref + start;
+    int diff;
+    u_char *mask = imgs->mask_detect;
+    u_char *mask_final = smartmask_final + start;
+    u_char *new_img = cam->imgs.image_detect + start;
+
+    if (mask) {
+        mask += start;
+    }
 
+    for (i = count; i > 0; i--) {
         if (*mask_final) {
-            sum += diff + 1;
-            count++;
+            diff = ABS(*ref - *new_img);
+            if (mask) {
+                diff = ((diff * *mask) / 255);
+            }
+            hist[diff]++;
         }
 
+        if (mask) {
+            mask++;
+        }
         ref++;
         new_img++;
         mask_final++;
     }
+}
+
+void cls_alg::noise_tune()
+{
+    int indx, sum, count;
+
+    /* The histogram is filled by the diff kernel when noise_on was set */
+    if (noise_valid == false) {
+        memset(noise_hist, 0, sizeof(noise_hist));
+        noise_tune_hist(0, cam->imgs.det_size, noise_hist);
+    }
+    noise_valid = false;
+
+    sum = 0;
+    count = 0;
+    for (indx = 0; indx < NOISE_HIST_LENGTH; indx++) {
+        sum += noise_hist[indx] * (indx + 1);
+        count += noise_hist[indx];
+    }
 
     if (count > 3)  {
         /* Avoid divide by zero. */
@@ -84,41 +106,104 @@ void cls_alg::noise_tune()
     cam->noise = 4 + (cam->noise + sum) / 2;
 }
 
+/* Value in the diffs history at pos */
+int cls_alg::tune_value(int64_t pos)
+{
+    if (pos < tune_fill_end) {
+        return tune_fill;
+    }
+    return tune_ring[pos % THRESHOLD_TUNE_LENGTH];
+}
+
+/*
+ * Add a value to the candidates for the top of the history.  Older
+ * candidates that are not larger can never be the top again.
+ */
+void cls_alg::tune_max_push(int64_t pos, int val)
+{
+    int indx;
+
+    while (tune_max_cnt > 0) {
+        indx = (tune_max_head + tune_max_cnt - 1) % THRESHOLD_TUNE_LENGTH;
+        if (tune_max_val[indx] > val) {
+            break;
+        }
+        tune_max_cnt--;
+    }
+    indx = (tune_max_head + tune_max_cnt) % THRESHOLD_TUNE_LENGTH;
+    tune_max_pos[indx] = pos;
+    tune_max_val[indx] = val;
+    tune_max_cnt++;
+}
+
+/* The filled entries are the oldest so they go in front of the candidates */
+void cls_alg::tune_max_fill()
+{
+    int64_t pos = tune_fill_end - 1;
+
+    if ((tune_max_cnt > 0) && (tune_max_val[tune_max_head] >= tune_fill)) {
+        return;
+    }
+    if ((tune_max_cnt > 0) && (tune_max_pos[tune_max_head] == pos)) {
+        tune_max_val[tune_max_head] = tune_fill;
+        return;
+    }
+    tune_max_head = (tune_max_head + THRESHOLD_TUNE_LENGTH - 1) % THRESHOLD_TUNE_LENGTH;
+    tune_max_pos[tune_max_head] = pos;
+    tune_max_val[tune_max_head] = tune_fill;
+    tune_max_cnt++;
+}
+
+/*
+ * The history of diffs is a ring with a running sum and the candidates
+ * for its top so each image is added without walking the history.  During
+ * motion and for entries never set the history holds a quarter of the
+ * threshold which is kept as tune_fill for the oldest entries.
+ */
 void cls_alg::threshold_tune()
 {
-    int i, top;
-    int sum = 0;
+    int top, sum, quarter;
     int diffs = cam->current_image->diffs;
-    int motion = cam->detecting_motion;
+    int64_t total, first;
 
     if (!diffs) {
         return;
     }
 
     top = diffs;
+    total = tune_sum;
+    quarter = cam->threshold / 4;
 
-    if (motion) {
-        diffs = cam->threshold / 4;
-    }
-
-    for (i = 0; i < THRESHOLD_TUNE_LENGTH - 1; i++) {
-        sum += diffs_last[i];
-
-        if (diffs_last[i + 1] && !motion) {
-            diffs_last[i] = diffs_last[i + 1];
-        } else {
-            diffs_last[i] = cam->threshold / 4;
+    if (cam->detecting_motion) {
+        tune_pos++;
+        tune_fill = quarter;
+        tune_fill_end = tune_pos;
+        tune_sum = (int64_t)quarter * THRESHOLD_TUNE_LENGTH;
+        tune_max_cnt = 0;
+        tune_max_push(tune_pos - 1, quarter);
+    } else {
+        first = tune_pos - THRESHOLD_TUNE_LENGTH;
+        tune_sum -= tune_value(first);
+        if (tune_max_pos[tune_max_head] == first) {
+            tune_max_head = (tune_max_head + 1) % THRESHOLD_TUNE_LENGTH;
+            tune_max_cnt--;
         }
-
-        if (diffs_last[i] > top) {
-            top = diffs_last[i];
+        if ((tune_fill == 0) && (tune_fill_end > (first + 1))) {
+            tune_fill = quarter;
+            tune_sum += (tune_fill_end - first - 1) * quarter;
+            tune_max_fill();
         }
+        tune_ring[tune_pos % THRESHOLD_TUNE_LENGTH] = diffs;
+        tune_sum += diffs;
+        tune_max_push(tune_pos, diffs);
+        tune_pos++;
     }
 
-    sum += diffs_last[i];
-    diffs_last[i] = diffs;
+    if (tune_max_val[tune_max_head] > top) {
+        top = tune_max_val[tune_max_head];
+    }
 
-    sum /= THRESHOLD_TUNE_LENGTH / 4;
+    sum = (int)(total / (THRESHOLD_TUNE_LENGTH / 4));
 
     if (sum < top * 2) {
         sum = top * 2;
@@ -196,19 +281,159 @@ int cls_alg::iflood(int x, int y, int width, int height,
     return count;
 }
 
+/* Find the root of a union-find label, halving the path as we go */
+int cls_alg::uf_find(int id)
+{
+    while (uf_parent[id] != id) {
+        uf_parent[id] = uf_parent[uf_parent[id]];
+        id = uf_parent[id];
+    }
+    return id;
+}
+
+/*
+ * Two pass labeling with union-find.  The first pass gives each pixel a
+ * provisional label from its left and upper neighbors and records where
+ * they connect.  The components are then numbered in the order their
+ * first pixel is reached by the seed scan of labeling(), which skips the
+ * last row and column, and finally the pixels are rewritten with the
+ * resolved label values.  The background is left at 0.
+ */
+int cls_alg::labeling_unionfind()
+{
+    ctx_images *imgs = &cam->imgs;
+    u_char *out = imgs->image_detect_motion;
+    int *labels = imgs->labels;
+    int ix, iy, pixelpos;
+    int width = imgs->det_width;
+    int height = imgs->det_height;
+    int id, up, left, root, other, id_cnt;
+    int labelsize = 0;
+    int current_label = 2;
+    /* Keep track of the area just under the threshold.  */
+    int max_under = 0;
+
+    cam->current_image->total_labels = 0;
+    imgs->labelsize_max = 0;
+    /* ALL labels above threshold are counted as labelgroup. */
+    imgs->labelgroup_max = 0;
+    imgs->labels_above = 0;
+
+    id_cnt = 1;
+    pixelpos = 0;
+    for (iy = 0; iy < height; iy++) {
+        for (ix = 0; ix < width; ix++, pixelpos++) {
+            if (out[pixelpos] == 0) {
+                labels[pixelpos] = 0;
+                continue;
+            }
+
+            up = 0;
+            left = 0;
+            if ((iy > 0) && (out[pixelpos - width] != 0)) {
+                up = labels[pixelpos - width];
+            }
+            if ((ix > 0) && (out[pixelpos - 1] != 0)) {
+                left = labels[pixelpos - 1];
+            }
+
+            if ((up == 0) && (left == 0)) {
+                id = id_cnt++;
+                uf_parent[id] = id;
+                uf_size[id] = 0;
+                uf_label[id] = 0;
+            } else if (up == 0) {
+                id = left;
+            } else if (left == 0) {
+                id = up;
+            } else {
+                /* Join the two keeping the lowest (first seen) as root */
+                id = uf_find(up);
+                other = uf_find(left);
+                if (other < id) {
+                    uf_parent[id] = other;
+                    id = other;
+                } else if (other > id) {
+                    uf_parent[other] = id;
+                }
+            }
+
+            labels[pixelpos] = id;
+            uf_size[id]++;
+        }
+    }
+
+    /* Parents always have lower ids so one ascending pass flattens all */
+    for (id = 1; id < id_cnt; id++) {
+        root = uf_parent[uf_parent[id]];
+        uf_parent[id] = root;
+        if (root != id) {
+            uf_size[root] += uf_size[id];
+        }
+    }
+
+    /* Number the components in the order labeling() seeds its floods */
+    for (iy = 0; iy < height - 1; iy++) {
+        pixelpos = iy * width;
+        for (ix = 0; ix < width - 1; ix++, pixelpos++) {
+            if (out[pixelpos] == 0) {
+                continue;
+            }
+            root = uf_parent[labels[pixelpos]];
+            if (uf_label[root] != 0) {
+                continue;
+            }
+
+            labelsize = uf_size[root];
+            /* Label above threshold? Mark it again (add 32768 to labelnumber). */
+            if ((labelsize * det_area) > cam->threshold) {
+                uf_label[root] = current_label + 32768;
+                imgs->labelgroup_max += labelsize;
+                imgs->labels_above++;
+            } else {
+                uf_label[root] = current_label;
+                if (max_under < labelsize) {
+                    max_under = labelsize;
+                }
+            }
+
+            if (imgs->labelsize_max < labelsize) {
+                imgs->labelsize_max = labelsize;
+                imgs->largest_label = current_label;
+            }
+
+            cam->current_image->total_labels++;
+            current_label++;
+        }
+    }
+
+    /* Components without a seed pixel stay unlabeled as in labeling() */
+    for (pixelpos = 0; pixelpos < imgs->det_size; pixelpos++) {
+        if (labels[pixelpos] != 0) {
+            labels[pixelpos] = uf_label[uf_parent[labels[pixelpos]]];
+        }
+    }
+
+    return imgs->labelgroup_max ? imgs->labelgroup_max : max_under;
+}
+
 int cls_alg::labeling()
 {
     ctx_images *imgs = &cam->imgs;
-    u_char *out = imgs->image_motion.image_norm;
+    u_char *out = imgs->image_detect_motion;
     int *labels = imgs->labels;
     int ix, iy, pixelpos;
-    int width = imgs->width;
-    int height = imgs->height;
+    int width = imgs->det_width;
+    int height = imgs->det_height;
     int labelsize = 0;
     int current_label = 2;
     /* Keep track of the area just under the threshold.  */
     int max_under = 0;
 
+    if (uf_parent != nullptr) {
+        return labeling_unionfind();
+    }
+
     cam->current_image->total_labels = 0;
     imgs->labelsize_max = 0;
     /* ALL labels above threshold are counted as labelgroup. */
@@ -236,7 +461,7 @@ int cls_alg::labeling()
 
             if (labelsize > 0) {
                 /* Label above threshold? Mark it again (add 32768 to labelnumber). */
-                if (labelsize > cam->threshold) {
+                if ((labelsize * det_area) > cam->threshold) {
                     labelsize = iflood(ix, iy, width, height, out, labels, current_label + 32768, current_label);
                     imgs->labelgroup_max += labelsize;
                     imgs->labels_above++;
@@ -263,8 +488,15 @@ int cls_alg::labeling()
     return imgs->labelgroup_max ? imgs->labelgroup_max : max_under;
 }
 
+/*
+ * The dilate and erode filters change height rows of img.  above and below
+ * are the rows next to them when img is a band of the image or nullptr at
+ * the edges of the image.
+ */
+
 /**  Dilates a 3x3 box. */
-int cls_alg::dilate9(u_char *img, int width, int height, void *buffer)
+int cls_alg::dilate9(u_char *img, int width, int height, void *buffer
+    , const u_char *above, const u_char *below)
 {
     /*
      * - row1, row2 and row3 represent lines in the temporary buffer.
@@ -284,7 +516,11 @@ int cls_alg::dilate9(u_char *img, int width, int height, void *buffer)
     row3 = row2 + width;
 
     /* Init rows 2 and 3. */
-    memset(row2, 0, (uint)width);
+    if (above != nullptr) {
+        memcpy(row2, above, (uint)width);
+    } else {
+        memset(row2, 0, (uint)width);
+    }
     memcpy(row3, img, (uint)width);
 
     /* Pointer to the current row in img. */
@@ -298,7 +534,9 @@ int cls_alg::dilate9(u_char *img, int width, int height, void *buffer)
         row3 = rowTemp;
 
         /* If we're at the last row, fill with zeros, otherwise copy from img. */
-        if (y == height - 1) {
+        if ((y == height - 1) && (below != nullptr)) {
+            memcpy(row3, below, (uint)width);
+        } else if (y == height - 1) {
             memset(row3, 0, (uint)width);
         } else {
             memcpy(row3, yp + width, (uint)width);
@@ -351,7 +589,8 @@ int cls_alg::dilate9(u_char *img, int width, int height, void *buffer)
 }
 
 /**  Dilates a + shape. */
-int cls_alg::dilate5(u_char *img, int width, int height, void *buffer)
+int cls_alg::dilate5(u_char *img, int width, int height, void *buffer
+    , const u_char *above, const u_char *below)
 {
     /*
      * - row1, row2 and row3 represent lines in the temporary buffer.
@@ -367,7 +606,11 @@ int cls_alg::dilate5(u_char *img, int width, int height, void *buffer)
     row3 = row2 + width;
 
     /* Init rows 2 and 3. */
-    memset(row2, 0, (uint)width);
+    if (above != nullptr) {
+        memcpy(row2, above, (uint)width);
+    } else {
+        memset(row2, 0, (uint)width);
+    }
     memcpy(row3, img, (uint)width);
 
     /* Pointer to the current row in img. */
@@ -381,7 +624,9 @@ int cls_alg::dilate5(u_char *img, int width, int height, void *buffer)
         row3 = rowTemp;
 
         /* If we're at the last row, fill with zeros, otherwise copy from img. */
-        if (y == height - 1) {
+        if ((y == height - 1) && (below != nullptr)) {
+            memcpy(row3, below, (uint)width);
+        } else if (y == height - 1) {
             memset(row3, 0, (uint)width);
         } else {
             memcpy(row3, yp + width, (uint)width);
@@ -420,7 +665,8 @@ int cls_alg::dilate5(u_char *img, int width, int height, void *buffer)
 }
 
 /**  Erodes a 3x3 box. */
-int cls_alg::erode9(u_char *img, int width, int height, void *buffer, u_char flag)
+int cls_alg::erode9(u_char *img, int width, int height, void *buffer, u_char flag
+    , const u_char *above, const u_char *below)
 {
     int y, i, sum = 0;
     char *Row1, *Row2, *Row3;
@@ -428,14 +674,20 @@ int cls_alg::erode9(u_char *img, int width, int height, void *buffer, u_char fla
     Row1 = (char *)buffer;
     Row2 = Row1 + width;
     Row3 = Row1 + 2 * width;
-    memset(Row2, flag, (uint)width);
+    if (above != nullptr) {
+        memcpy(Row2, above, (uint)width);
+    } else {
+        memset(Row2, flag, (uint)width);
+    }
     memcpy(Row3, img, (uint)width);
 
     for (y = 0; y < height; y++) {
         memcpy(Row1, Row2, (uint)width);
         memcpy(Row2, Row3, (uint)width);
 
-        if (y == height - 1) {
+        if ((y == height - 1) && (below != nullptr)) {
+            memcpy(Row3, below, (uint)width);
+        } else if (y == height - 1) {
             memset(Row3, flag, (uint)width);
         } else {
             memcpy(Row3, img + (y + 1) * width, (uint)width);
@@ -463,7 +715,8 @@ int cls_alg::erode9(u_char *img, int width, int height, void *buffer, u_char fla
 }
 
 /* Erodes in a + shape. */
-int cls_alg::erode5(u_char *img, int width, int height, void *buffer, u_char flag)
+int cls_alg::erode5(u_char *img, int width, int height, void *buffer, u_char flag
+    , const u_char *above, const u_char *below)
 {
     int y, i, sum = 0;
     char *Row1, *Row2, *Row3;
@@ -471,14 +724,20 @@ int cls_alg::erode5(u_char *img, int width, int height, void *buffer, u_char fla
     Row1 = (char *)buffer;
     Row2 = Row1 + width;
     Row3 = Row1 + 2 * width;
-    memset(Row2, flag, (uint)width);
+    if (above != nullptr) {
+        memcpy(Row2, above, (uint)width);
+    } else {
+        memset(Row2, flag, (uint)width);
+    }
     memcpy(Row3, img, (uint)width);
 
     for (y = 0; y < height; y++) {
         memcpy(Row1, Row2, (uint)width);
         memcpy(Row2, Row3, (uint)width);
 
-        if (y == height - 1) {
+        if ((y == height - 1) && (below != nullptr)) {
+            memcpy(Row3, below, (uint)width);
+        } else if (y == height - 1) {
             memset(Row3, flag, (uint)width);
         } else {
             memcpy(Row3, img + (y + 1) * width, (uint)width);
@@ -501,11 +760,135 @@ int cls_alg::erode5(u_char *img, int width, int height, void *buffer, u_char fla
     return sum;
 }
 
+/* Run the erode or dilate filter on the motion image and return the count */
+int cls_alg::despeckle_filter(char filter)
+{
+    int width, height, indx, diffs;
+    u_char *out, *buffer;
+    ctx_alg_band *band;
+    ctx_bits_kernel bk;
+
+    out = cam->imgs.image_detect_motion;
+    width = cam->imgs.det_width;
+    height = cam->imgs.det_height;
+
+    if (packed) {
+        if (packed_valid == false) {
+            alg_simd_bits_pack(out, width, height, packed_words, motion_bits);
+            packed_valid = true;
+        }
+        /* The filters use the packed rows in place of the motion image */
+        out = (u_char *)motion_bits;
+        width = packed_words * (int)sizeof(*motion_bits);
+    }
+
+    if ((band_cnt == 1) && packed) {
+        bk.bits = motion_bits;
+        bk.words = packed_words;
+        bk.width = cam->imgs.det_width;
+        bk.height = height;
+        bk.above = nullptr;
+        bk.below = nullptr;
+        bk.buffer = (uint64_t *)cam->imgs.common_buffer;
+        return alg_simd_bits_filter(&bk, filter);
+    } else if (band_cnt == 1) {
+        buffer = cam->imgs.common_buffer;
+        if (filter == 'E') {
+            return erode9(out, width, height, buffer, 0, nullptr, nullptr);
+        } else if (filter == 'e') {
+            return erode5(out, width, height, buffer, 0, nullptr, nullptr);
+        } else if (filter == 'D') {
+            return dilate9(out, width, height, buffer, nullptr, nullptr);
+        } else {
+            return dilate5(out, width, height, buffer, nullptr, nullptr);
+        }
+    }
+
+    /* Save the rows next to each band before any band is changed */
+    for (indx = 0; indx < band_cnt; indx++) {
+        band = &bands[indx];
+        if (band->row_st > 0) {
+            memcpy(band->halo, out + ((band->row_st - 1) * width), (uint)width);
+        }
+        if (band->row_en < height) {
+            memcpy(band->halo + width, out + (band->row_en * width), (uint)width);
+        }
+    }
+
+    band_filter = filter;
+    band_post(ALG_STAGE_DESPECKLE);
+
+    diffs = 0;
+    for (indx = 0; indx < band_cnt; indx++) {
+        diffs += bands[indx].diffs;
+    }
+    return diffs;
+}
+
+/* Run the despeckle filter on the rows of one band */
+int cls_alg::despeckle_band(ctx_alg_band *band)
+{
+    int width;
+    u_char *img;
+    const u_char *above, *below;
+    ctx_bits_kernel bk;
+
+    if (packed) {
+        width = packed_words * (int)sizeof(*motion_bits);
+    } else {
+        width = cam->imgs.det_width;
+    }
+    above = nullptr;
+    below = nullptr;
+    if (band->row_st > 0) {
+        above = band->halo;
+    }
+    if (band->row_en < cam->imgs.det_height) {
+        below = band->halo + width;
+    }
+
+    if (packed) {
+        bk.bits = motion_bits + (band->row_st * packed_words);
+        bk.words = packed_words;
+        bk.width = cam->imgs.det_width;
+        bk.height = band->row_en - band->row_st;
+        bk.above = (const uint64_t *)above;
+        bk.below = (const uint64_t *)below;
+        bk.buffer = (uint64_t *)band->buffer;
+        return alg_simd_bits_filter(&bk, band_filter);
+    }
+
+    img = cam->imgs.image_detect_motion + (band->row_st * width);
+
+    if (band_filter == 'E') {
+        return erode9(img, width, band->row_en - band->row_st
+            , band->buffer, 0, above, below);
+    } else if (band_filter == 'e') {
+        return erode5(img, width, band->row_en - band->row_st
+            , band->buffer, 0, above, below);
+    } else if (band_filter == 'D') {
+        return dilate9(img, width, band->row_en - band->row_st
+            , band->buffer, above, below);
+    } else {
+        return dilate5(img, width, band->row_en - band->row_st
+            , band->buffer, above, below);
+    }
+}
+
+/* Return the packed results of the filters to the motion image */
+void cls_alg::despeckle_unpack()
+{
+    if (packed_valid) {
+        alg_simd_bits_unpack(motion_bits, cam->imgs.det_width, cam->imgs.det_height
+            , packed_words, cam->imgs.image_detect, cam->imgs.image_detect_motion);
+        packed_valid = false;
+    }
+}
+
 void cls_alg::despeckle()
 {
-    int diffs, width, height, done;
+    int diffs, done;
     uint i, len;
-    u_char *out, *common_buffer;
 
     if ((cam->cfg->despeckle_filter == "") || cam->current_image->diffs <= 0) {
         if (cam->imgs.labelsize_max) {
@@ -515,48 +898,49 @@ void cls_alg::despeckle()
     }
 
     diffs = 0;
-    out = cam->imgs.image_motion.image_norm;
-    width = cam->imgs.width;
-    height = cam->imgs.height;
     done = 0;
     len = (uint)cam->cfg->despeckle_filter.length();
-    common_buffer = cam->imgs.common_buffer;
     cam->current_image->total_labels = 0;
     cam->imgs.largest_label = 0;
 
     for (i = 0; i < len; i++) {
         switch (cam->cfg->despeckle_filter[i]) {
         case 'E':
-            diffs = erode9(out, width, height, common_buffer, 0);
+            diffs = despeckle_filter('E');
             if (diffs == 0) {
                 i = len;
             }
             done = 1;
             break;
         case 'e':
-            diffs = erode5(out, width, height, common_buffer, 0);
+            diffs = despeckle_filter('e');
             if (diffs == 0) {
                 i = len;
             }
             done = 1;
             break;
         case 'D':
-            diffs = dilate9(out, width, height, common_buffer);
+            diffs = despeckle_filter('D');
             done = 1;
             break;
         case 'd':
-            diffs = dilate5(out, width, height, common_buffer);
+            diffs = despeckle_filter('d');
             done = 1;
             break;
         /* No further despeckle after labeling! */
         case 'l':
+            despeckle_unpack();
+            time_add(ALG_TIME_DESPECKLE);
             diffs = labeling();
+            time_add(ALG_TIME_LABELING);
             i = len;
             done = 2;
             break;
         }
     }
 
+    despeckle_unpack();
+
     /* If conf.despeckle_filter contains any valid action EeDdl */
     if (done) {
         if (done != 2) {
@@ -575,7 +959,7 @@ void cls_alg::tune_smartmask()
 {
     int i;
     u_char diff;
-    int motionsize = cam->imgs.motionsize;
+    int motionsize = cam->imgs.det_size;
     int sensitivity = cam->lastrate * (11 - cam->cfg->smart_mask_speed);
 
     if ((cam->cfg->smart_mask_speed == 0) ||
@@ -608,21 +992,21 @@ void cls_alg::tune_smartmask()
         }
     }
     /* Further expansion (here:erode due to inverted logic!) of the mask. */
-    erode9(smartmask_final, cam->imgs.width, cam->imgs.height,
-                      cam->imgs.common_buffer, 255);
-    erode5(smartmask_final, cam->imgs.width, cam->imgs.height,
-                      cam->imgs.common_buffer, 255);
+    erode9(smartmask_final, cam->imgs.det_width, cam->imgs.det_height,
+                      cam->imgs.common_buffer, 255, nullptr, nullptr);
+    erode5(smartmask_final, cam->imgs.det_width, cam->imgs.det_height,
+                      cam->imgs.common_buffer, 255, nullptr, nullptr);
     smartmask_count = 5 * cam->lastrate * (11 - cam->cfg->smart_mask_speed);
 }
 
 void cls_alg::diff_nomask()
 {
     u_char *ref = cam->imgs.ref;
-    u_char *out = cam->imgs.image_motion.image_norm;
-    u_char *new_img = cam->imgs.image_vprvcy;
+    u_char *out = cam->imgs.image_detect_motion;
+    u_char *new_img = cam->imgs.image_detect;
 
     int i, curdiff;
-    int imgsz = cam->imgs.motionsize;
+    int imgsz = cam->imgs.det_size;
     int diffs = 0, diffs_net = 0;
     int noise = cam->noise;
     int lrgchg = cam->cfg->threshold_ratio_change;
@@ -660,12 +1044,12 @@ void cls_alg::diff_nomask()
 void cls_alg::diff_mask()
 {
     u_char *ref  = cam->imgs.ref;
-    u_char *out  = cam->imgs.image_motion.image_norm;
-    u_char *mask = cam->imgs.mask;
-    u_char *new_img = cam->imgs.image_vprvcy;
+    u_char *out  = cam->imgs.image_detect_motion;
+    u_char *mask = cam->imgs.mask_detect;
+    u_char *new_img = cam->imgs.image_detect;
 
     int i, curdiff;
-    int imgsz = cam->imgs.motionsize;
+    int imgsz = cam->imgs.det_size;
     int diffs = 0, diffs_net = 0;
     int noise = cam->noise;
     int lrgchg = cam->cfg->threshold_ratio_change;
@@ -710,18 +1094,18 @@ void cls_alg::diff_smart()
 {
 
     u_char *ref  = cam->imgs.ref;
-    u_char *out  = cam->imgs.image_motion.image_norm;
+    u_char *out  = cam->imgs.image_detect_motion;
     u_char *mask_final = smartmask_final;
-    u_char *new_img = cam->imgs.image_vprvcy;
+    u_char *new_img = cam->imgs.image_detect;
 
     int i, curdiff;
-    int imgsz = cam->imgs.motionsize;
+    int imgsz = cam->imgs.det_size;
     int diffs = 0, diffs_net = 0;
     int noise = cam->noise;
     int *mask_buffer = smartmask_buffer;
     int lrgchg = cam->cfg->threshold_ratio_change;
 
-    imgsz = cam->imgs.motionsize;
+    imgsz = cam->imgs.det_size;
     memset(out + imgsz, 128, (uint)(imgsz / 2));
     memset(out, 0, (uint)imgsz);
 
@@ -767,19 +1151,19 @@ void cls_alg::diff_smart()
 void cls_alg::diff_masksmart()
 {
     u_char *ref = cam->imgs.ref;
-    u_char *out = cam->imgs.image_motion.image_norm;
-    u_char *mask = cam->imgs.mask;
+    u_char *out = cam->imgs.image_detect_motion;
+    u_char *mask = cam->imgs.mask_detect;
     u_char *mask_final = smartmask_final;
-    u_char *new_img = cam->imgs.image_vprvcy;
+    u_char *new_img = cam->imgs.image_detect;
 
     int i, curdiff;
-    int imgsz = cam->imgs.motionsize;
+    int imgsz = cam->imgs.det_size;
     int diffs = 0, diffs_net = 0;
     int noise = cam->noise;
     int *mask_buffer = smartmask_buffer;
     int lrgchg = cam->cfg->threshold_ratio_change;
 
-    imgsz= cam->imgs.motionsize;
+    imgsz= cam->imgs.det_size;
     memset(out + imgsz, 128, ((uint)imgsz / 2));
     memset(out, 0, (uint)imgsz);
 
@@ -835,11 +1219,11 @@ bool cls_alg::diff_fast()
 {
     ctx_images *imgs = &cam->imgs;
     int i, curdiff, diffs = 0;
-    int step = cam->imgs.motionsize / 10000;
+    int step = cam->imgs.det_size / 10000;
     int noise = cam->noise;
-    int max_n_changes = cam->cfg->threshold / 2;
+    int max_n_changes = cam->cfg->threshold / 2 / det_area;
     u_char *ref = imgs->ref;
-    u_char *new_img = cam->imgs.image_vprvcy;
+    u_char *new_img = cam->imgs.image_detect;
 
     if (!step % 2) {
         step++;
@@ -847,7 +1231,7 @@ bool cls_alg::diff_fast()
 
     max_n_changes /= step;
 
-    i = imgs->motionsize;
+    i = imgs->det_size;
 
     for (; i > 0; i -= step) {
         curdiff = abs(*ref - *new_img); /* Using a temp variable is 12% faster. */
@@ -864,175 +1248,693 @@ bool cls_alg::diff_fast()
     return false;
 }
 
-void cls_alg::diff_standard()
+/* Set up the kernel arguments for the whole image */
+void cls_alg::diff_kernel_init(ctx_diff_kernel *dk)
 {
-    if (cam->cfg->smart_mask_speed == 0) {
-        if (cam->imgs.mask == NULL) {
-            diff_nomask();
+    dk->ref = cam->imgs.ref;
+    dk->img = cam->imgs.image_detect;
+    dk->mask = cam->imgs.mask_detect;
+    dk->out = cam->imgs.image_detect_motion;
+    dk->smartbuf = smartmask_buffer;
+    dk->count = cam->imgs.det_size;
+    dk->noise = cam->noise;
+    dk->lrgchg = cam->cfg->threshold_ratio_change;
+    dk->diffs = 0;
+    dk->diffs_net = 0;
+    dk->histmask = smartmask_final;
+    dk->hist = nullptr;
+    if (cam->cfg->smart_mask_speed) {
+        dk->smartmask = smartmask_final;
+        if (cam->event_curr_nbr != cam->event_prev_nbr) {
+            dk->smart_incr = SMARTMASK_SENSITIVITY_INCR;
         } else {
-            diff_mask();
+            dk->smart_incr = 0;
         }
     } else {
-        if (cam->imgs.mask == NULL) {
-            diff_smart();
-        } else {
-            diff_masksmart();
-        }
+        dk->smartmask = nullptr;
+        dk->smart_incr = 0;
     }
 }
 
-void cls_alg::lightswitch()
+/* Run the diff kernel on the pixels of dk which begin at offset */
+void cls_alg::diff_kernel_run(ctx_diff_kernel *dk, int offset)
 {
-    if (cam->cfg->lightswitch_percent >= 1) {
-        if (cam->current_image->diffs > (cam->imgs.motionsize * cam->cfg->lightswitch_percent / 100)) {
-            MOTION_LOG(INF, TYPE_ALL, NO_ERRNO, _("Lightswitch detected"));
-            if (cam->frame_skip < cam->cfg->lightswitch_frames) {
-                cam->frame_skip = cam->cfg->lightswitch_frames;
-            }
-            cam->current_image->diffs = 0;
-            ref_frame_update();
-        }
+    if ((diff_kernel == nullptr) || (dk->hist != nullptr)) {
+        alg_simd_diff_scalar(dk);
+        return;
     }
-}
-
-void cls_alg::ref_frame_update()
-{
-    int accept_timer;
-    int i, threshold_ref;
-    int *ref_dyn = cam->imgs.ref_dyn;
-    u_char *image_virgin = cam->imgs.image_vprvcy;
-    u_char *ref = cam->imgs.ref;
-    u_char *mask_final = smartmask_final;
-    u_char *out = cam->imgs.image_motion.image_norm;
 
-    accept_timer = cam->cfg->static_object_time * cam->cfg->framerate;
-    threshold_ref = cam->noise * EXCLUDE_LEVEL_PERCENT / 100;
+    if (simd_check) {
+        memcpy(check_buffer + offset, dk->smartbuf
+            , (uint)dk->count * sizeof(*check_buffer));
+    }
 
-    for (i = cam->imgs.motionsize; i > 0; i--) {
-        /* Exclude pixels from ref frame well below noise level. */
-        if (((int)(abs(*ref - *image_virgin)) > threshold_ref) && (*mask_final)) {
-            if (*ref_dyn == 0) { /* Always give new pixels a chance. */
-                *ref_dyn = 1;
-            } else if (*ref_dyn > accept_timer) { /* Include static Object after some time. */
-                *ref_dyn = 0;
-                *ref = *image_virgin;
-            } else if (*out) {
-                (*ref_dyn)++; /* Motionpixel? Keep excluding from ref frame. */
-            } else {
-                *ref_dyn = 0; /* Nothing special - release pixel. */
-                *ref = (u_char)((*ref + *image_virgin) / 2);
-            }
-        } else {  /* No motion: copy to ref frame. */
-            *ref_dyn = 0; /* Reset pixel */
-            *ref = *image_virgin;
-        }
+    diff_kernel(dk);
 
-        ref++;
-        image_virgin++;
-        mask_final++;
-        ref_dyn++;
-        out++;
+    if (simd_check) {
+        diff_simd_check(dk, offset);
     }
-
 }
 
-void cls_alg::ref_frame_reset()
+/* Run the diff kernel on count pixels beginning at indx and add the results */
+void cls_alg::diff_kernel_part(ctx_diff_kernel *dk, int indx, int count
+    , int &diffs, int &diffs_net)
 {
-    /* Copy fresh image */
-    memcpy(cam->imgs.ref, cam->imgs.image_vprvcy, (uint)cam->imgs.size_norm);
-    /* Reset static objects */
-    memset(cam->imgs.ref_dyn, 0
-        ,(uint)cam->imgs.motionsize * sizeof(*cam->imgs.ref_dyn));
+    ctx_diff_kernel pk;
+
+    pk = *dk;
+    pk.ref += indx;
+    pk.img += indx;
+    pk.out += indx;
+    pk.smartbuf += indx;
+    pk.histmask += indx;
+    if (pk.mask != nullptr) {
+        pk.mask += indx;
+    }
+    if (pk.smartmask != nullptr) {
+        pk.smartmask += indx;
+    }
+    pk.count = count;
 
+    diff_kernel_run(&pk, indx);
+    diffs += pk.diffs;
+    diffs_net += pk.diffs_net;
 }
 
-/*Calculate the center location of changes*/
-void cls_alg::location_center()
+/* Diff the runs of active blocks within one row of blocks */
+void cls_alg::diff_block_row(ctx_diff_kernel *dk, int by, int &diffs, int &diffs_net)
 {
-    int width = cam->imgs.width;
-    int height = cam->imgs.height;
-    ctx_coord *cent = &cam->current_image->location;
-    u_char *out = cam->imgs.image_motion.image_norm;
-    int x, y, centc = 0;
+    int y, y_end, bx, bx_end, x_st, x_end;
+    int width = cam->imgs.det_width;
+    u_char *map = block_map + (by * block_cols);
 
-    cent->x = 0;
-    cent->y = 0;
+    y_end = MIN((by + 1) * ALG_BLOCK_SIZE, cam->imgs.det_height);
 
-    for (y = 0; y < height; y++) {
-        for (x = 0; x < width; x++) {
-            if (*(out++)) {
-                cent->x += x;
-                cent->y += y;
-                centc++;
+    /* The histogram needs every pixel and the inactive blocks diff to zero */
+    if (dk->hist != nullptr) {
+        y = by * ALG_BLOCK_SIZE;
+        diff_kernel_part(dk, y * width, (y_end - y) * width, diffs, diffs_net);
+        return;
+    }
+
+    for (y = by * ALG_BLOCK_SIZE; y < y_end; y++) {
+        bx = 0;
+        while (bx < block_cols) {
+            if ((map[bx] & 1) == 0) {
+                bx++;
+                continue;
+            }
+            bx_end = bx + 1;
+            while ((bx_end < block_cols) && (map[bx_end] & 1)) {
+                bx_end++;
             }
+            x_st = bx * ALG_BLOCK_SIZE;
+            x_end = MIN(bx_end * ALG_BLOCK_SIZE, width);
+            diff_kernel_part(dk, (y * width) + x_st, x_end - x_st, diffs, diffs_net);
+            bx = bx_end;
         }
     }
+}
 
-    if (centc) {
-        cent->x = cent->x / centc;
-        cent->y = cent->y / centc;
+/* Diff only the blocks marked active by diff_prescreen */
+void cls_alg::diff_blocks()
+{
+    ctx_diff_kernel dk;
+    int imgsz = cam->imgs.det_size;
+    int by, diffs = 0, diffs_net = 0;
+
+    diff_kernel_init(&dk);
+    if (noise_on) {
+        memset(noise_hist, 0, sizeof(noise_hist));
+        dk.hist = noise_hist;
     }
+    memset(dk.out + imgsz, 128, (uint)(imgsz / 2));
+    memset(dk.out, 0, (uint)imgsz);
 
-    /* This allows for the redcross and boxes to be drawn*/
-    if (cent->x < 10) {
-        cent->x = 15;
-    }
-    if (cent->y < 10) {
-        cent->y = 15;
-    }
-    if ((cent->x + 10) > width) {
-        cent->x = width - 15;
-    }
-    if ((cent->y + 10) > height) {
-        cent->y = height - 15;
+    for (by = 0; by < block_rows; by++) {
+        diff_block_row(&dk, by, diffs, diffs_net);
     }
 
+    diff_results(diffs, diffs_net);
 }
 
-/*Calculate distribution and variances of changes*/
-void cls_alg::location_dist_stddev()
+/*
+ * Compute the sum of absolute differences of each block and shift the
+ * activity of the current image into bit 0 of block_map.  Blocks which
+ * are not active cannot have any pixels with motion.
+ */
+void cls_alg::diff_prescreen()
 {
-    ctx_images *imgs = &cam->imgs;
-    int width = cam->imgs.width;
-    int height = cam->imgs.height;
-    ctx_coord *cent = &cam->current_image->location;
-    u_char *out = imgs->image_motion.image_norm;
-    int x, y, centc = 0, xdist = 0, ydist = 0;
-    int64_t variance_x, variance_y, variance_xy, distance_mean;
+    int indx;
 
-    cent->maxx = 0;
-    cent->maxy = 0;
-    cent->minx = width;
-    cent->miny = height;
-    variance_x = 0;
-    variance_y = 0;
-    distance_mean = 0;
+    if (band_cnt == 1) {
+        band_stage = ALG_STAGE_PRESCREEN;
+        band_run(&bands[0]);
+    } else {
+        band_post(ALG_STAGE_PRESCREEN);
+    }
+
+    block_active_cnt = 0;
+    for (indx = 0; indx < band_cnt; indx++) {
+        block_active_cnt += bands[indx].blocks;
+    }
+}
+
+/* Pre-screen the block rows of one band.  Bands start on a block row */
+void cls_alg::prescreen_band(ctx_alg_band *band)
+{
+    ctx_block_kernel bk;
+    int indx, ofs, blk_st, blk_en;
+
+    ofs = band->row_st * cam->imgs.det_width;
+    blk_st = (band->row_st / ALG_BLOCK_SIZE) * block_cols;
+    blk_en = ((band->row_en + ALG_BLOCK_SIZE - 1) / ALG_BLOCK_SIZE) * block_cols;
+
+    bk.ref = cam->imgs.ref + ofs;
+    bk.img = cam->imgs.image_detect + ofs;
+    bk.width = cam->imgs.det_width;
+    bk.height = band->row_en - band->row_st;
+    bk.noise = cam->noise;
+    bk.cols = block_cols;
+    bk.sad = block_sad + blk_st;
+    bk.active = block_active + blk_st;
+
+    block_kernel(&bk);
+
+    band->blocks = 0;
+    for (indx = blk_st; indx < blk_en; indx++) {
+        block_map[indx] = (u_char)((block_map[indx] << 1) | block_active[indx]);
+        band->blocks += block_active[indx];
+    }
+}
+
+void cls_alg::diff_results(int diffs, int diffs_net)
+{
+    cam->current_image->diffs_raw = diffs;
+    cam->current_image->diffs = diffs;
+    cam->imgs.image_motion.imgts = cam->current_image->imgts;
+
+    if (diffs > 0 ) {
+        cam->current_image->diffs_ratio = (abs(diffs_net) * 100) / diffs;
+    } else {
+        cam->current_image->diffs_ratio = 100;
+    }
+}
+
+/* Run the vectorized diff kernel selected at startup */
+void cls_alg::diff_simd()
+{
+    ctx_diff_kernel dk;
+    int imgsz = cam->imgs.det_size;
+
+    diff_kernel_init(&dk);
+    if (noise_on) {
+        memset(noise_hist, 0, sizeof(noise_hist));
+        dk.hist = noise_hist;
+    }
+
+    memset(dk.out + imgsz, 128, (uint)(imgsz / 2));
+    diff_kernel_run(&dk, 0);
+
+    diff_results(dk.diffs, dk.diffs_net);
+}
+
+/*
+ * Diff, noise_tune histogram and reference frame update in a single pass over
+ * tiles of rows.  The results must be the same as diff_standard followed
+ * by noise_tune and ref_frame_update so the parts are only done when the
+ * inputs that they use cannot change in between:
+ *  - noise_tune only runs on the first frame of each second and changes
+ *    the noise used for the reference frame.
+ *  - tune_smartmask changes smartmask_final.
+ *  - despeckle changes the motion image so reference pixels that depend
+ *    upon it are saved and finished by ref_frame_update.
+ *  - the running average background uses the motion image for every
+ *    pixel so it is always left to ref_frame_update.
+ */
+void cls_alg::diff_fused()
+{
+    fused_ref = (noise_on == false) && (bg_words == nullptr) &&
+        !((cam->cfg->smart_mask_speed != 0) &&
+          (cam->event_curr_nbr != cam->event_prev_nbr) &&
+          (smartmask_count == 1));
+    fused_defer = (cam->cfg->despeckle_filter.find_first_of("EeDd") != std::string::npos);
+
+    diff_bands();
+}
+
+/* Diff each band and add up the results of the bands */
+void cls_alg::diff_bands()
+{
+    int imgsz = cam->imgs.det_size;
+    int indx, hst, diffs = 0, diffs_net = 0;
+
+    diff_kernel_init(&band_dk);
+    memset(band_dk.out + imgsz, 128, (uint)(imgsz / 2));
+
+    if (band_cnt == 1) {
+        band_stage = ALG_STAGE_DIFF;
+        band_run(&bands[0]);
+    } else {
+        band_post(ALG_STAGE_DIFF);
+    }
+
+    if (noise_on) {
+        memset(noise_hist, 0, sizeof(noise_hist));
+    }
+    for (indx = 0; indx < band_cnt; indx++) {
+        diffs += bands[indx].diffs;
+        diffs_net += bands[indx].diffs_net;
+        if (noise_on) {
+            for (hst = 0; hst < NOISE_HIST_LENGTH; hst++) {
+                noise_hist[hst] += bands[indx].noise_hist[hst];
+            }
+        }
+    }
+
+    diff_results(diffs, diffs_net);
+}
+
+/*
+ * Diff the rows of one band.  The band is done in tiles of one row of
+ * blocks and with diff_fused the reference frame is done for each tile
+ * while it is still in the cache.
+ */
+void cls_alg::diff_band(ctx_alg_band *band)
+{
+    int width = cam->imgs.det_width;
+    int tile = width * ALG_BLOCK_SIZE;
+    int indx, cnt, ind_en;
+    ctx_diff_kernel dk;
+
+    dk = band_dk;
+    if (noise_on) {
+        dk.hist = band->noise_hist;
+    }
+
+    ind_en = band->row_en * width;
+    for (indx = band->row_st * width; indx < ind_en; indx += tile) {
+        cnt = MIN(tile, ind_en - indx);
+
+        if (block_map != nullptr) {
+            memset(dk.out + indx, 0, (uint)cnt);
+            diff_block_row(&dk, indx / tile, band->diffs, band->diffs_net);
+        } else {
+            diff_kernel_part(&dk, indx, cnt, band->diffs, band->diffs_net);
+        }
+
+        if (fused_ref) {
+            ref_frame_range(indx, cnt, fused_defer ? &band->pending : nullptr);
+        }
+    }
+}
+
+/*
+ * Repeat the diff with the scalar kernel and compare.  Upon any difference
+ * the scalar results are used and the vector kernel is turned off.
+ */
+void cls_alg::diff_simd_check(ctx_diff_kernel *dk, int offset)
+{
+    ctx_diff_kernel chk;
+    int imgsz = dk->count;
+
+    chk = *dk;
+    chk.out = check_out + offset;
+    chk.smartbuf = check_buffer + offset;
+    alg_simd_diff_scalar(&chk);
+
+    if ((chk.diffs == dk->diffs) &&
+        (chk.diffs_net == dk->diffs_net) &&
+        (memcmp(chk.out, dk->out, (uint)imgsz) == 0) &&
+        (memcmp(chk.smartbuf, dk->smartbuf, (uint)imgsz * sizeof(*check_buffer)) == 0)) {
+        return;
+    }
+
+    MOTION_LOG(ERR, TYPE_ALL, NO_ERRNO
+        , _("Diff kernel %s does not match scalar results (%d/%d vs %d/%d).  Using scalar")
+        , diff_kernel_nm.c_str(), dk->diffs, dk->diffs_net, chk.diffs, chk.diffs_net);
+
+    memcpy(dk->out, chk.out, (uint)imgsz);
+    memcpy(dk->smartbuf, chk.smartbuf, (uint)imgsz * sizeof(*check_buffer));
+    dk->diffs = chk.diffs;
+    dk->diffs_net = chk.diffs_net;
+
+    diff_kernel = nullptr;
+    diff_kernel_nm = "scalar";
+    simd_check = false;
+}
+
+void cls_alg::diff_standard()
+{
+    if (fused) {
+        diff_fused();
+        return;
+    }
+
+    if (band_cnt > 1) {
+        diff_bands();
+        return;
+    }
+
+    if (block_map != nullptr) {
+        diff_blocks();
+        return;
+    }
+
+    /* The scalar kernel gives the same results as the functions below */
+    if ((diff_kernel != nullptr) || noise_on) {
+        diff_simd();
+        return;
+    }
+
+    if (cam->cfg->smart_mask_speed == 0) {
+        if (cam->imgs.mask_detect == NULL) {
+            diff_nomask();
+        } else {
+            diff_mask();
+        }
+    } else {
+        if (cam->imgs.mask_detect == NULL) {
+            diff_smart();
+        } else {
+            diff_masksmart();
+        }
+    }
+}
+
+void cls_alg::lightswitch()
+{
+    if (cam->cfg->lightswitch_percent >= 1) {
+        if (cam->current_image->diffs > (cam->imgs.det_size * cam->cfg->lightswitch_percent / 100)) {
+            MOTION_LOG(INF, TYPE_ALL, NO_ERRNO, _("Lightswitch detected"));
+            if (cam->frame_skip < cam->cfg->lightswitch_frames) {
+                cam->frame_skip = cam->cfg->lightswitch_frames;
+            }
+            cam->current_image->diffs = 0;
+            ref_frame_update();
+        }
+    }
+}
+
+/*
+ * Update count pixels of the reference frame beginning at start.  With
+ * pending the pixels which depend upon the motion image are added to it
+ * for ref_frame_update to finish.
+ */
+void cls_alg::ref_frame_range(int start, int count, std::vector<int> *pending)
+{
+    int accept_timer;
+    int i, threshold_ref;
+    int *ref_dyn = cam->imgs.ref_dyn + start;
+    u_char *image_virgin = cam->imgs.image_detect + start;
+    u_char *ref = cam->imgs.ref + start;
+    u_char *mask_final = smartmask_final + start;
+    u_char *out = cam->imgs.image_detect_motion + start;
+
+    if (bg_words != nullptr) {
+        ref_frame_average(start, count);
+        return;
+    }
+
+    accept_timer = cam->cfg->static_object_time * cam->cfg->framerate;
+    threshold_ref = cam->noise * EXCLUDE_LEVEL_PERCENT / 100;
+
+    for (i = count; i > 0; i--) {
+        /* Exclude pixels from ref frame well below noise level. */
+        if (((int)(abs(*ref - *image_virgin)) > threshold_ref) && (*mask_final)) {
+            if (*ref_dyn == 0) { /* Always give new pixels a chance. */
+                *ref_dyn = 1;
+            } else if (*ref_dyn > accept_timer) { /* Include static Object after some time. */
+                *ref_dyn = 0;
+                *ref = *image_virgin;
+            } else if (pending != nullptr) {
+                pending->push_back(start + count - i);
+            } else if (*out) {
+                (*ref_dyn)++; /* Motionpixel? Keep excluding from ref frame. */
+            } else {
+                *ref_dyn = 0; /* Nothing special - release pixel. */
+                *ref = (u_char)((*ref + *image_virgin) / 2);
+            }
+        } else {  /* No motion: copy to ref frame. */
+            *ref_dyn = 0; /* Reset pixel */
+            *ref = *image_virgin;
+        }
+
+        ref++;
+        image_virgin++;
+        mask_final++;
+        ref_dyn++;
+        out++;
+    }
+}
+
+/* Update count pixels of the running average background beginning at start */
+void cls_alg::ref_frame_average(int start, int count)
+{
+    ctx_bg_kernel bk;
+
+    bk.bg = bg_words + start;
+    bk.ref = cam->imgs.ref + start;
+    bk.img = cam->imgs.image_detect + start;
+    bk.smartmask = smartmask_final + start;
+    bk.out = cam->imgs.image_detect_motion + start;
+    bk.count = count;
+    bk.threshold = cam->noise * EXCLUDE_LEVEL_PERCENT / 100;
+    bk.rate = bg_rate;
+    bk.tick = bg_tick;
+    bk.limit = bg_limit;
+
+    alg_simd_bg_update(&bk);
+}
+
+void cls_alg::ref_frame_update()
+{
+    int indx, bnd, step;
+    uint i;
+    int *ref_dyn = cam->imgs.ref_dyn;
+    u_char *ref = cam->imgs.ref;
+    u_char *out = cam->imgs.image_detect_motion;
+    std::vector<int> *pending;
+
+    /* Any histogram collected by the diff is for the prior reference frame */
+    noise_valid = false;
+
+    /*
+     * The timers of the running average only count to ALG_BG_TIMER so they
+     * are advanced once every step images to cover static_object_time.
+     */
+    if (bg_words != nullptr) {
+        step = (cam->cfg->static_object_time * cam->cfg->framerate)
+            / ALG_BG_TIMER + 1;
+        bg_limit = MIN((cam->cfg->static_object_time * cam->cfg->framerate)
+            / step + 1, ALG_BG_TIMER);
+        bg_tick = (bg_frame == 0) ? 1 : 0;
+        bg_frame = (bg_frame + 1) % step;
+    }
+
+    if ((fused_ref == false) && (band_cnt > 1)) {
+        band_post(ALG_STAGE_REF);
+        return;
+    } else if (fused_ref == false) {
+        ref_frame_range(0, cam->imgs.det_size, nullptr);
+        return;
+    }
+
+    /* Finish the pixels that diff_fused left for the final motion image */
+    fused_ref = false;
+    for (bnd = 0; bnd < band_cnt; bnd++) {
+        pending = &bands[bnd].pending;
+        for (i = 0; i < pending->size(); i++) {
+            indx = (*pending)[i];
+            if (out[indx]) {
+                ref_dyn[indx]++;
+            } else {
+                ref_dyn[indx] = 0;
+                ref[indx] = (u_char)((ref[indx] + cam->imgs.image_detect[indx]) / 2);
+            }
+        }
+        pending->clear();
+    }
+}
+
+void cls_alg::ref_frame_reset()
+{
+    int indx;
+
+    /* Copy fresh image */
+    memcpy(cam->imgs.ref, cam->imgs.image_detect, (uint)cam->imgs.det_size);
+    /* Reset static objects */
+    if (bg_words != nullptr) {
+        for (indx = 0; indx < cam->imgs.det_size; indx++) {
+            bg_words[indx] = (uint16_t)(cam->imgs.ref[indx] << (2 * ALG_BG_FRAC));
+        }
+    } else {
+        memset(cam->imgs.ref_dyn, 0
+            ,(uint)cam->imgs.det_size * sizeof(*cam->imgs.ref_dyn));
+    }
+
+}
+
+/*
+ * Count the changed pixels in each column and row of the motion image.
+ * The center, box and standard deviations are computed from the counts
+ * so the image is only scanned once.
+ */
+int cls_alg::location_counts()
+{
+    int width = cam->imgs.det_width;
+    int height = cam->imgs.det_height;
+    u_char *out = cam->imgs.image_detect_motion;
+    int x, y, cnt, centc = 0;
+
+    memset(loc_cols, 0, (uint)width * sizeof(*loc_cols));
 
     for (y = 0; y < height; y++) {
+        cnt = 0;
         for (x = 0; x < width; x++) {
             if (*(out++)) {
-                variance_x += ((x - cent->x) * (x - cent->x));
-                variance_y += ((y - cent->y) * (y - cent->y));
-                distance_mean += (int64_t)sqrt(
-                        ((x - cent->x) * (x - cent->x)) +
-                        ((y - cent->y) * (y - cent->y)));
-
-                if (x > cent->x) {
-                    xdist += x - cent->x;
-                } else if (x < cent->x) {
-                    xdist += cent->x - x;
-                }
+                loc_cols[x]++;
+                cnt++;
+            }
+        }
+        loc_rows[y] = cnt;
+        centc += cnt;
+    }
 
-                if (y > cent->y) {
-                    ydist += y - cent->y;
-                } else if (y < cent->y) {
-                    ydist += cent->y - y;
-                }
+    return centc;
+}
+
+/*Calculate the center location of changes*/
+void cls_alg::location_center(int centc)
+{
+    int width = cam->imgs.det_width;
+    int height = cam->imgs.det_height;
+    ctx_coord *cent = &cam->current_image->location;
+    int64_t sum_x, sum_y;
+    int x, y;
+
+    sum_x = 0;
+    for (x = 0; x < width; x++) {
+        sum_x += (int64_t)x * loc_cols[x];
+    }
+    sum_y = 0;
+    for (y = 0; y < height; y++) {
+        sum_y += (int64_t)y * loc_rows[y];
+    }
 
-                centc++;
+    cent->x = 0;
+    cent->y = 0;
+    if (centc) {
+        cent->x = (int)(sum_x / centc);
+        cent->y = (int)(sum_y / centc);
+    }
+
+    /* This allows for the redcross and boxes to be drawn*/
+    if (cent->x < 10) {
+        cent->x = 15;
+    }
+    if (cent->y < 10) {
+        cent->y = 15;
+    }
+    if ((cent->x + 10) > width) {
+        cent->x = width - 15;
+    }
+    if ((cent->y + 10) > height) {
+        cent->y = height - 15;
+    }
+
+}
+
+/* Sum the distances and squared distances from the center of the counts */
+void cls_alg::location_dist_sums(int64_t &xdist, int64_t &ydist
+    , int64_t &variance_x, int64_t &variance_y)
+{
+    int width = cam->imgs.det_width;
+    int height = cam->imgs.det_height;
+    ctx_coord *cent = &cam->current_image->location;
+    int x, y;
+    int64_t d;
+
+    xdist = 0;
+    variance_x = 0;
+    for (x = 0; x < width; x++) {
+        d = x - cent->x;
+        xdist += (d < 0 ? -d : d) * loc_cols[x];
+        variance_x += d * d * loc_cols[x];
+    }
+
+    ydist = 0;
+    variance_y = 0;
+    for (y = 0; y < height; y++) {
+        d = y - cent->y;
+        ydist += (d < 0 ? -d : d) * loc_rows[y];
+        variance_y += d * d * loc_rows[y];
+    }
+}
+
+/*
+ * Sum the whole number distance of each changed pixel from the center and
+ * its square.  Only the rows with changes are visited and the square root
+ * is followed from one pixel to the next along the row.
+ */
+void cls_alg::location_dist_radial(int64_t &dist_sum, int64_t &dist_sq)
+{
+    int width = cam->imgs.det_width;
+    int height = cam->imgs.det_height;
+    ctx_coord *cent = &cam->current_image->location;
+    u_char *out;
+    int x, y, cnt;
+    int64_t r, d2, dy2;
+
+    dist_sum = 0;
+    dist_sq = 0;
+    r = 0;
+
+    for (y = 0; y < height; y++) {
+        if (loc_rows[y] == 0) {
+            continue;
+        }
+        out = cam->imgs.image_detect_motion + (y * width);
+        dy2 = (int64_t)(y - cent->y) * (y - cent->y);
+        cnt = 0;
+        for (x = 0; cnt < loc_rows[y]; x++) {
+            if (out[x] == 0) {
+                continue;
+            }
+            d2 = ((int64_t)(x - cent->x) * (x - cent->x)) + dy2;
+            while (((r + 1) * (r + 1)) <= d2) {
+                r++;
+            }
+            while ((r * r) > d2) {
+                r--;
             }
+            dist_sum += r;
+            dist_sq += r * r;
+            cnt++;
         }
     }
+}
+
+/*Calculate distribution and variances of changes*/
+void cls_alg::location_dist_stddev(int centc)
+{
+    int width = cam->imgs.det_width;
+    int height = cam->imgs.det_height;
+    ctx_coord *cent = &cam->current_image->location;
+    int xdist, ydist;
+    int64_t xdist_sum, ydist_sum, variance_x, variance_y, variance_xy;
+    int64_t distance_mean, dist_sum, dist_sq;
+
+    cent->maxx = 0;
+    cent->maxy = 0;
+    cent->minx = width;
+    cent->miny = height;
+
+    location_dist_sums(xdist_sum, ydist_sum, variance_x, variance_y);
+    xdist = (int)xdist_sum;
+    ydist = (int)ydist_sum;
+
+    location_dist_radial(dist_sum, dist_sq);
 
     if (centc) {
         cent->minx = cent->x - xdist / centc * 3;
@@ -1041,65 +1943,39 @@ void cls_alg::location_dist_stddev()
         cent->maxy = cent->y + ydist / centc * 3;
         cent->stddev_x = (int)sqrt((variance_x / centc));
         cent->stddev_y = (int)sqrt((variance_y / centc));
-        distance_mean = (int64_t)(distance_mean / centc);
+        distance_mean = (int64_t)(dist_sum / centc);
     } else {
         cent->stddev_y = 0;
         cent->stddev_x = 0;
         distance_mean = 0;
     }
 
-    variance_xy = 0;
-    out = imgs->image_motion.image_norm;
-    for (y = 0; y < height; y++) {
-        for (x = 0; x < width; x++) {
-            if (*(out++)) {
-                variance_xy += (
-                    ((int64_t)sqrt(((x - cent->x) * (x - cent->x)) +
-                          ((y - cent->y) * (y - cent->y))) - distance_mean) *
-                    ((int64_t)sqrt(((x - cent->x) * (x - cent->x)) +
-                          ((y - cent->y) * (y - cent->y))) - distance_mean));
-            }
-        }
-    }
+    /* The sum of (distance - distance_mean) squared from the sums */
+    variance_xy = dist_sq - (2 * distance_mean * dist_sum) +
+        (centc * distance_mean * distance_mean);
+
     /* Per statistics, divide by n-1 for calc of a standard deviation */
     if ((centc-1) > 0) {
         cent->stddev_xy = (int)sqrt((variance_xy / (centc-1)));
     }
 }
 
-void cls_alg::location_dist_basic()
+void cls_alg::location_dist_basic(int centc)
 {
-    ctx_images *imgs = &cam->imgs;
-    int width = cam->imgs.width;
-    int height = cam->imgs.height;
+    int width = cam->imgs.det_width;
+    int height = cam->imgs.det_height;
     ctx_coord *cent = &cam->current_image->location;
-    u_char *out = imgs->image_motion.image_norm;
-    int x, y, centc = 0, xdist = 0, ydist = 0;
+    int xdist, ydist;
+    int64_t xdist_sum, ydist_sum, variance_x, variance_y;
 
     cent->maxx = 0;
     cent->maxy = 0;
     cent->minx = width;
     cent->miny = height;
 
-    for (y = 0; y < height; y++) {
-        for (x = 0; x < width; x++) {
-            if (*(out++)) {
-                if (x > cent->x) {
-                    xdist += x - cent->x;
-                } else if (x < cent->x) {
-                    xdist += cent->x - x;
-                }
-
-                if (y > cent->y) {
-                    ydist += y - cent->y;
-                } else if (y < cent->y) {
-                    ydist += cent->y - y;
-                }
-
-                centc++;
-            }
-        }
-    }
+    location_dist_sums(xdist_sum, ydist_sum, variance_x, variance_y);
+    xdist = (int)xdist_sum;
+    ydist = (int)ydist_sum;
 
     if (centc) {
         cent->minx = cent->x - xdist / centc * 3;
@@ -1112,6 +1988,23 @@ void cls_alg::location_dist_basic()
     }
 }
 
+/* Convert the location from the detection plane to the image coordinates*/
+void cls_alg::location_scale()
+{
+    int scale = cam->imgs.det_scale;
+    ctx_coord *cent = &cam->current_image->location;
+
+    cent->x *= scale;
+    cent->y *= scale;
+    cent->minx *= scale;
+    cent->maxx *= scale;
+    cent->miny *= scale;
+    cent->maxy *= scale;
+    cent->stddev_x *= scale;
+    cent->stddev_y *= scale;
+    cent->stddev_xy *= scale;
+}
+
 /* Ensure min/max are within limits*/
 void cls_alg::location_minmax()
 {
@@ -1158,13 +2051,23 @@ void cls_alg::location_minmax()
 /* Determine the location and standard deviations of changes*/
 void cls_alg::location()
 {
-    location_center();
+    int centc;
+
+    time_start();
+
+    centc = location_counts();
+    location_center(centc);
     if (calc_stddev) {
-        location_dist_stddev();
+        location_dist_stddev(centc);
     } else {
-        location_dist_basic();
+        location_dist_basic(centc);
+    }
+    if (cam->imgs.det_scale > 1) {
+        location_scale();
     }
     location_minmax();
+
+    time_add(ALG_TIME_LOCATION);
 }
 
 /* Apply user or default thresholds on standard deviations*/
@@ -1191,13 +2094,59 @@ void cls_alg::stddev()
     }
 }
 
+/*
+ * Convert the results from the detection plane to the image size.  The
+ * diffs are counted in image pixels so that the thresholds keep their
+ * meaning and the motion image is enlarged for the pictures, movies
+ * and streams.
+ */
+void cls_alg::diff_scale()
+{
+    int x, y, i;
+    int scale = cam->imgs.det_scale;
+    int width = cam->imgs.width;
+    int det_width = cam->imgs.det_width;
+    u_char *src = cam->imgs.image_detect_motion;
+    u_char *dst = cam->imgs.image_motion.image_norm;
+
+    cam->current_image->diffs *= det_area;
+    cam->current_image->diffs_raw *= det_area;
+
+    for (y = 0; y < cam->imgs.det_height; y++) {
+        for (x = 0; x < det_width; x++) {
+            for (i = 0; i < scale; i++) {
+                dst[(x * scale) + i] = src[x];
+            }
+        }
+        for (i = 1; i < scale; i++) {
+            memcpy(dst + (i * width), dst, (uint)width);
+        }
+        src += det_width;
+        dst += width * scale;
+    }
+    memset(cam->imgs.image_motion.image_norm + cam->imgs.motionsize
+        , 128, (uint)(cam->imgs.motionsize / 2));
+}
+
 void cls_alg::diff()
 {
-    if (cam->detecting_motion) {
+    /* The histogram for noise_tune is collected when it may run */
+    noise_on = (cam->cfg->noise_tune && (cam->shots_mt == 0) &&
+        (cam->detecting_motion == false));
+    noise_valid = false;
+
+    time_start();
+
+    if (block_map != nullptr) {
+        diff_prescreen();
+        diff_standard();
+        noise_valid = noise_on;
+    } else if (cam->detecting_motion) {
         diff_standard();
     } else {
         if (diff_fast()) {
             diff_standard();
+            noise_valid = noise_on;
         } else {
             cam->current_image->diffs = 0;
             cam->current_image->diffs_raw = 0;
@@ -1205,14 +2154,411 @@ void cls_alg::diff()
         }
     }
     lightswitch();
+    time_add(ALG_TIME_DIFF);
     despeckle();
+    time_add(ALG_TIME_DESPECKLE);
+    if (cam->imgs.det_scale > 1) {
+        diff_scale();
+    }
+    time_add(ALG_TIME_DIFF);
 }
 
-cls_alg::cls_alg(cls_camera *p_cam)
+/* Begin timing a stage */
+void cls_alg::time_start()
 {
-    int i;
+    if (timing) {
+        clock_gettime(CLOCK_MONOTONIC, &time_st);
+    }
+}
+
+/* Add the time since the last mark to the stage and start the next one */
+void cls_alg::time_add(ALG_TIME stage)
+{
+    struct timespec ts;
+
+    if (timing == false) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    time_ns[stage] += ((int64_t)(ts.tv_sec - time_st.tv_sec) * 1000000000L)
+        + (ts.tv_nsec - time_st.tv_nsec);
+    time_st = ts;
+}
+
+static void *alg_band_handler(void *arg)
+{
+    ctx_alg_band *band = (ctx_alg_band *)arg;
+
+    band->alg->band_handler(band);
+
+    pthread_exit(nullptr);
+}
+
+/* Worker for the bands after the first.  The first band is done by the camera thread */
+void cls_alg::band_handler(ctx_alg_band *band)
+{
+    int gen;
+
+    mythreadname_set("dt", cam->cfg->device_id, cam->cfg->device_name.c_str());
+
+    gen = 0;
+    pthread_mutex_lock(&band_mutex);
+    while (band_stop == false) {
+        if (band_gen == gen) {
+            pthread_cond_wait(&band_start, &band_mutex);
+            continue;
+        }
+        gen = band_gen;
+        pthread_mutex_unlock(&band_mutex);
+
+        band_run(band);
+
+        pthread_mutex_lock(&band_mutex);
+        band_busy--;
+        if (band_busy == 0) {
+            pthread_cond_signal(&band_done);
+        }
+    }
+    pthread_mutex_unlock(&band_mutex);
+}
+
+/* Do the current stage for one band */
+void cls_alg::band_run(ctx_alg_band *band)
+{
+    int width = cam->imgs.det_width;
+
+    if (band_stage == ALG_STAGE_PRESCREEN) {
+        prescreen_band(band);
+    } else if (band_stage == ALG_STAGE_DIFF) {
+        band->diffs = 0;
+        band->diffs_net = 0;
+        if (noise_on) {
+            memset(band->noise_hist, 0, sizeof(band->noise_hist));
+        }
+        band->pending.clear();
+        diff_band(band);
+    } else if (band_stage == ALG_STAGE_DESPECKLE) {
+        band->diffs = despeckle_band(band);
+    } else {
+        ref_frame_range(band->row_st * width
+            , (band->row_en - band->row_st) * width, nullptr);
+    }
+}
+
+/* Give the stage to the workers, do the first band and wait for the rest */
+void cls_alg::band_post(ALG_STAGE stage)
+{
+    pthread_mutex_lock(&band_mutex);
+    band_stage = stage;
+    band_busy = band_cnt - 1;
+    band_gen++;
+    pthread_cond_broadcast(&band_start);
+    pthread_mutex_unlock(&band_mutex);
+
+    band_run(&bands[0]);
+
+    pthread_mutex_lock(&band_mutex);
+    while (band_busy > 0) {
+        pthread_cond_wait(&band_done, &band_mutex);
+    }
+    pthread_mutex_unlock(&band_mutex);
+}
+
+/*
+ * Split the detection plane into threads bands of whole block rows and
+ * start a worker for each band after the first.
+ */
+void cls_alg::band_init(int threads)
+{
+    int indx, tiles, width, retcd;
+    ctx_alg_band *band;
+
+    width = cam->imgs.det_width;
+    tiles = (cam->imgs.det_height + ALG_BLOCK_SIZE - 1) / ALG_BLOCK_SIZE;
+
+    band_cnt = MIN(threads, tiles);
+    band_workers = 0;
+    band_gen = 0;
+    band_busy = 0;
+    band_stop = false;
+    band_stage = ALG_STAGE_DIFF;
+    band_filter = 'E';
+    bands = new ctx_alg_band[band_cnt];
+
+    for (indx = 0; indx < band_cnt; indx++) {
+        band = &bands[indx];
+        band->alg = this;
+        band->row_st = ((indx * tiles) / band_cnt) * ALG_BLOCK_SIZE;
+        band->row_en = MIN((((indx + 1) * tiles) / band_cnt) * ALG_BLOCK_SIZE
+            , cam->imgs.det_height);
+        band->diffs = 0;
+        band->diffs_net = 0;
+        band->blocks = 0;
+        memset(band->noise_hist, 0, sizeof(band->noise_hist));
+        band->buffer = nullptr;
+        band->halo = nullptr;
+        if (fused) {
+            band->pending.reserve((uint)((band->row_en - band->row_st) * width));
+        }
+        if (band_cnt > 1) {
+            band->buffer =(u_char*) mymalloc((uint)(3 * width));
+            band->halo =(u_char*) mymalloc((uint)(2 * width));
+        }
+    }
 
+    if (band_cnt == 1) {
+        return;
+    }
+
+    pthread_mutex_init(&band_mutex, NULL);
+    pthread_cond_init(&band_start, NULL);
+    pthread_cond_init(&band_done, NULL);
+
+    for (indx = 1; indx < band_cnt; indx++) {
+        retcd = pthread_create(&bands[indx].thread_id, NULL
+            , &alg_band_handler, &bands[indx]);
+        if (retcd != 0) {
+            MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+                , _("Unable to start detection thread.  Using 1"));
+            band_deinit();
+            band_init(1);
+            return;
+        }
+        band_workers++;
+    }
+
+    MOTION_LOG(INF, TYPE_ALL, NO_ERRNO
+        , _("Motion detection in %d bands"), band_cnt);
+}
+
+/* Stop the workers and free the bands */
+void cls_alg::band_deinit()
+{
+    int indx;
+
+    if (bands == nullptr) {
+        return;
+    }
+
+    if (band_cnt > 1) {
+        pthread_mutex_lock(&band_mutex);
+        band_stop = true;
+        pthread_cond_broadcast(&band_start);
+        pthread_mutex_unlock(&band_mutex);
+
+        for (indx = 1; indx <= band_workers; indx++) {
+            pthread_join(bands[indx].thread_id, NULL);
+        }
+
+        pthread_cond_destroy(&band_done);
+        pthread_cond_destroy(&band_start);
+        pthread_mutex_destroy(&band_mutex);
+    }
+
+    for (indx = 0; indx < band_cnt; indx++) {
+        myfree(bands[indx].buffer);
+        myfree(bands[indx].halo);
+    }
+    delete [] bands;
+    bands = nullptr;
+    band_cnt = 0;
+}
+
+void cls_alg::params_log()
+{
+    ctx_params_item *itm;
+    int indx;
+
+    for (indx=0;indx<params->params_cnt;indx++) {
+        itm = &params->params_array[indx];
+        MOTION_SHT(INF, TYPE_ALL, NO_ERRNO, "%-25s %s"
+            ,itm->param_name.c_str(),itm->param_value.c_str());
+    }
+}
+
+void cls_alg::params_model()
+{
+    ctx_params_item *itm;
+    int indx;
+
+    for (indx=0;indx<params->params_cnt;indx++) {
+        itm = &params->params_array[indx];
+        if (itm->param_name == "simd") {
+            diff_kernel_nm = itm->param_value;
+        } else if (itm->param_name == "simd_check") {
+            simd_check = mtob(itm->param_value);
+        } else if (itm->param_name == "fused") {
+            fused = mtob(itm->param_value);
+        } else if (itm->param_name == "labeling") {
+            labeling_nm = itm->param_value;
+        } else if (itm->param_name == "prescreen") {
+            prescreen_nm = itm->param_value;
+        } else if (itm->param_name == "threads") {
+            band_cnt = mtoi(itm->param_value);
+        } else if (itm->param_name == "packed") {
+            packed = mtob(itm->param_value);
+        } else if (itm->param_name == "background") {
+            bg_nm = itm->param_value;
+        } else if (itm->param_name == "background_rate") {
+            bg_rate = mtoi(itm->param_value);
+        }
+    }
+}
+
+void cls_alg::params_defaults()
+{
+    util_parms_add_default(params, "simd", "auto");
+    util_parms_add_default(params, "simd_check", "off");
+    util_parms_add_default(params, "fused", "off");
+    util_parms_add_default(params, "labeling", "flood");
+    util_parms_add_default(params, "prescreen", "block");
+    util_parms_add_default(params, "threads", "1");
+    util_parms_add_default(params, "packed", "off");
+    util_parms_add_default(params, "background", "blend");
+    util_parms_add_default(params, "background_rate", "2");
+}
+
+/**Load the detect_params and select the diff kernel */
+void cls_alg::load_params()
+{
+    int uf_cnt;
+
+    diff_kernel = nullptr;
+    diff_kernel_nm = "auto";
+    simd_check = false;
+    check_out = nullptr;
+    check_buffer = nullptr;
+    fused = false;
+    noise_on = false;
+    noise_valid = false;
+    memset(noise_hist, 0, sizeof(noise_hist));
+    fused_ref = false;
+    labeling_nm = "flood";
+    uf_parent = nullptr;
+    uf_size = nullptr;
+    uf_label = nullptr;
+    prescreen_nm = "block";
+    block_cols = 0;
+    block_rows = 0;
+    block_active_cnt = 0;
+    block_sad = nullptr;
+    block_map = nullptr;
+    block_active = nullptr;
+    block_kernel = nullptr;
+    fused_defer = false;
+    band_cnt = 1;
+    bands = nullptr;
+    packed = false;
+    packed_valid = false;
+    packed_words = 0;
+    motion_bits = nullptr;
+    bg_nm = "blend";
+    bg_rate = 2;
+    bg_frame = 0;
+    bg_tick = 0;
+    bg_limit = ALG_BG_TIMER;
+    bg_words = nullptr;
+
+    params = new ctx_params;
+    util_parms_parse(params, "detect_params", cam->cfg->parm_cam.detect_params);
+
+    params_defaults();
+
+    params_log();
+
+    params_model();
+
+    diff_kernel = alg_simd_select(diff_kernel_nm, diff_kernel_nm);
+    MOTION_LOG(INF, TYPE_ALL, NO_ERRNO
+        , _("Using %s diff kernel"), diff_kernel_nm.c_str());
+
+    if (diff_kernel == nullptr) {
+        simd_check = false;
+    }
+
+    if (simd_check) {
+        MOTION_LOG(NTC, TYPE_ALL, NO_ERRNO
+            , _("Checking %s diff kernel against scalar results")
+            , diff_kernel_nm.c_str());
+        check_out =(u_char*) mymalloc((uint)cam->imgs.det_size);
+        check_buffer =(int*) mymalloc((uint)cam->imgs.det_size * sizeof(*check_buffer));
+    }
+
+    if (fused) {
+        MOTION_LOG(INF, TYPE_ALL, NO_ERRNO, _("Using fused diff and reference update"));
+    }
+
+    if (labeling_nm == "unionfind") {
+        /* A new label needs a gap on the left so at most half of each row */
+        uf_cnt = (cam->imgs.det_size / 2) + cam->imgs.det_height + 2;
+        uf_parent =(int*) mymalloc((uint)uf_cnt * sizeof(*uf_parent));
+        uf_size =(int*) mymalloc((uint)uf_cnt * sizeof(*uf_size));
+        uf_label =(int*) mymalloc((uint)uf_cnt * sizeof(*uf_label));
+    } else if (labeling_nm != "flood") {
+        MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+            , _("Invalid labeling method %s.  Using flood"), labeling_nm.c_str());
+        labeling_nm = "flood";
+    }
+
+    if ((prescreen_nm != "block") && (prescreen_nm != "sample")) {
+        MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+            , _("Invalid prescreen method %s.  Using block"), prescreen_nm.c_str());
+        prescreen_nm = "block";
+    }
+
+    if (prescreen_nm == "block") {
+        block_cols = (cam->imgs.det_width + ALG_BLOCK_SIZE - 1) / ALG_BLOCK_SIZE;
+        block_rows = (cam->imgs.det_height + ALG_BLOCK_SIZE - 1) / ALG_BLOCK_SIZE;
+        block_sad =(int*) mymalloc((uint)(block_cols * block_rows) * sizeof(*block_sad));
+        block_map =(u_char*) mymalloc((uint)(block_cols * block_rows));
+        block_active =(u_char*) mymalloc((uint)(block_cols * block_rows));
+        block_kernel = alg_simd_block_select(diff_kernel_nm);
+    }
+
+    if (packed) {
+        MOTION_LOG(INF, TYPE_ALL, NO_ERRNO, _("Using packed motion mask for despeckle"));
+        packed_words = (cam->imgs.det_width + 63) / 64;
+        motion_bits =(uint64_t*) mymalloc((uint)(packed_words * cam->imgs.det_height)
+            * sizeof(*motion_bits));
+    }
+
+    if (bg_nm == "average") {
+        if ((bg_rate < 1) || (bg_rate > ALG_BG_FRAC)) {
+            MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+                , _("Invalid background_rate %d.  Using 2"), bg_rate);
+            bg_rate = 2;
+        }
+        MOTION_LOG(INF, TYPE_ALL, NO_ERRNO
+            , _("Using running average background with rate 1/%d"), 1 << bg_rate);
+        bg_words =(uint16_t*) mymalloc((uint)cam->imgs.det_size * sizeof(*bg_words));
+    } else if (bg_nm != "blend") {
+        MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+            , _("Invalid background model %s.  Using blend"), bg_nm.c_str());
+        bg_nm = "blend";
+    }
+    /* The average keeps its timers in bg_words so only blend needs these */
+    if (bg_words == nullptr) {
+        cam->imgs.ref_dyn =(int*) mymalloc((uint)cam->imgs.det_size
+            * sizeof(*cam->imgs.ref_dyn));
+    }
+
+    if ((band_cnt < 1) || (band_cnt > ALG_THREADS_MAX)) {
+        MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+            , _("Invalid threads %d.  Using 1"), band_cnt);
+        band_cnt = 1;
+    }
+    if ((band_cnt > 1) && simd_check) {
+        MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+            , _("The simd_check is only done with threads=1.  Using 1"));
+        band_cnt = 1;
+    }
+    band_init(band_cnt);
+}
+
+cls_alg::cls_alg(cls_camera *p_cam)
+{
     cam = p_cam;
+    det_area = cam->imgs.det_scale * cam->imgs.det_scale;
 
     if ((cam->cfg->threshold_sdevx == 0) &&
         (cam->cfg->threshold_sdevy == 0) &&
@@ -1222,25 +2568,55 @@ cls_alg::cls_alg(cls_camera *p_cam)
         calc_stddev = true;
     }
 
-    smartmask =(unsigned char*) mymalloc((uint)cam->imgs.motionsize);
-    smartmask_final =(unsigned char*) mymalloc((uint)cam->imgs.motionsize);
-    smartmask_buffer =(int*) mymalloc((uint)cam->imgs.motionsize * sizeof(*smartmask_buffer));
+    smartmask =(unsigned char*) mymalloc((uint)cam->imgs.det_size);
+    smartmask_final =(unsigned char*) mymalloc((uint)cam->imgs.det_size);
+    smartmask_buffer =(int*) mymalloc((uint)cam->imgs.det_size * sizeof(*smartmask_buffer));
 
-    memset(smartmask, 0, (uint)cam->imgs.motionsize);
-    memset(smartmask_final, 255, (uint)cam->imgs.motionsize);
-    memset(smartmask_buffer, 0, (uint)cam->imgs.motionsize * sizeof(*smartmask_buffer));
+    memset(smartmask, 0, (uint)cam->imgs.det_size);
+    memset(smartmask_final, 255, (uint)cam->imgs.det_size);
+    memset(smartmask_buffer, 0, (uint)cam->imgs.det_size * sizeof(*smartmask_buffer));
 
-    for (i = 0; i < THRESHOLD_TUNE_LENGTH - 1; i++) {
-        diffs_last[i] = 0;
-    }
+    timing = false;
+    memset(time_ns, 0, sizeof(time_ns));
+    memset(&time_st, 0, sizeof(time_st));
+
+    loc_cols =(int*) mymalloc((uint)cam->imgs.det_width * sizeof(*loc_cols));
+    loc_rows =(int*) mymalloc((uint)cam->imgs.det_height * sizeof(*loc_rows));
+
+    /* The history begins with every entry unset */
+    memset(tune_ring, 0, sizeof(tune_ring));
+    tune_pos = THRESHOLD_TUNE_LENGTH;
+    tune_fill_end = THRESHOLD_TUNE_LENGTH;
+    tune_fill = 0;
+    tune_sum = 0;
+    tune_max_head = 0;
+    tune_max_cnt = 0;
+    tune_max_push(tune_fill_end - 1, tune_fill);
+
+    load_params();
 
 }
 
 cls_alg::~cls_alg()
 {
+    band_deinit();
     myfree(smartmask);
     myfree(smartmask_final);
     myfree(smartmask_buffer);
+    myfree(check_out);
+    myfree(check_buffer);
+    myfree(uf_parent);
+    myfree(uf_size);
+    myfree(uf_label);
+    myfree(block_sad);
+    myfree(block_map);
+    myfree(block_active);
+    myfree(motion_bits);
+    myfree(bg_words);
+    myfree(cam->imgs.ref_dyn);
+    myfree(loc_cols);
+    myfree(loc_rows);
+    mydelete(params);
 
 }
 
@@ -19,8 +19,42 @@
 #ifndef _INCLUDE_ALG_HPP_
 #define _INCLUDE_ALG_HPP_
     #define THRESHOLD_TUNE_LENGTH  256
+    #define NOISE_HIST_LENGTH  256
+    #define ALG_THREADS_MAX  16
+
+    enum ALG_STAGE {
+        ALG_STAGE_PRESCREEN,
+        ALG_STAGE_DIFF,
+        ALG_STAGE_DESPECKLE,
+        ALG_STAGE_REF
+    };
+
+    /* Stages timed when cls_alg::timing is set */
+    enum ALG_TIME {
+        ALG_TIME_DIFF,
+        ALG_TIME_DESPECKLE,
+        ALG_TIME_LABELING,
+        ALG_TIME_LOCATION,
+        ALG_TIME_CNT
+    };
+
+    /* One horizontal band of the detection plane and its partial results */
+    struct ctx_alg_band {
+        cls_alg     *alg;
+        pthread_t   thread_id;
+        int         row_st;         /* First row of the band */
+        int         row_en;         /* Row after the last row of the band */
+        int         diffs;
+        int         diffs_net;
+        int         blocks;         /* Active blocks from the pre-screen */
+        int         noise_hist[NOISE_HIST_LENGTH];
+        std::vector<int>    pending;    /* Reference pixels left for ref_frame_update */
+        u_char      *buffer;        /* Rows for the erode and dilate filters */
+        u_char      *halo;          /* Rows above and below the band before the filter */
+    };
 
     class cls_alg {
+        friend class cls_bench;
         public:
             cls_alg(cls_camera *p_cam);
             ~cls_alg();
@@ -32,34 +66,140 @@
             void ref_frame_reset();
             void stddev();
             void location();
+            void band_handler(ctx_alg_band *band);
             u_char  *smartmask_final;
+            int     block_cols;
+            int     block_rows;
+            int     block_active_cnt;   /* Active blocks in the current image */
+            int     *block_sad;         /* Sum of abs differences for each block */
+            u_char  *block_map;         /* Activity of each block, bit 0 is the current image */
+            bool    timing;             /* Add the time of each stage to time_ns */
+            int64_t time_ns[ALG_TIME_CNT];
         private:
             cls_camera *cam;
+            int     det_area;           /* Image pixels per detection plane pixel */
             int     smartmask_count;
             u_char  *smartmask;
             int     *smartmask_buffer;
-            int     diffs_last[THRESHOLD_TUNE_LENGTH];
+            int     tune_ring[THRESHOLD_TUNE_LENGTH];  /* Recent diffs for threshold_tune */
+            int64_t tune_pos;           /* Position of the next diffs in the history */
+            int64_t tune_fill_end;      /* Positions before this hold tune_fill */
+            int     tune_fill;
+            int64_t tune_sum;           /* Sum of the history */
+            int64_t tune_max_pos[THRESHOLD_TUNE_LENGTH];   /* Candidates for the top of the history */
+            int     tune_max_val[THRESHOLD_TUNE_LENGTH];
+            int     tune_max_head;
+            int     tune_max_cnt;
             bool    calc_stddev;
+            ctx_params  *params;
+            alg_diff_fn diff_kernel;
+            std::string diff_kernel_nm;
+            bool        simd_check;
+            u_char      *check_out;
+            int         *check_buffer;
+            bool        fused;
+            bool        noise_on;       /* Collect noise_hist during the diff */
+            bool        noise_valid;    /* noise_hist is for the current image */
+            int         noise_hist[NOISE_HIST_LENGTH];
+            bool        fused_ref;
+            bool        fused_defer;
+            std::string labeling_nm;
+            int         *uf_parent;
+            int         *uf_size;
+            int         *uf_label;      /* Final label value of each root */
+            std::string prescreen_nm;
+            u_char      *block_active;
+            alg_block_fn block_kernel;
+            int             band_cnt;
+            ctx_alg_band    *bands;
+            int             band_workers;   /* Threads started for bands after the first */
+            pthread_mutex_t band_mutex;
+            pthread_cond_t  band_start;
+            pthread_cond_t  band_done;
+            int             band_gen;       /* Incremented for each stage given to the workers */
+            int             band_busy;      /* Workers that have not finished the stage */
+            bool            band_stop;
+            ALG_STAGE       band_stage;
+            char            band_filter;    /* Despeckle filter for ALG_STAGE_DESPECKLE */
+            ctx_diff_kernel band_dk;
+            bool        packed;
+            bool        packed_valid;   /* motion_bits holds the motion image */
+            int         packed_words;   /* Words in each row of motion_bits */
+            uint64_t    *motion_bits;
+            std::string bg_nm;
+            int         bg_rate;
+            int         bg_frame;       /* Images since the timers were last advanced */
+            int         bg_tick;        /* Timer increment for the current image */
+            int         bg_limit;       /* Timer value where static objects are accepted */
+            uint16_t    *bg_words;      /* Running average background and timers */
+            struct timespec time_st;    /* Start of the stage being timed */
+            int         *loc_cols;      /* Changed pixels in each column */
+            int         *loc_rows;      /* Changed pixels in each row */
 
             int iflood(int x, int y, int width, int height,
                 u_char *out, int *labels, int newvalue, int oldvalue);
             int labeling();
-            int dilate9(u_char *img, int width, int height, void *buffer);
-            int dilate5(u_char *img, int width, int height, void *buffer);
-            int erode9(u_char *img, int width, int height, void *buffer, u_char flag);
-            int erode5(u_char *img, int width, int height, void *buffer, u_char flag);
+            int labeling_unionfind();
+            int uf_find(int id);
+            int dilate9(u_char *img, int width, int height, void *buffer
+                , const u_char *above, const u_char *below);
+            int dilate5(u_char *img, int width, int height, void *buffer
+                , const u_char *above, const u_char *below);
+            int erode9(u_char *img, int width, int height, void *buffer, u_char flag
+                , const u_char *above, const u_char *below);
+            int erode5(u_char *img, int width, int height, void *buffer, u_char flag
+                , const u_char *above, const u_char *below);
             void despeckle();
+            int despeckle_filter(char filter);
+            int despeckle_band(ctx_alg_band *band);
+            void despeckle_unpack();
             void diff_nomask();
             void diff_mask();
             void diff_smart();
             void diff_masksmart();
             bool diff_fast();
             void diff_standard();
+            void diff_kernel_init(ctx_diff_kernel *dk);
+            void diff_kernel_run(ctx_diff_kernel *dk, int offset);
+            void diff_results(int diffs, int diffs_net);
+            void diff_kernel_part(ctx_diff_kernel *dk, int indx, int count
+                , int &diffs, int &diffs_net);
+            void diff_block_row(ctx_diff_kernel *dk, int by, int &diffs, int &diffs_net);
+            void diff_blocks();
+            void diff_prescreen();
+            void prescreen_band(ctx_alg_band *band);
+            void diff_simd();
+            void diff_simd_check(ctx_diff_kernel *dk, int offset);
+            void diff_fused();
+            void diff_bands();
+            void diff_band(ctx_alg_band *band);
+            void diff_scale();
+            void noise_tune_hist(int start, int count, int *hist);
+            int tune_value(int64_t pos);
+            void tune_max_push(int64_t pos, int val);
+            void tune_max_fill();
+            void ref_frame_range(int start, int count, std::vector<int> *pending);
+            void ref_frame_average(int start, int count);
             void lightswitch();
-            void location_center();
-            void location_dist_stddev();
-            void location_dist_basic();
+            int location_counts();
+            void location_center(int centc);
+            void location_dist_sums(int64_t &xdist, int64_t &ydist
+                , int64_t &variance_x, int64_t &variance_y);
+            void location_dist_radial(int64_t &dist_sum, int64_t &dist_sq);
+            void location_dist_stddev(int centc);
+            void location_dist_basic(int centc);
+            void location_scale();
             void location_minmax();
+            void params_defaults();
+            void params_log();
+            void params_model();
+            void load_params();
+            void time_start();
+            void time_add(ALG_TIME stage);
+            void band_init(int threads);
+            void band_deinit();
+            void band_post(ALG_STAGE stage);
+            void band_run(ctx_alg_band *band);
 
     };
 
@@ -0,0 +1,858 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * alg_simd.cpp - Vectorized motion diff kernels
+ *
+ * All kernels work on the absolute difference |ref - img| as an unsigned
+ * byte and derive the sign from which of the two values is larger.  This
+ * matches the scalar int arithmetic exactly:
+ *   - (curdiff * mask) / 255 truncates toward zero so the magnitude is
+ *     (|curdiff| * mask) / 255 with the sign unchanged.
+ *   - abs(curdiff) > noise is |curdiff| >= noise + 1.
+ * The division by 255 uses (x + 1 + (x >> 8)) >> 8 which is exact for
+ * all products of two bytes.
+ */
+
+#include "motion.hpp"
+#include "util.hpp"
+#include "logger.hpp"
+#include "alg_simd.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define HAVE_SIMD_X86
+    #include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define HAVE_SIMD_NEON
+    #include <arm_neon.h>
+#endif
+
+/* Scalar kernel.  Used as the fallback and for the tail of vector loops */
+static void alg_simd_diff_range(ctx_diff_kernel *dk, int start)
+{
+    int indx, curdiff;
+    int diffs = 0, diffs_net = 0;
+
+    for (indx = start; indx < dk->count; indx++) {
+        curdiff = (dk->ref[indx] - dk->img[indx]);
+        if (dk->mask != nullptr) {
+            curdiff = ((curdiff * dk->mask[indx]) / 255);
+        }
+        if ((dk->hist != nullptr) && dk->histmask[indx]) {
+            dk->hist[abs(curdiff)]++;
+        }
+        if (dk->smartmask != nullptr) {
+            if (abs(curdiff) > dk->noise) {
+                dk->smartbuf[indx] += dk->smart_incr;
+                if (dk->smartmask[indx] == 0) {
+                    curdiff = 0;
+                }
+            }
+        }
+        if (abs(curdiff) > dk->noise) {
+            dk->out[indx] = dk->img[indx];
+            diffs++;
+            if (curdiff > dk->lrgchg) {
+                diffs_net++;
+            } else if (curdiff < -dk->lrgchg) {
+                diffs_net--;
+            }
+        } else {
+            dk->out[indx] = 0;
+        }
+    }
+    dk->diffs += diffs;
+    dk->diffs_net += diffs_net;
+}
+
+void alg_simd_diff_scalar(ctx_diff_kernel *dk)
+{
+    dk->diffs = 0;
+    dk->diffs_net = 0;
+    alg_simd_diff_range(dk, 0);
+}
+
+/*
+ * Thresholds as unsigned byte comparisons.  A value of -1 means the
+ * comparison can never be true (threshold above 254).  A negative noise
+ * level makes every pixel count even after the smart mask has zeroed it
+ * and a negative large change level makes the scalar net count depend on
+ * the sign of the diff in a way the byte compares do not follow.  Both of
+ * those cases are left to the scalar code.
+ */
+static int alg_simd_thresh(int val)
+{
+    if (val < 0) {
+        return 0;
+    } else if (val >= 255) {
+        return -1;
+    }
+    return val + 1;
+}
+
+#ifdef HAVE_SIMD_X86
+
+__attribute__((target("sse2")))
+static void alg_simd_diff_sse2(ctx_diff_kernel *dk)
+{
+    int indx, loops, n1, l1;
+    int64_t tot_m, tot_p, tot_n;
+    __m128i zero, vn1, vl1, vincr, r, p, ad, raw, mot, gt, sm;
+    __m128i cnt_m, cnt_p, cnt_n, pos, neg, lo, hi, m, w;
+
+    dk->diffs = 0;
+    dk->diffs_net = 0;
+
+    n1 = alg_simd_thresh(dk->noise);
+    l1 = alg_simd_thresh(dk->lrgchg);
+    if (n1 == -1) {
+        memset(dk->out, 0, (uint)dk->count);
+        return;
+    } else if ((n1 == 0) || (dk->lrgchg < 0)) {
+        alg_simd_diff_range(dk, 0);
+        return;
+    }
+
+    zero = _mm_setzero_si128();
+    vn1 = _mm_set1_epi8((char)n1);
+    vl1 = _mm_set1_epi8((char)(l1 == -1 ? 0 : l1));
+    vincr = _mm_set1_epi32(dk->smart_incr);
+    cnt_m = cnt_p = cnt_n = zero;
+    tot_m = tot_p = tot_n = 0;
+    loops = 0;
+
+    for (indx = 0; indx + 16 <= dk->count; indx += 16) {
+        r = _mm_loadu_si128((const __m128i *)(dk->ref + indx));
+        p = _mm_loadu_si128((const __m128i *)(dk->img + indx));
+        ad = _mm_or_si128(_mm_subs_epu8(r, p), _mm_subs_epu8(p, r));
+
+        if (dk->mask != nullptr) {
+            m = _mm_loadu_si128((const __m128i *)(dk->mask + indx));
+            lo = _mm_mullo_epi16(_mm_unpacklo_epi8(ad, zero), _mm_unpacklo_epi8(m, zero));
+            hi = _mm_mullo_epi16(_mm_unpackhi_epi8(ad, zero), _mm_unpackhi_epi8(m, zero));
+            lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, _mm_set1_epi16(1))
+                , _mm_srli_epi16(lo, 8)), 8);
+            hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, _mm_set1_epi16(1))
+                , _mm_srli_epi16(hi, 8)), 8);
+            ad = _mm_packus_epi16(lo, hi);
+        }
+
+        raw = _mm_cmpeq_epi8(_mm_max_epu8(ad, vn1), ad);
+
+        if (dk->smartmask != nullptr) {
+            if (dk->smart_incr != 0) {
+                lo = _mm_unpacklo_epi8(raw, raw);
+                hi = _mm_unpackhi_epi8(raw, raw);
+                w = _mm_loadu_si128((const __m128i *)(dk->smartbuf + indx));
+                w = _mm_add_epi32(w, _mm_and_si128(_mm_unpacklo_epi16(lo, lo), vincr));
+                _mm_storeu_si128((__m128i *)(dk->smartbuf + indx), w);
+                w = _mm_loadu_si128((const __m128i *)(dk->smartbuf + indx + 4));
+                w = _mm_add_epi32(w, _mm_and_si128(_mm_unpackhi_epi16(lo, lo), vincr));
+                _mm_storeu_si128((__m128i *)(dk->smartbuf + indx + 4), w);
+                w = _mm_loadu_si128((const __m128i *)(dk->smartbuf + indx + 8));
+                w = _mm_add_epi32(w, _mm_and_si128(_mm_unpacklo_epi16(hi, hi), vincr));
+                _mm_storeu_si128((__m128i *)(dk->smartbuf + indx + 8), w);
+                w = _mm_loadu_si128((const __m128i *)(dk->smartbuf + indx + 12));
+                w = _mm_add_epi32(w, _mm_and_si128(_mm_unpackhi_epi16(hi, hi), vincr));
+                _mm_storeu_si128((__m128i *)(dk->smartbuf + indx + 12), w);
+            }
+            sm = _mm_loadu_si128((const __m128i *)(dk->smartmask + indx));
+            mot = _mm_andnot_si128(_mm_cmpeq_epi8(sm, zero), raw);
+        } else {
+            mot = raw;
+        }
+
+        _mm_storeu_si128((__m128i *)(dk->out + indx), _mm_and_si128(mot, p));
+
+        if (l1 == -1) {
+            gt = zero;
+        } else {
+            gt = _mm_and_si128(mot, _mm_cmpeq_epi8(_mm_max_epu8(ad, vl1), ad));
+        }
+        pos = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_subs_epu8(r, p), zero), gt);
+        neg = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_subs_epu8(p, r), zero), gt);
+
+        cnt_m = _mm_sub_epi8(cnt_m, mot);
+        cnt_p = _mm_sub_epi8(cnt_p, pos);
+        cnt_n = _mm_sub_epi8(cnt_n, neg);
+
+        if (++loops == 255) {
+            w = _mm_sad_epu8(cnt_m, zero);
+            tot_m += _mm_cvtsi128_si32(w) + _mm_cvtsi128_si32(_mm_srli_si128(w, 8));
+            w = _mm_sad_epu8(cnt_p, zero);
+            tot_p += _mm_cvtsi128_si32(w) + _mm_cvtsi128_si32(_mm_srli_si128(w, 8));
+            w = _mm_sad_epu8(cnt_n, zero);
+            tot_n += _mm_cvtsi128_si32(w) + _mm_cvtsi128_si32(_mm_srli_si128(w, 8));
+            cnt_m = cnt_p = cnt_n = zero;
+            loops = 0;
+        }
+    }
+
+    w = _mm_sad_epu8(cnt_m, zero);
+    tot_m += _mm_cvtsi128_si32(w) + _mm_cvtsi128_si32(_mm_srli_si128(w, 8));
+    w = _mm_sad_epu8(cnt_p, zero);
+    tot_p += _mm_cvtsi128_si32(w) + _mm_cvtsi128_si32(_mm_srli_si128(w, 8));
+    w = _mm_sad_epu8(cnt_n, zero);
+    tot_n += _mm_cvtsi128_si32(w) + _mm_cvtsi128_si32(_mm_srli_si128(w, 8));
+
+    dk->diffs = (int)tot_m;
+    dk->diffs_net = (int)(tot_p - tot_n);
+
+    alg_simd_diff_range(dk, indx);
+}
+
+__attribute__((target("avx2")))
+static int64_t alg_simd_sum_avx2(__m256i cnt)
+{
+    __m256i w;
+    w = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+    return _mm256_extract_epi64(w, 0) + _mm256_extract_epi64(w, 1) +
+        _mm256_extract_epi64(w, 2) + _mm256_extract_epi64(w, 3);
+}
+
+__attribute__((target("avx2")))
+static void alg_simd_smartbuf_avx2(int *buf, __m128i raw, __m256i vincr)
+{
+    __m256i w;
+
+    w = _mm256_loadu_si256((const __m256i *)buf);
+    w = _mm256_add_epi32(w, _mm256_and_si256(_mm256_cvtepi8_epi32(raw), vincr));
+    _mm256_storeu_si256((__m256i *)buf, w);
+
+    w = _mm256_loadu_si256((const __m256i *)(buf + 8));
+    w = _mm256_add_epi32(w, _mm256_and_si256(
+        _mm256_cvtepi8_epi32(_mm_srli_si128(raw, 8)), vincr));
+    _mm256_storeu_si256((__m256i *)(buf + 8), w);
+}
+
+__attribute__((target("avx2")))
+static void alg_simd_diff_avx2(ctx_diff_kernel *dk)
+{
+    int indx, loops, n1, l1;
+    int64_t tot_m, tot_p, tot_n;
+    __m256i zero, vn1, vl1, vincr, one, r, p, ad, raw, mot, gt, sm;
+    __m256i cnt_m, cnt_p, cnt_n, pos, neg, lo, hi, m;
+
+    dk->diffs = 0;
+    dk->diffs_net = 0;
+
+    n1 = alg_simd_thresh(dk->noise);
+    l1 = alg_simd_thresh(dk->lrgchg);
+    if (n1 == -1) {
+        memset(dk->out, 0, (uint)dk->count);
+        return;
+    } else if ((n1 == 0) || (dk->lrgchg < 0)) {
+        alg_simd_diff_range(dk, 0);
+        return;
+    }
+
+    zero = _mm256_setzero_si256();
+    one = _mm256_set1_epi16(1);
+    vn1 = _mm256_set1_epi8((char)n1);
+    vl1 = _mm256_set1_epi8((char)(l1 == -1 ? 0 : l1));
+    vincr = _mm256_set1_epi32(dk->smart_incr);
+    cnt_m = cnt_p = cnt_n = zero;
+    tot_m = tot_p = tot_n = 0;
+    loops = 0;
+
+    for (indx = 0; indx + 32 <= dk->count; indx += 32) {
+        r = _mm256_loadu_si256((const __m256i *)(dk->ref + indx));
+        p = _mm256_loadu_si256((const __m256i *)(dk->img + indx));
+        ad = _mm256_or_si256(_mm256_subs_epu8(r, p), _mm256_subs_epu8(p, r));
+
+        if (dk->mask != nullptr) {
+            /* Unpack and pack are both per 128 bit lane so the order is kept */
+            m = _mm256_loadu_si256((const __m256i *)(dk->mask + indx));
+            lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(ad, zero)
+                , _mm256_unpacklo_epi8(m, zero));
+            hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(ad, zero)
+                , _mm256_unpackhi_epi8(m, zero));
+            lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(lo, one)
+                , _mm256_srli_epi16(lo, 8)), 8);
+            hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(hi, one)
+                , _mm256_srli_epi16(hi, 8)), 8);
+            ad = _mm256_packus_epi16(lo, hi);
+        }
+
+        raw = _mm256_cmpeq_epi8(_mm256_max_epu8(ad, vn1), ad);
+
+        if (dk->smartmask != nullptr) {
+            if (dk->smart_incr != 0) {
+                alg_simd_smartbuf_avx2(dk->smartbuf + indx
+                    , _mm256_castsi256_si128(raw), vincr);
+                alg_simd_smartbuf_avx2(dk->smartbuf + indx + 16
+                    , _mm256_extracti128_si256(raw, 1), vincr);
+            }
+            sm = _mm256_loadu_si256((const __m256i *)(dk->smartmask + indx));
+            mot = _mm256_andnot_si256(_mm256_cmpeq_epi8(sm, zero), raw);
+        } else {
+            mot = raw;
+        }
+
+        _mm256_storeu_si256((__m256i *)(dk->out + indx), _mm256_and_si256(mot, p));
+
+        if (l1 == -1) {
+            gt = zero;
+        } else {
+            gt = _mm256_and_si256(mot
+                , _mm256_cmpeq_epi8(_mm256_max_epu8(ad, vl1), ad));
+        }
+        pos = _mm256_andnot_si256(
+            _mm256_cmpeq_epi8(_mm256_subs_epu8(r, p), zero), gt);
+        neg = _mm256_andnot_si256(
+            _mm256_cmpeq_epi8(_mm256_subs_epu8(p, r), zero), gt);
+
+        cnt_m = _mm256_sub_epi8(cnt_m, mot);
+        cnt_p = _mm256_sub_epi8(cnt_p, pos);
+        cnt_n = _mm256_sub_epi8(cnt_n, neg);
+
+        if (++loops == 255) {
+            tot_m += alg_simd_sum_avx2(cnt_m);
+            tot_p += alg_simd_sum_avx2(cnt_p);
+            tot_n += alg_simd_sum_avx2(cnt_n);
+            cnt_m = cnt_p = cnt_n = zero;
+            loops = 0;
+        }
+    }
+
+    tot_m += alg_simd_sum_avx2(cnt_m);
+    tot_p += alg_simd_sum_avx2(cnt_p);
+    tot_n += alg_simd_sum_avx2(cnt_n);
+
+    dk->diffs = (int)tot_m;
+    dk->diffs_net = (int)(tot_p - tot_n);
+
+    alg_simd_diff_range(dk, indx);
+}
+
+#endif /* HAVE_SIMD_X86 */
+
+#ifdef HAVE_SIMD_NEON
+
+static uint32x4_t alg_simd_acc_neon(uint32x4_t acc, uint8x16_t cnt)
+{
+    return vpadalq_u16(acc, vpaddlq_u8(cnt));
+}
+
+static int64_t alg_simd_sum_neon(uint32x4_t acc)
+{
+    return (int64_t)vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1) +
+        vgetq_lane_u32(acc, 2) + vgetq_lane_u32(acc, 3);
+}
+
+static uint8x8_t alg_simd_div255_neon(uint16x8_t x)
+{
+    return vshrn_n_u16(vaddq_u16(vaddq_u16(x, vdupq_n_u16(1)), vshrq_n_u16(x, 8)), 8);
+}
+
+static void alg_simd_diff_neon(ctx_diff_kernel *dk)
+{
+    int indx, loops, n1, l1;
+    uint8x16_t vn1, vl1, r, p, ad, raw, mot, gt, m, pos, neg;
+    uint8x16_t cnt_m, cnt_p, cnt_n;
+    uint32x4_t acc_m, acc_p, acc_n;
+    int16x8_t raw16;
+    int32x4_t vincr;
+
+    dk->diffs = 0;
+    dk->diffs_net = 0;
+
+    n1 = alg_simd_thresh(dk->noise);
+    l1 = alg_simd_thresh(dk->lrgchg);
+    if (n1 == -1) {
+        memset(dk->out, 0, (uint)dk->count);
+        return;
+    } else if ((n1 == 0) || (dk->lrgchg < 0)) {
+        alg_simd_diff_range(dk, 0);
+        return;
+    }
+
+    vn1 = vdupq_n_u8((uint8_t)n1);
+    vl1 = vdupq_n_u8((uint8_t)(l1 == -1 ? 0 : l1));
+    vincr = vdupq_n_s32(dk->smart_incr);
+    cnt_m = cnt_p = cnt_n = vdupq_n_u8(0);
+    acc_m = acc_p = acc_n = vdupq_n_u32(0);
+    loops = 0;
+
+    for (indx = 0; indx + 16 <= dk->count; indx += 16) {
+        r = vld1q_u8(dk->ref + indx);
+        p = vld1q_u8(dk->img + indx);
+        ad = vabdq_u8(r, p);
+
+        if (dk->mask != nullptr) {
+            m = vld1q_u8(dk->mask + indx);
+            ad = vcombine_u8(
+                alg_simd_div255_neon(vmull_u8(vget_low_u8(ad), vget_low_u8(m))),
+                alg_simd_div255_neon(vmull_u8(vget_high_u8(ad), vget_high_u8(m))));
+        }
+
+        raw = vcgeq_u8(ad, vn1);
+
+        if (dk->smartmask != nullptr) {
+            if (dk->smart_incr != 0) {
+                raw16 = vmovl_s8(vget_low_s8(vreinterpretq_s8_u8(raw)));
+                vst1q_s32(dk->smartbuf + indx, vaddq_s32(vld1q_s32(dk->smartbuf + indx)
+                    , vandq_s32(vmovl_s16(vget_low_s16(raw16)), vincr)));
+                vst1q_s32(dk->smartbuf + indx + 4, vaddq_s32(vld1q_s32(dk->smartbuf + indx + 4)
+                    , vandq_s32(vmovl_s16(vget_high_s16(raw16)), vincr)));
+                raw16 = vmovl_s8(vget_high_s8(vreinterpretq_s8_u8(raw)));
+                vst1q_s32(dk->smartbuf + indx + 8, vaddq_s32(vld1q_s32(dk->smartbuf + indx + 8)
+                    , vandq_s32(vmovl_s16(vget_low_s16(raw16)), vincr)));
+                vst1q_s32(dk->smartbuf + indx + 12, vaddq_s32(vld1q_s32(dk->smartbuf + indx + 12)
+                    , vandq_s32(vmovl_s16(vget_high_s16(raw16)), vincr)));
+            }
+            m = vld1q_u8(dk->smartmask + indx);
+            mot = vandq_u8(raw, vtstq_u8(m, m));
+        } else {
+            mot = raw;
+        }
+
+        vst1q_u8(dk->out + indx, vandq_u8(mot, p));
+
+        if (l1 == -1) {
+            gt = vdupq_n_u8(0);
+        } else {
+            gt = vandq_u8(mot, vcgeq_u8(ad, vl1));
+        }
+        pos = vandq_u8(gt, vcgtq_u8(r, p));
+        neg = vandq_u8(gt, vcgtq_u8(p, r));
+
+        cnt_m = vsubq_u8(cnt_m, mot);
+        cnt_p = vsubq_u8(cnt_p, pos);
+        cnt_n = vsubq_u8(cnt_n, neg);
+
+        if (++loops == 255) {
+            acc_m = alg_simd_acc_neon(acc_m, cnt_m);
+            acc_p = alg_simd_acc_neon(acc_p, cnt_p);
+            acc_n = alg_simd_acc_neon(acc_n, cnt_n);
+            cnt_m = cnt_p = cnt_n = vdupq_n_u8(0);
+            loops = 0;
+        }
+    }
+
+    acc_m = alg_simd_acc_neon(acc_m, cnt_m);
+    acc_p = alg_simd_acc_neon(acc_p, cnt_p);
+    acc_n = alg_simd_acc_neon(acc_n, cnt_n);
+
+    dk->diffs = (int)alg_simd_sum_neon(acc_m);
+    dk->diffs_net = (int)(alg_simd_sum_neon(acc_p) - alg_simd_sum_neon(acc_n));
+
+    alg_simd_diff_range(dk, indx);
+}
+
+#endif /* HAVE_SIMD_NEON */
+
+/*
+ * Block pre-screen.  The image is walked row by row so the memory is read
+ * in order and the results are accumulated into the blocks of the row.
+ * A block is active when any pixel differs by more than the noise.  The
+ * mask file and smart mask only reduce the difference so the diff of an
+ * inactive block is always zero.
+ */
+static void alg_simd_block_range(ctx_block_kernel *bk, int y, int x0)
+{
+    int x, ad, n1, indx, blk;
+
+    n1 = alg_simd_thresh(bk->noise);
+    indx = y * bk->width;
+    blk = (y / ALG_BLOCK_SIZE) * bk->cols;
+
+    for (x = x0; x < bk->width; x++) {
+        ad = abs(bk->ref[indx + x] - bk->img[indx + x]);
+        bk->sad[blk + x / ALG_BLOCK_SIZE] += ad;
+        if ((n1 != -1) && (ad >= n1)) {
+            bk->active[blk + x / ALG_BLOCK_SIZE] = 1;
+        }
+    }
+}
+
+void alg_simd_block_scalar(ctx_block_kernel *bk)
+{
+    int y, cnt;
+
+    cnt = bk->cols * ((bk->height + ALG_BLOCK_SIZE - 1) / ALG_BLOCK_SIZE);
+    memset(bk->sad, 0, (uint)cnt * sizeof(*bk->sad));
+    memset(bk->active, 0, (uint)cnt);
+
+    for (y = 0; y < bk->height; y++) {
+        alg_simd_block_range(bk, y, 0);
+    }
+}
+
+#ifdef HAVE_SIMD_X86
+
+__attribute__((target("sse2")))
+static void alg_simd_block_sse2(ctx_block_kernel *bk)
+{
+    int y, bx, full, cnt, n1, blk, indx;
+    __m128i zero, vn1, r, p, ad, w;
+
+    n1 = alg_simd_thresh(bk->noise);
+    if (n1 <= 0) {
+        alg_simd_block_scalar(bk);
+        return;
+    }
+
+    cnt = bk->cols * ((bk->height + ALG_BLOCK_SIZE - 1) / ALG_BLOCK_SIZE);
+    memset(bk->sad, 0, (uint)cnt * sizeof(*bk->sad));
+    memset(bk->active, 0, (uint)cnt);
+
+    zero = _mm_setzero_si128();
+    vn1 = _mm_set1_epi8((char)n1);
+    full = bk->width / ALG_BLOCK_SIZE;
+
+    for (y = 0; y < bk->height; y++) {
+        indx = y * bk->width;
+        blk = (y / ALG_BLOCK_SIZE) * bk->cols;
+        for (bx = 0; bx < full; bx++) {
+            r = _mm_loadu_si128((const __m128i *)(bk->ref + indx));
+            p = _mm_loadu_si128((const __m128i *)(bk->img + indx));
+            ad = _mm_or_si128(_mm_subs_epu8(r, p), _mm_subs_epu8(p, r));
+            w = _mm_sad_epu8(ad, zero);
+            bk->sad[blk + bx] += _mm_cvtsi128_si32(w) +
+                _mm_cvtsi128_si32(_mm_srli_si128(w, 8));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(ad, vn1), ad)) != 0) {
+                bk->active[blk + bx] = 1;
+            }
+            indx += ALG_BLOCK_SIZE;
+        }
+        alg_simd_block_range(bk, y, full * ALG_BLOCK_SIZE);
+    }
+}
+
+#endif /* HAVE_SIMD_X86 */
+
+#ifdef HAVE_SIMD_NEON
+
+static void alg_simd_block_neon(ctx_block_kernel *bk)
+{
+    int y, bx, full, cnt, n1, blk, indx;
+    uint8x16_t vn1, ad, m;
+    uint64x2_t w;
+    uint8x8_t t;
+
+    n1 = alg_simd_thresh(bk->noise);
+    if (n1 <= 0) {
+        alg_simd_block_scalar(bk);
+        return;
+    }
+
+    cnt = bk->cols * ((bk->height + ALG_BLOCK_SIZE - 1) / ALG_BLOCK_SIZE);
+    memset(bk->sad, 0, (uint)cnt * sizeof(*bk->sad));
+    memset(bk->active, 0, (uint)cnt);
+
+    vn1 = vdupq_n_u8((uint8_t)n1);
+    full = bk->width / ALG_BLOCK_SIZE;
+
+    for (y = 0; y < bk->height; y++) {
+        indx = y * bk->width;
+        blk = (y / ALG_BLOCK_SIZE) * bk->cols;
+        for (bx = 0; bx < full; bx++) {
+            ad = vabdq_u8(vld1q_u8(bk->ref + indx), vld1q_u8(bk->img + indx));
+            w = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(ad)));
+            bk->sad[blk + bx] += (int)(vgetq_lane_u64(w, 0) + vgetq_lane_u64(w, 1));
+            m = vcgeq_u8(ad, vn1);
+            t = vorr_u8(vget_low_u8(m), vget_high_u8(m));
+            if (vget_lane_u64(vreinterpret_u64_u8(t), 0) != 0) {
+                bk->active[blk + bx] = 1;
+            }
+            indx += ALG_BLOCK_SIZE;
+        }
+        alg_simd_block_range(bk, y, full * ALG_BLOCK_SIZE);
+    }
+}
+
+#endif /* HAVE_SIMD_NEON */
+
+/* Block kernel for the diff kernel name returned by alg_simd_select */
+alg_block_fn alg_simd_block_select(std::string selected)
+{
+    #ifdef HAVE_SIMD_X86
+        /* A block row is 16 bytes so avx2 uses the sse2 version */
+        if ((selected == "avx2") || (selected == "sse2")) {
+            return &alg_simd_block_sse2;
+        }
+    #endif
+    #ifdef HAVE_SIMD_NEON
+        if (selected == "neon") {
+            return &alg_simd_block_neon;
+        }
+    #endif
+    return &alg_simd_block_scalar;
+}
+
+/* Pack the motion image into one bit per pixel, set when the pixel is not zero */
+void alg_simd_bits_pack(const u_char *img, int width, int height
+    , int words, uint64_t *bits)
+{
+    int x, y;
+    uint64_t *row;
+
+    memset(bits, 0, (uint)(words * height) * sizeof(*bits));
+    for (y = 0; y < height; y++) {
+        row = bits + (y * words);
+        for (x = 0; x < width; x++) {
+            if (img[x] != 0) {
+                row[x >> 6] |= (uint64_t)1 << (x & 63);
+            }
+        }
+        img += width;
+    }
+}
+
+/*
+ * Expand the packed mask back into the motion image.  Set pixels take the
+ * value of the image so that they are not zero.
+ */
+void alg_simd_bits_unpack(const uint64_t *bits, int width, int height
+    , int words, const u_char *img, u_char *out)
+{
+    int x, y;
+    const uint64_t *row;
+
+    for (y = 0; y < height; y++) {
+        row = bits + (y * words);
+        for (x = 0; x < width; x++) {
+            if ((row[x >> 6] >> (x & 63)) & 1) {
+                out[x] = (img[x] == 0) ? 1 : img[x];
+            } else {
+                out[x] = 0;
+            }
+        }
+        img += width;
+        out += width;
+    }
+}
+
+/* Pixels to the left and right of each pixel in word k of a packed row */
+static inline uint64_t alg_simd_bits_left(const uint64_t *row, int k)
+{
+    return (row[k] << 1) | ((k > 0) ? (row[k - 1] >> 63) : 0);
+}
+
+static inline uint64_t alg_simd_bits_right(const uint64_t *row, int k, int words)
+{
+    return (row[k] >> 1) | ((k < words - 1) ? (row[k + 1] << 63) : 0);
+}
+
+/*
+ * Erode (E, e) or dilate (D, d) the packed mask in place.  The results and
+ * count are the same as erode9, erode5, dilate9 and dilate5 with a flag of
+ * zero give for the pixels which are not zero.
+ */
+int alg_simd_bits_filter(ctx_bits_kernel *bk, char filter)
+{
+    int y, k, sum, words, lastbit;
+    uint64_t v, lastmask;
+    uint64_t *prev, *cur, *zero, *tmp, *row;
+    const uint64_t *up, *dn;
+
+    words = bk->words;
+    prev = bk->buffer;
+    cur = prev + words;
+    zero = cur + words;
+    memset(zero, 0, (uint)words * sizeof(*zero));
+    if (bk->above != nullptr) {
+        memcpy(prev, bk->above, (uint)words * sizeof(*prev));
+    } else {
+        memset(prev, 0, (uint)words * sizeof(*prev));
+    }
+
+    /* The first and last column are always cleared */
+    lastbit = (bk->width - 1) & 63;
+    lastmask = (lastbit == 63) ? ~(uint64_t)0 : (((uint64_t)1 << (lastbit + 1)) - 1);
+    lastmask &= ~((uint64_t)1 << lastbit);
+
+    sum = 0;
+    row = bk->bits;
+    for (y = 0; y < bk->height; y++) {
+        memcpy(cur, row, (uint)words * sizeof(*cur));
+        up = prev;
+        if (y < bk->height - 1) {
+            dn = row + words;
+        } else if (bk->below != nullptr) {
+            dn = bk->below;
+        } else {
+            dn = zero;
+        }
+
+        for (k = 0; k < words; k++) {
+            if (filter == 'E') {
+                v = up[k] & alg_simd_bits_left(up, k) & alg_simd_bits_right(up, k, words) &
+                    cur[k] & alg_simd_bits_left(cur, k) & alg_simd_bits_right(cur, k, words) &
+                    dn[k] & alg_simd_bits_left(dn, k) & alg_simd_bits_right(dn, k, words);
+            } else if (filter == 'e') {
+                v = up[k] & dn[k] &
+                    cur[k] & alg_simd_bits_left(cur, k) & alg_simd_bits_right(cur, k, words);
+            } else if (filter == 'D') {
+                v = up[k] | alg_simd_bits_left(up, k) | alg_simd_bits_right(up, k, words) |
+                    cur[k] | alg_simd_bits_left(cur, k) | alg_simd_bits_right(cur, k, words) |
+                    dn[k] | alg_simd_bits_left(dn, k) | alg_simd_bits_right(dn, k, words);
+            } else {
+                v = up[k] | dn[k] |
+                    cur[k] | alg_simd_bits_left(cur, k) | alg_simd_bits_right(cur, k, words);
+            }
+            if (k == 0) {
+                v &= ~(uint64_t)1;
+            }
+            if (k == words - 1) {
+                v &= lastmask;
+            }
+            row[k] = v;
+            sum += __builtin_popcountll(v);
+        }
+
+        /* The original of this row is the row above the next one */
+        tmp = prev;
+        prev = cur;
+        cur = tmp;
+        row += words;
+    }
+
+    return sum;
+}
+
+/*
+ * Update the running average background.  Pixels that differ from the
+ * background by more than the threshold within the smart mask and are part
+ * of the motion image are left out and their timer advanced.  Once the
+ * timer reaches the limit the pixel is taken as a static object.  All
+ * other pixels move toward the image by 1/2^rate of the difference.
+ */
+void alg_simd_bg_update(ctx_bg_kernel *bk)
+{
+    int indx, word, bg, timer, lvl, diff, keep, accept;
+    int count = bk->count, thresh = bk->threshold, rate = bk->rate;
+    int tick = bk->tick, limit = bk->limit;
+    int half = 1 << (rate - 1);
+    uint16_t *bgw = bk->bg;
+    u_char *ref = bk->ref;
+    const u_char *img = bk->img;
+    const u_char *smartmask = bk->smartmask;
+    const u_char *out = bk->out;
+
+    for (indx = 0; indx < count; indx++) {
+        word = bgw[indx];
+        bg = word >> ALG_BG_FRAC;
+        lvl = img[indx] << ALG_BG_FRAC;
+        diff = ref[indx] - img[indx];
+
+        /* All ones when the pixel is left out of the background */
+        keep = -((diff > thresh) | (-diff > thresh));
+        keep &= -(smartmask[indx] != 0) & -(out[indx] != 0);
+        timer = ((word & ALG_BG_TIMER) + tick) & keep;
+        accept = -(timer >= limit);
+
+        bg = (bg & keep) | ((bg + ((lvl - bg + half) >> rate)) & ~keep);
+        bg = (lvl & accept) | (bg & ~accept);
+        timer &= ~accept;
+
+        bgw[indx] = (uint16_t)((bg << ALG_BG_FRAC) | timer);
+        ref[indx] = (u_char)((bg + (1 << (ALG_BG_FRAC - 1))) >> ALG_BG_FRAC);
+    }
+}
+
+/*
+ * Reduce a plane by scale in each direction using the rounded mean of
+ * each scale x scale box.  The width and height must be multiples of scale.
+ */
+void alg_simd_downscale(const u_char *src, int width, int height
+    , int scale, u_char *dst)
+{
+    int x, y, bx, by, sum, area;
+    const u_char *row;
+
+    area = scale * scale;
+    for (y = 0; y < height; y += scale) {
+        for (x = 0; x < width; x += scale) {
+            sum = 0;
+            row = src + (y * width) + x;
+            for (by = 0; by < scale; by++) {
+                for (bx = 0; bx < scale; bx++) {
+                    sum += row[bx];
+                }
+                row += width;
+            }
+            *dst++ = (u_char)((sum + (area / 2)) / area);
+        }
+    }
+}
+
+/* Select the diff kernel.  want is auto, scalar, sse2, avx2 or neon */
+alg_diff_fn alg_simd_select(std::string want, std::string &selected)
+{
+    bool has_sse2, has_avx2, has_neon;
+
+    has_sse2 = false;
+    has_avx2 = false;
+    has_neon = false;
+
+    #ifdef HAVE_SIMD_X86
+        __builtin_cpu_init();
+        has_sse2 = __builtin_cpu_supports("sse2");
+        has_avx2 = __builtin_cpu_supports("avx2");
+    #endif
+    #ifdef HAVE_SIMD_NEON
+        has_neon = true;
+    #endif
+
+    if (((want == "avx2") && !has_avx2) ||
+        ((want == "sse2") && !has_sse2) ||
+        ((want == "neon") && !has_neon)) {
+        MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+            , _("Diff kernel %s not supported by this CPU"), want.c_str());
+        want = "auto";
+    } else if ((want != "auto") && (want != "scalar") &&
+        (want != "avx2") && (want != "sse2") && (want != "neon")) {
+        MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+            , _("Invalid diff kernel %s"), want.c_str());
+        want = "auto";
+    }
+
+    if (want == "auto") {
+        if (has_avx2) {
+            want = "avx2";
+        } else if (has_sse2) {
+            want = "sse2";
+        } else if (has_neon) {
+            want = "neon";
+        } else {
+            want = "scalar";
+        }
+    }
+
+    selected = want;
+
+    #ifdef HAVE_SIMD_X86
+        if (want == "avx2") {
+            return &alg_simd_diff_avx2;
+        } else if (want == "sse2") {
+            return &alg_simd_diff_sse2;
+        }
+    #endif
+    #ifdef HAVE_SIMD_NEON
+        if (want == "neon") {
+            return &alg_simd_diff_neon;
+        }
+    #endif
+
+    selected = "scalar";
+    return nullptr;
+}
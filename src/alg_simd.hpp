@@ -0,0 +1,118 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * alg_simd.hpp - Vectorized motion diff kernels
+ *
+ * The kernels produce exactly the same motion image, diff counts and
+ * smart mask buffer updates as the scalar cls_alg::diff_* functions.
+ * The block kernels compute the pre-screen for each 16x16 block of the
+ * image.  The implementation is selected once at camera start based upon
+ * the features reported by the CPU.  Only the scalar kernel fills the
+ * histogram of differences used by noise_tune.  The bits kernels erode
+ * and dilate the motion image packed to one bit per pixel.  The
+ * downscale reduces the luma plane to the size used for detection and
+ * the background update is written without branches so the compiler can
+ * vectorize it.
+ */
+
+#ifndef _INCLUDE_ALG_SIMD_HPP_
+#define _INCLUDE_ALG_SIMD_HPP_
+
+    /* Arguments and results for one pass of a diff kernel */
+    struct ctx_diff_kernel {
+        const u_char    *ref;           /* Reference frame */
+        const u_char    *img;           /* Image with the privacy mask applied */
+        const u_char    *mask;          /* Mask file values or nullptr */
+        const u_char    *smartmask;     /* Final smart mask or nullptr */
+        int             *smartbuf;      /* Smart mask buffer (when smartmask) */
+        u_char          *out;           /* Motion image (Y plane only) */
+        int             count;          /* Number of pixels to process */
+        int             noise;
+        int             lrgchg;         /* threshold_ratio_change */
+        int             smart_incr;     /* Increment for smartbuf or zero */
+        const u_char    *histmask;      /* Pixels counted in hist */
+        int             *hist;          /* Histogram of the masked differences or nullptr */
+        int             diffs;          /* Result: changed pixels */
+        int             diffs_net;      /* Result: net large changes */
+    };
+
+    typedef void (*alg_diff_fn)(ctx_diff_kernel *dk);
+
+    #define ALG_BLOCK_SIZE  16
+
+    /* Arguments and results for the block pre-screen */
+    struct ctx_block_kernel {
+        const u_char    *ref;           /* Reference frame */
+        const u_char    *img;           /* Image with the privacy mask applied */
+        int             width;
+        int             height;
+        int             noise;
+        int             cols;           /* Blocks per row */
+        int             *sad;           /* Result: sum of abs differences per block */
+        u_char          *active;        /* Result: 1 when a pixel differs by more than noise */
+    };
+
+    typedef void (*alg_block_fn)(ctx_block_kernel *bk);
+
+    /* Arguments for the erode and dilate filters on the packed motion mask */
+    struct ctx_bits_kernel {
+        uint64_t        *bits;          /* Mask with one bit per pixel */
+        int             words;          /* Words in each row of bits */
+        int             width;
+        int             height;
+        const uint64_t  *above;         /* Row above the mask or nullptr at the image edge */
+        const uint64_t  *below;         /* Row below the mask or nullptr at the image edge */
+        uint64_t        *buffer;        /* Three rows of words */
+    };
+
+    /*
+     * Background model as a running average.  Each word holds the
+     * background in 8.4 fixed point above a 4 bit static object timer.
+     */
+    #define ALG_BG_FRAC     4
+    #define ALG_BG_TIMER    15
+
+    /* Arguments for one pass of the running average background update */
+    struct ctx_bg_kernel {
+        uint16_t        *bg;            /* Background and timer words */
+        u_char          *ref;           /* Result: background rounded to bytes */
+        const u_char    *img;           /* Image with the privacy mask applied */
+        const u_char    *smartmask;     /* Final smart mask */
+        const u_char    *out;           /* Motion image */
+        int             count;          /* Number of pixels to process */
+        int             threshold;      /* Differences above this may be excluded */
+        int             rate;           /* Learning rate as a shift, 1 to 4 */
+        int             tick;           /* Added to the timer of excluded pixels */
+        int             limit;          /* Timer value where the pixel is accepted */
+    };
+
+    void alg_simd_diff_scalar(ctx_diff_kernel *dk);
+    alg_diff_fn alg_simd_select(std::string want, std::string &selected);
+    void alg_simd_block_scalar(ctx_block_kernel *bk);
+    alg_block_fn alg_simd_block_select(std::string selected);
+    void alg_simd_bits_pack(const u_char *img, int width, int height
+        , int words, uint64_t *bits);
+    void alg_simd_bits_unpack(const uint64_t *bits, int width, int height
+        , int words, const u_char *img, u_char *out);
+    int alg_simd_bits_filter(ctx_bits_kernel *bk, char filter);
+    void alg_simd_bg_update(ctx_bg_kernel *bk);
+    void alg_simd_downscale(const u_char *src, int width, int height
+        , int scale, u_char *dst);
+
+#endif /* _INCLUDE_ALG_SIMD_HPP_ */
@@ -24,6 +24,9 @@
 #include "allcam.hpp"
 #include "camera.hpp"
 #include "jpegutils.hpp"
+#include "framepool.hpp"
+#include "pacer.hpp"
+#include "webu_getimg.hpp"
 
 
 static void *allcam_handler(void *arg)
@@ -59,9 +62,11 @@ void cls_allcam::getsizes_img(cls_camera *p_cam)
     p_cam->all_sizes.dst_sz = (dst_w * dst_h * 3)/2;
 }
 
-void cls_allcam::getimg_src(cls_camera *p_cam, std::string imgtyp, u_char *dst_img, u_char *src_img)
+void cls_allcam::getimg_src(cls_camera *p_cam, std::string imgtyp, u_char *dst_img, u_char *src_img
+    , struct SwsContext **swsctx)
 {
-    int indx;
+    int64_t wait_ns;
+    struct timespec ts;
     ctx_stream_data *strm_c;
 
     if (imgtyp == "norm") {
@@ -77,19 +82,19 @@ void cls_allcam::getimg_src(cls_camera *p_cam, std::string imgtyp, u_char *dst_i
     }
 
     pthread_mutex_lock(&p_cam->stream.mutex);
-        indx=0;
-        while (indx < 1000) {
-            if (strm_c->img_data == nullptr) {
-                if (strm_c->all_cnct == 0){
-                    strm_c->all_cnct++;
+        if (strm_c->img_data == nullptr) {
+            if (strm_c->all_cnct == 0){
+                strm_c->all_cnct++;
+            }
+            /* Allow the camera two frames to provide its first image */
+            wait_ns = 2000000000L / std::max(p_cam->cfg->framerate, 1);
+            mycond_deadline(&ts, wait_ns);
+            while (strm_c->img_data == nullptr) {
+                if (pthread_cond_timedwait(&p_cam->stream.cond
+                    , &p_cam->stream.mutex, &ts) == ETIMEDOUT) {
+                    break;
                 }
-                pthread_mutex_unlock(&p_cam->stream.mutex);
-                    SLEEP(0, 1000);
-                pthread_mutex_lock(&p_cam->stream.mutex);
-            } else {
-                break;
             }
-            indx++;
         }
         if ((p_cam->imgs.height != p_cam->all_sizes.src_h) ||
             (p_cam->imgs.width  != p_cam->all_sizes.src_w)) {
@@ -109,7 +114,7 @@ void cls_allcam::getimg_src(cls_camera *p_cam, std::string imgtyp, u_char *dst_i
     pthread_mutex_unlock(&p_cam->stream.mutex);
 
     util_resize(src_img, p_cam->all_sizes.src_w, p_cam->all_sizes.src_h
-        , dst_img, p_cam->all_sizes.dst_w, p_cam->all_sizes.dst_h);
+        , dst_img, p_cam->all_sizes.dst_w, p_cam->all_sizes.dst_h, swsctx);
 
 }
 
@@ -119,8 +124,10 @@ void cls_allcam::getimg(ctx_stream_data *strm_a, std::string imgtyp)
     int c_y, c_u, c_v; /* camera img y,u,v */
     int img_orow, img_ocol;
     int indx, row, dst_w, dst_h;
+    int jpg_sz;
     u_char *dst_img, *src_img, *all_img;
     cls_camera *p_cam;
+    ctx_stream_jpg *jpg;
 
     getsizes();
 
@@ -128,7 +135,7 @@ void cls_allcam::getimg(ctx_stream_data *strm_a, std::string imgtyp)
     a_u = (all_sizes.src_w * all_sizes.src_h);
     a_v = a_u + (a_u / 4);
 
-    all_img = (unsigned char*) mymalloc((uint)all_sizes.src_sz);
+    all_img = pool->get((size_t)all_sizes.src_sz);
     memset(all_img , 0x80, (size_t)a_u);
     memset(all_img  + a_u, 0x80, (size_t)(a_u/2));
 
@@ -140,10 +147,10 @@ void cls_allcam::getimg(ctx_stream_data *strm_a, std::string imgtyp)
         img_orow = p_cam->all_loc.offset_row;
         img_ocol = p_cam->all_loc.offset_col;
 
-        dst_img = (unsigned char*) mymalloc((uint)p_cam->all_sizes.dst_sz);
-        src_img = (unsigned char*) mymalloc((uint)p_cam->all_sizes.src_sz);
+        dst_img = pool->get((size_t)p_cam->all_sizes.dst_sz);
+        src_img = pool->get((size_t)p_cam->all_sizes.src_sz);
 
-        getimg_src(p_cam, imgtyp, dst_img, src_img);
+        getimg_src(p_cam, imgtyp, dst_img, src_img, &resize_ctx[(uint)indx]);
 
         a_y = (img_orow * all_sizes.src_w) + img_ocol;
         a_u =(all_sizes.src_h * all_sizes.src_w) +
@@ -169,23 +176,29 @@ void cls_allcam::getimg(ctx_stream_data *strm_a, std::string imgtyp)
             }
         }
 
-        myfree(dst_img);
-        myfree(src_img);
+        pool->put(dst_img);
+        pool->put(src_img);
     }
 
     pthread_mutex_lock(&stream.mutex);
         memset(strm_a->img_data, 0x80, (size_t)all_sizes.dst_sz);
         util_resize(all_img, all_sizes.src_w, all_sizes.src_h
-            , strm_a->img_data, all_sizes.dst_w, all_sizes.dst_h);
-        myfree(all_img);
-
-        strm_a->jpg_sz = jpgutl_put_yuv420p(
-            strm_a->jpg_data, all_sizes.dst_sz, strm_a->img_data
-            , all_sizes.dst_w, all_sizes.dst_h
-            , 70, NULL,NULL,NULL);
-
-        strm_a->consumed = false;
+            , strm_a->img_data, all_sizes.dst_w, all_sizes.dst_h, &resize_all);
     pthread_mutex_unlock(&stream.mutex);
+    pool->put(all_img);
+
+    /* Only this thread writes img_data so it can be encoded unlocked */
+    jpg = webu_getimg_jpg_new(pool, all_sizes.dst_sz);
+    jpg_sz = jpgenc->put_yuv420p(
+        jpg->buf + STREAM_JPG_HDR, all_sizes.dst_sz, strm_a->img_data
+        , all_sizes.dst_w, all_sizes.dst_h
+        , 70, NULL,NULL);
+    if (jpg_sz <= 0) {
+        webu_getimg_jpg_unref(jpg);
+        return;
+    }
+    webu_getimg_jpg_done(jpg, jpg_sz);
+    webu_getimg_jpg_publish(&stream, strm_a, jpg);
 
 }
 
@@ -206,9 +219,19 @@ void cls_allcam::stream_free()
         } else if (indx == 4) {
             strm = &stream.sub;
         }
-        myfree(strm->img_data);
-        myfree(strm->jpg_data);
+        pool->put(strm->img_data);
+        webu_getimg_jpg_publish(&stream, strm, nullptr);
+    }
+
+    for (indx=0;indx<(int)resize_ctx.size();indx++) {
+        sws_freeContext(resize_ctx[(uint)indx]);
     }
+    resize_ctx.clear();
+    sws_freeContext(resize_all);
+    resize_all = nullptr;
+
+    /* The sizes of the images have changed */
+    pool->trim();
 
 }
 
@@ -229,12 +252,10 @@ void cls_allcam::stream_alloc()
         } else if (indx == 4) {
             strm = &stream.sub;
         }
-        strm->img_data = (unsigned char*)
-            mymalloc((size_t)all_sizes.dst_sz);
-        strm->jpg_data = (unsigned char*)
-            mymalloc((size_t)all_sizes.dst_sz);
+        strm->img_data = pool->get((size_t)all_sizes.dst_sz);
         strm->consumed = true;
     }
+    resize_ctx.assign((uint)active_cnt, nullptr);
 
 }
 
@@ -704,28 +725,11 @@ void cls_allcam::getsizes()
 
 void cls_allcam::timing()
 {
-    struct timespec ts2;
-    int64_t sleeptm;
-
     if ((restart == true) || (handler_stop == true)) {
         return;
     }
 
-    clock_gettime(CLOCK_MONOTONIC, &ts2);
-
-    sleeptm = ((1000000L / app->cfg->stream_maxrate) -
-          (1000000L * (ts2.tv_sec - curr_ts.tv_sec)) -
-          ((ts2.tv_nsec - curr_ts.tv_nsec)/1000))*1000;
-
-    /* If over 1 second, just do one*/
-    if (sleeptm > 999999999L) {
-        SLEEP(1, 0);
-    } else if (sleeptm > 0) {
-        SLEEP(0, sleeptm);
-    }
-
-    clock_gettime(CLOCK_MONOTONIC, &curr_ts);
-
+    pacer->wait(app->cfg->stream_maxrate);
 }
 
 void cls_allcam::handler()
@@ -836,14 +840,20 @@ cls_allcam::cls_allcam(cls_motapp *p_app)
     memset(&stream, 0, sizeof(ctx_stream));
     all_sizes.reset = true;
     pthread_mutex_init(&stream.mutex, NULL);
+    mycond_init(&stream.cond);
     stream.motion.consumed = true;
     stream.norm.consumed = true;
     stream.secondary.consumed = true;
     stream.source.consumed = true;
     stream.sub.consumed = true;
-    clock_gettime(CLOCK_MONOTONIC, &curr_ts);
+    pacer = new cls_pacer();
+    jpgenc = new cls_jpgenc(nullptr);
     active_cnt    = 0;
     active_cam.clear();
+    resize_ctx.clear();
+    resize_all = nullptr;
+    pool = new cls_framepool("allcam");
+    pool->hugepages = app->cfg->parm_cam.image_hugepages;
 
     handler_startup();
 }
@@ -852,6 +862,10 @@ cls_allcam::~cls_allcam()
 {
     finish = true;
     handler_shutdown();
-    pthread_mutex_destroy(&stream.mutex);
     stream_free();
+    pthread_cond_destroy(&stream.cond);
+    pthread_mutex_destroy(&stream.mutex);
+    mydelete(pool);
+    mydelete(pacer);
+    mydelete(jpgenc);
 }
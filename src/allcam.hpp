@@ -30,6 +30,7 @@ class cls_allcam {
         void            handler();
         ctx_stream      stream;
         ctx_all_sizes   all_sizes;
+        cls_framepool   *pool;          /* Image buffers */
 
         bool    restart;
         bool    finish;
@@ -42,7 +43,10 @@ class cls_allcam {
         int watchdog;
         int max_col;
         int max_row;
-        struct timespec     curr_ts;
+        cls_pacer           *pacer;
+        cls_jpgenc          *jpgenc;        /* Used by the handler thread */
+        std::vector<struct SwsContext*> resize_ctx; /* Scaling of each camera */
+        struct SwsContext   *resize_all;            /* Scaling of the combined image */
 
         void handler_startup();
         void handler_shutdown();
@@ -60,7 +64,8 @@ class cls_allcam {
         void init_params();
         void init_validate();
         void init_cams();
-        void getimg_src(cls_camera *p_cam, std::string imgtyp, u_char *dst_img, u_char *src_img);
+        void getimg_src(cls_camera *p_cam, std::string imgtyp, u_char *dst_img, u_char *src_img
+            , struct SwsContext **swsctx);
         void getimg(ctx_stream_data *strm_a, std::string imgtyp);
 
 };
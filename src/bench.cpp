@@ -0,0 +1,857 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "motion.hpp"
+#include "util.hpp"
+#include "logger.hpp"
+#include "camera.hpp"
+#include "conf.hpp"
+#include "alg_simd.hpp"
+#include "alg.hpp"
+#include "rotate.hpp"
+#include "video_convert.hpp"
+#include "picture.hpp"
+#include "jpegutils.hpp"
+#include "draw.hpp"
+#include "bench.hpp"
+
+#include <sys/utsname.h>
+#ifdef __linux__
+    #include <sys/syscall.h>
+    #include <linux/perf_event.h>
+#endif
+
+#define BENCH_ITER_MIN  3
+#define BENCH_ITER_MAX  100000
+
+static uint32_t bench_seed;
+
+/* Repeatable pseudo random numbers so every run times the same images */
+static int bench_rand(int range)
+{
+    bench_seed = (bench_seed * 1664525) + 1013904223;
+    return (int)((bench_seed >> 8) % (uint32_t)range);
+}
+
+static u_char bench_clip(int val)
+{
+    return (u_char)MIN(MAX(val, 0), 255);
+}
+
+void cls_bench::usage()
+{
+    printf("Motion version %s, Copyright 2020-2025\n",PACKAGE_VERSION);
+    printf("\nusage:\tmotion-bench [options]\n");
+    printf("\n");
+    printf("Times the image kernels on synthetic images.\n");
+    printf("\n\n");
+    printf("Possible options:\n\n");
+    printf("-s sizes\t\tComma separated image sizes.  Default:\n");
+    printf("\t\t\t%s\n", BENCH_SIZES_DEFAULT);
+    printf("-f name\t\t\tOnly run the kernels with name in their name.\n");
+    printf("-t ms\t\t\tMinimum time for each kernel.  Default 200.\n");
+    printf("-j file\t\t\tWrite the results as JSON to file or - for stdout.\n");
+    printf("-h\t\t\tShow this screen.\n");
+    printf("\n");
+    printf("Cycles are counted by the kernel performance counters when they\n");
+    printf("are available and only for the thread running the benchmark.\n");
+    printf("\n");
+}
+
+bool cls_bench::cmdline()
+{
+    int c;
+    std::string parm;
+
+    parm = BENCH_SIZES_DEFAULT;
+
+    while ((c = getopt(argc, argv, "s:f:t:j:h?")) != EOF)
+        switch (c) {
+        case 's':
+            parm = optarg;
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 't':
+            min_ms = mtoi(optarg);
+            break;
+        case 'j':
+            json_file = optarg;
+            break;
+        case 'h':
+        case '?':
+        default:
+            usage();
+            return false;
+        }
+
+    while (parm != "") {
+        sizes.push_back(mtok(parm, ","));
+    }
+
+    return true;
+}
+
+/* Open a counter of the cycles of this thread */
+void cls_bench::perf_open()
+{
+    perf_fd = -1;
+
+    #ifdef __linux__
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        perf_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    #endif
+
+    if (perf_fd == -1) {
+        MOTION_LOG(NTC, TYPE_ALL, NO_ERRNO
+            , _("Cycle counter not available.  Only times are reported"));
+    }
+}
+
+int64_t cls_bench::perf_read()
+{
+    uint64_t val;
+
+    if (perf_fd == -1) {
+        return 0;
+    }
+    if (read(perf_fd, &val, sizeof(val)) != sizeof(val)) {
+        return 0;
+    }
+    return (int64_t)val;
+}
+
+/*
+ * The reference is a textured gradient.  The current image adds objects
+ * and noise under the default noise level.  The motion image has the
+ * objects plus single pixel speckles for the despeckle filters.
+ */
+void cls_bench::images_init()
+{
+    int x, y, indx, obj, ox, oy, ow, oh, wh;
+
+    wh = width * height;
+    img_ref =(u_char*) mymalloc((uint)((wh * 3) / 2));
+    img_cur =(u_char*) mymalloc((uint)((wh * 3) / 2));
+    img_mask =(u_char*) mymalloc((uint)wh);
+    img_src =(u_char*) mymalloc((uint)(wh * 3));
+    img_dst =(u_char*) mymalloc((uint)(wh * 3));
+
+    bench_seed = 1;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            img_ref[(y * width) + x] = bench_clip(
+                ((x + y) * 160 / (width + height)) + 40 + bench_rand(16));
+        }
+    }
+    memset(img_ref + wh, 128, (uint)(wh / 2));
+
+    for (indx = 0; indx < wh; indx++) {
+        img_cur[indx] = bench_clip(img_ref[indx] + bench_rand(5) - 2);
+        img_mask[indx] = (bench_rand(100) == 0) ? 255 : 0;
+    }
+    memset(img_cur + wh, 128, (uint)(wh / 2));
+
+    ow = width / 10;
+    oh = height / 10;
+    for (obj = 0; obj < 6; obj++) {
+        ox = ((obj % 3) * width / 3) + (width / 10);
+        oy = ((obj / 3) * height / 2) + (height / 6);
+        for (y = oy; y < oy + oh; y++) {
+            for (x = ox; x < ox + ow; x++) {
+                img_cur[(y * width) + x] = bench_clip(img_cur[(y * width) + x] + 70);
+                img_mask[(y * width) + x] = 255;
+            }
+        }
+    }
+
+    for (indx = 0; indx < (wh * 3); indx++) {
+        img_src[indx] = (u_char)bench_rand(256);
+    }
+}
+
+void cls_bench::images_deinit()
+{
+    myfree(img_ref);
+    myfree(img_cur);
+    myfree(img_mask);
+    myfree(img_src);
+    myfree(img_dst);
+}
+
+/* Set up a camera with the default config for the current size */
+void cls_bench::init_cam()
+{
+    cam = new cls_camera(app);
+    cam->cfg = new cls_config(app);
+    cam->cfg->width = width;
+    cam->cfg->height = height;
+
+    cam->init_values();
+    cam->device_status = STATUS_OPENED;
+
+    cam->imgs.width = width;
+    cam->imgs.height = height;
+    cam->imgs.motionsize = (width * height);
+    cam->imgs.size_norm = (width * height * 3) / 2;
+    cam->imgs.size_high = 0;
+    cam->imgs.labelsize_max = 0;
+    cam->imgs.largest_label = 0;
+    cam->init_detect();
+
+    cam->ring_resize();
+    cam->init_buffers();
+    cam->current_image = &cam->imgs.image_ring[cam->imgs.ring_in];
+
+    cam->noise = cam->cfg->noise_level;
+    cam->threshold = cam->cfg->threshold;
+    cam->threshold_maximum = (height * width * 3) / 2;
+
+    cam->alg = new cls_alg(cam);
+    cam->rotate = new cls_rotate(cam);
+    cam->picture = new cls_picture(cam);
+    cam->draw = new cls_draw(cam);
+    cam->init_areadetect();
+
+    /* Time the images between the noise_tune updates */
+    cam->shots_mt = 1;
+    cam->detecting_motion = false;
+    cam->cfg->despeckle_filter = "";
+}
+
+void cls_bench::deinit_cam()
+{
+    if (cam == nullptr) {
+        return;
+    }
+    cam->cleanup_buffers();
+    mydelete(cam);
+}
+
+/* Replace the cls_alg of the camera with one using detect_params */
+void cls_bench::alg_new(std::string detect_params)
+{
+    mydelete(cam->alg);
+    cam->cfg->parm_cam.detect_params = detect_params;
+    cam->alg = new cls_alg(cam);
+
+    memcpy(cam->current_image->image_norm, img_ref, (uint)cam->imgs.size_norm);
+    cam->detect_image();
+    cam->alg->ref_frame_reset();
+    memcpy(img_dst, cam->imgs.ref, (uint)cam->imgs.det_size);
+
+    memcpy(cam->current_image->image_norm, img_cur, (uint)cam->imgs.size_norm);
+    cam->detect_image();
+}
+
+void cls_bench::run_start(std::string name, std::string params, int64_t bytes)
+{
+    rslt.name = name;
+    rslt.params = params;
+    rslt.width = width;
+    rslt.height = height;
+    rslt.iterations = 0;
+    rslt.ns = 0;
+    rslt.cycles = 0;
+    rslt.bytes = bytes;
+}
+
+/* Repeat until the kernel has run for the minimum time */
+bool cls_bench::run_more()
+{
+    if (rslt.iterations < BENCH_ITER_MIN) {
+        return true;
+    }
+    return ((rslt.ns < ((int64_t)min_ms * 1000000)) &&
+        (rslt.iterations < BENCH_ITER_MAX));
+}
+
+/* Record the result.  The cycles of worker threads are not counted */
+void cls_bench::run_end(bool multithread)
+{
+    if ((perf_fd == -1) || multithread) {
+        rslt.cycles = -1;
+    }
+    report_line(&rslt);
+    results.push_back(rslt);
+}
+
+void cls_bench::mark_start()
+{
+    mark_cycles = perf_read();
+    clock_gettime(CLOCK_MONOTONIC, &mark_ts);
+}
+
+void cls_bench::mark_stop()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    rslt.cycles += perf_read() - mark_cycles;
+    rslt.ns += ((int64_t)(ts.tv_sec - mark_ts.tv_sec) * 1000000000L)
+        + (ts.tv_nsec - mark_ts.tv_nsec);
+    rslt.iterations++;
+}
+
+/* The diff of the current image and the reference update that follows */
+void cls_bench::bench_diff(std::string detect_params, bool multithread)
+{
+    int det_size;
+
+    alg_new(detect_params);
+    det_size = cam->imgs.det_size;
+
+    if (("diff" + detect_params).find(filter) != std::string::npos) {
+        run_start("diff", detect_params, det_size * 2);
+        while (run_more()) {
+            memcpy(cam->imgs.ref, img_dst, (uint)det_size);
+            mark_start();
+            cam->alg->diff();
+            mark_stop();
+        }
+        run_end(multithread);
+    }
+
+    if (("ref_update" + detect_params).find(filter) != std::string::npos) {
+        cam->alg->diff();
+        run_start("ref_update", detect_params, det_size * 2);
+        while (run_more()) {
+            memcpy(cam->imgs.ref, img_dst, (uint)det_size);
+            mark_start();
+            cam->alg->ref_frame_update();
+            mark_stop();
+        }
+        run_end(multithread);
+    }
+}
+
+void cls_bench::bench_despeckle(std::string detect_params)
+{
+    const char *filters = "EeDd";
+    const char *names[] = {"erode9", "erode5", "dilate9", "dilate5"};
+    int indx, det_size;
+
+    alg_new(detect_params);
+    det_size = cam->imgs.det_size;
+
+    for (indx = 0; indx < 4; indx++) {
+        if ((std::string(names[indx]) + detect_params).find(filter) == std::string::npos) {
+            continue;
+        }
+        run_start(names[indx], detect_params, det_size);
+        while (run_more()) {
+            memcpy(cam->imgs.image_detect_motion, img_mask, (uint)det_size);
+            cam->alg->packed_valid = false;
+            mark_start();
+            cam->alg->despeckle_filter(filters[indx]);
+            mark_stop();
+        }
+        run_end(false);
+    }
+}
+
+void cls_bench::bench_labeling(std::string detect_params)
+{
+    int det_size;
+
+    if (("labeling" + detect_params).find(filter) == std::string::npos) {
+        return;
+    }
+
+    alg_new(detect_params);
+    det_size = cam->imgs.det_size;
+
+    run_start("labeling", detect_params, det_size);
+    while (run_more()) {
+        memcpy(cam->imgs.image_detect_motion, img_mask, (uint)det_size);
+        mark_start();
+        cam->alg->labeling();
+        mark_stop();
+    }
+    run_end(false);
+}
+
+/* The rotations and flips as cls_rotate::process does them on each plane */
+void cls_bench::bench_rotate()
+{
+    u_char *img;
+    int wh, wh4, w2, h2, size;
+    cls_rotate *rotate = cam->rotate;
+
+    img = cam->current_image->image_norm;
+    wh = width * height;
+    wh4 = wh / 4;
+    w2 = width / 2;
+    h2 = height / 2;
+    size = (wh * 3) / 2;
+    memcpy(img, img_cur, (uint)size);
+
+    if (std::string("rot90cw").find(filter) != std::string::npos) {
+        run_start("rot90cw", "", size);
+        while (run_more()) {
+            mark_start();
+            rotate->rot90cw(img, img_dst, wh, width, height);
+            rotate->rot90cw(img + wh, img_dst + wh, wh4, w2, h2);
+            rotate->rot90cw(img + wh + wh4, img_dst + wh + wh4, wh4, w2, h2);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    if (std::string("rot90ccw").find(filter) != std::string::npos) {
+        run_start("rot90ccw", "", size);
+        while (run_more()) {
+            mark_start();
+            rotate->rot90ccw(img, img_dst, wh, width, height);
+            rotate->rot90ccw(img + wh, img_dst + wh, wh4, w2, h2);
+            rotate->rot90ccw(img + wh + wh4, img_dst + wh + wh4, wh4, w2, h2);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    if (std::string("rot180").find(filter) != std::string::npos) {
+        run_start("rot180", "", size);
+        while (run_more()) {
+            mark_start();
+            rotate->reverse_inplace_quad(img, wh);
+            rotate->reverse_inplace_quad(img + wh, wh4);
+            rotate->reverse_inplace_quad(img + wh + wh4, wh4);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    if (std::string("flip_horizontal").find(filter) != std::string::npos) {
+        run_start("flip_horizontal", "", size);
+        while (run_more()) {
+            mark_start();
+            rotate->flip_inplace_horizontal(img, width, height);
+            rotate->flip_inplace_horizontal(img + wh, w2, h2);
+            rotate->flip_inplace_horizontal(img + wh + wh4, w2, h2);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    if (std::string("flip_vertical").find(filter) != std::string::npos) {
+        run_start("flip_vertical", "", size);
+        while (run_more()) {
+            mark_start();
+            rotate->flip_inplace_vertical(img, width, height);
+            rotate->flip_inplace_vertical(img + wh, w2, h2);
+            rotate->flip_inplace_vertical(img + wh + wh4, w2, h2);
+            mark_stop();
+        }
+        run_end(false);
+    }
+}
+
+/* The converters of the v4l2 formats to YUV420P */
+void cls_bench::bench_convert()
+{
+    cls_convert *convert;
+    u_char *img;
+    int wh;
+
+    convert = new cls_convert(cam, 0, width, height);
+    img = cam->current_image->image_norm;
+    wh = width * height;
+
+    if (std::string("yuv422to420p").find(filter) != std::string::npos) {
+        run_start("yuv422to420p", "", wh * 2);
+        while (run_more()) {
+            mark_start();
+            convert->yuv422to420p(img, img_src);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    if (std::string("yuv422pto420p").find(filter) != std::string::npos) {
+        run_start("yuv422pto420p", "", wh * 2);
+        while (run_more()) {
+            mark_start();
+            convert->yuv422pto420p(img, img_src);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    if (std::string("uyvyto420p").find(filter) != std::string::npos) {
+        run_start("uyvyto420p", "", wh * 2);
+        while (run_more()) {
+            mark_start();
+            convert->uyvyto420p(img, img_src);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    if (std::string("rgb24toyuv420p").find(filter) != std::string::npos) {
+        run_start("rgb24toyuv420p", "", wh * 3);
+        while (run_more()) {
+            mark_start();
+            convert->rgb24toyuv420p(img, img_src);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    if (std::string("bgr24toyuv420p").find(filter) != std::string::npos) {
+        run_start("bgr24toyuv420p", "", wh * 3);
+        while (run_more()) {
+            mark_start();
+            convert->bgr24toyuv420p(img, img_src);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    if (std::string("bayer2rgb24").find(filter) != std::string::npos) {
+        run_start("bayer2rgb24", "", wh);
+        while (run_more()) {
+            mark_start();
+            convert->bayer2rgb24(img_dst, img_src);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    if (std::string("greytoyuv420p").find(filter) != std::string::npos) {
+        run_start("greytoyuv420p", "", wh);
+        while (run_more()) {
+            mark_start();
+            convert->greytoyuv420p(img, img_src);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    delete convert;
+}
+
+void cls_bench::bench_scale()
+{
+    int size;
+    struct SwsContext *swsctx;
+
+    size = (width * height * 3) / 2;
+
+    if (std::string("scale_img").find(filter) != std::string::npos) {
+        run_start("scale_img", "", size);
+        while (run_more()) {
+            mark_start();
+            cam->picture->scale_img(width, height, img_cur, img_dst);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    if (std::string("util_resize").find(filter) != std::string::npos) {
+        swsctx = nullptr;
+        run_start("util_resize", "half", size);
+        while (run_more()) {
+            mark_start();
+            util_resize(img_cur, width, height, img_dst, width / 2, height / 2, &swsctx);
+            mark_stop();
+        }
+        run_end(false);
+        sws_freeContext(swsctx);
+    }
+}
+
+void cls_bench::bench_jpeg()
+{
+    int size, quality;
+    struct timespec ts;
+    cls_jpgenc *jpgenc;
+
+    size = (width * height * 3) / 2;
+    quality = cam->cfg->picture_quality;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    if (std::string("jpgutl_put_yuv420p").find(filter) != std::string::npos) {
+        run_start("jpgutl_put_yuv420p", "quality=" + std::to_string(quality), size);
+        while (run_more()) {
+            mark_start();
+            jpgutl_put_yuv420p(img_dst, size, img_cur, width, height
+                , quality, cam, &ts, nullptr);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    if (std::string("jpgutl_put_grey").find(filter) != std::string::npos) {
+        run_start("jpgutl_put_grey", "quality=" + std::to_string(quality)
+            , width * height);
+        while (run_more()) {
+            mark_start();
+            jpgutl_put_grey(img_dst, size, img_cur, width, height
+                , quality, cam, &ts, nullptr);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    /* The encoder kept between images as the pictures and streams use it */
+    jpgenc = new cls_jpgenc(cam);
+    if (std::string("jpgenc_yuv420p").find(filter) != std::string::npos) {
+        run_start("jpgenc_yuv420p", "quality=" + std::to_string(quality), size);
+        while (run_more()) {
+            mark_start();
+            jpgenc->put_yuv420p(img_dst, size, img_cur, width, height
+                , quality, &ts, nullptr);
+            mark_stop();
+        }
+        run_end(false);
+    }
+
+    if (std::string("jpgenc_grey").find(filter) != std::string::npos) {
+        run_start("jpgenc_grey", "quality=" + std::to_string(quality)
+            , width * height);
+        while (run_more()) {
+            mark_start();
+            jpgenc->put_grey(img_dst, size, img_cur, width, height
+                , quality, &ts, nullptr);
+            mark_stop();
+        }
+        run_end(false);
+    }
+    mydelete(jpgenc);
+}
+
+/* A timestamp as text_left and text_right draw it with each scale */
+void cls_bench::bench_text()
+{
+    int scale;
+    u_char *img;
+
+    if (std::string("text").find(filter) == std::string::npos) {
+        return;
+    }
+
+    img = cam->current_image->image_norm;
+    memcpy(img, img_cur, (uint)((width * height * 3) / 2));
+
+    for (scale = 1; scale <= 2; scale++) {
+        run_start("text", "scale=" + std::to_string(scale), 0);
+        while (run_more()) {
+            mark_start();
+            cam->draw->text(img, width, height, 10, 20
+                , "2025-01-01\\n12:00:00 Camera 1", scale);
+            mark_stop();
+        }
+        run_end(false);
+    }
+}
+
+void cls_bench::report_line(ctx_bench_result *res)
+{
+    double pixels, ns;
+
+    pixels = (double)res->width * res->height;
+    ns = (double)res->ns / res->iterations;
+
+    printf("%-20s %-28s %4dx%-4d %8.3f ms %7.3f ns/px"
+        , res->name.c_str(), res->params.c_str()
+        , res->width, res->height, ns / 1000000.0, ns / pixels);
+    if (res->cycles >= 0) {
+        printf(" %7.3f cyc/px", (double)res->cycles / res->iterations / pixels);
+    } else {
+        printf("       - cyc/px");
+    }
+    if (res->bytes > 0) {
+        printf(" %9.1f MB/s", (double)res->bytes * 1000.0 / ns);
+    }
+    printf("\n");
+}
+
+void cls_bench::report_json()
+{
+    FILE *fp;
+    uint indx;
+    ctx_bench_result *res;
+    double pixels, ns;
+    struct utsname uts;
+
+    if (json_file == "") {
+        return;
+    }
+
+    if (json_file == "-") {
+        fp = stdout;
+    } else {
+        fp = myfopen(json_file.c_str(), "we");
+        if (fp == nullptr) {
+            MOTION_LOG(ERR, TYPE_ALL, SHOW_ERRNO
+                , _("Unable to open %s"), json_file.c_str());
+            return;
+        }
+    }
+
+    memset(&uts, 0, sizeof(uts));
+    uname(&uts);
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"version\": \"%s\",\n", PACKAGE_VERSION);
+    fprintf(fp, "  \"machine\": \"%s\",\n", uts.machine);
+    fprintf(fp, "  \"cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(fp, "  \"cycles\": %s,\n", (perf_fd == -1) ? "false" : "true");
+    fprintf(fp, "  \"results\": [\n");
+    for (indx = 0; indx < results.size(); indx++) {
+        res = &results[indx];
+        pixels = (double)res->width * res->height;
+        ns = (double)res->ns / res->iterations;
+        fprintf(fp, "    {\"name\": \"%s\", \"params\": \"%s\""
+            ", \"width\": %d, \"height\": %d, \"iterations\": %d"
+            ", \"ns_per_iter\": %.0f, \"ns_per_pixel\": %.4f"
+            , res->name.c_str(), res->params.c_str()
+            , res->width, res->height, res->iterations, ns, ns / pixels);
+        if (res->cycles >= 0) {
+            fprintf(fp, ", \"cycles_per_pixel\": %.4f"
+                , (double)res->cycles / res->iterations / pixels);
+        } else {
+            fprintf(fp, ", \"cycles_per_pixel\": null");
+        }
+        if (res->bytes > 0) {
+            fprintf(fp, ", \"mb_per_s\": %.1f}", (double)res->bytes * 1000.0 / ns);
+        } else {
+            fprintf(fp, ", \"mb_per_s\": null}");
+        }
+        fprintf(fp, "%s\n", (indx + 1 < results.size()) ? "," : "");
+    }
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+
+    if (fp != stdout) {
+        myfclose(fp);
+    }
+}
+
+int cls_bench::run()
+{
+    uint indx;
+    size_t xpos;
+
+    if (cmdline() == false) {
+        return 1;
+    }
+
+    perf_open();
+
+    for (indx = 0; indx < sizes.size(); indx++) {
+        xpos = sizes[indx].find('x');
+        if (xpos == std::string::npos) {
+            MOTION_LOG(ERR, TYPE_ALL, NO_ERRNO
+                , _("Invalid size %s"), sizes[indx].c_str());
+            continue;
+        }
+        width = mtoi(sizes[indx].substr(0, xpos));
+        height = mtoi(sizes[indx].substr(xpos + 1));
+        if ((width < 64) || (height < 64) || (width % 8) || (height % 8)) {
+            MOTION_LOG(ERR, TYPE_ALL, NO_ERRNO
+                , _("Invalid size %s"), sizes[indx].c_str());
+            continue;
+        }
+
+        images_init();
+        init_cam();
+
+        bench_diff("simd=scalar,prescreen=sample", false);
+        bench_diff("simd=auto,prescreen=sample", false);
+        bench_diff("simd=auto,prescreen=block", false);
+        bench_diff("simd=auto,prescreen=block,fused=on", false);
+        bench_diff("simd=auto,prescreen=block,background=average", false);
+        bench_diff("simd=auto,prescreen=block,threads=4", true);
+        bench_despeckle("packed=off");
+        bench_despeckle("packed=on");
+        bench_labeling("labeling=flood");
+        bench_labeling("labeling=unionfind");
+        bench_rotate();
+        bench_convert();
+        bench_scale();
+        bench_jpeg();
+        bench_text();
+
+        deinit_cam();
+        images_deinit();
+    }
+
+    report_json();
+
+    return 0;
+}
+
+cls_bench::cls_bench(int p_argc, char **p_argv)
+{
+    argc = p_argc;
+    argv = p_argv;
+    app = new cls_motapp();
+    app->conf_src = nullptr;
+    app->user_pause = "off";
+    cam = nullptr;
+    filter = "";
+    json_file = "";
+    min_ms = 200;
+    width = 0;
+    height = 0;
+    perf_fd = -1;
+    img_ref = nullptr;
+    img_cur = nullptr;
+    img_mask = nullptr;
+    img_src = nullptr;
+    img_dst = nullptr;
+    mark_cycles = 0;
+    memset(&mark_ts, 0, sizeof(mark_ts));
+}
+
+cls_bench::~cls_bench()
+{
+    if (perf_fd != -1) {
+        close(perf_fd);
+    }
+    deinit_cam();
+    mydelete(app);
+}
+
+/** Main entry point of motion-bench. */
+int main (int p_argc, char **p_argv)
+{
+    cls_bench *bench;
+    int retcd;
+
+    motlog = new cls_log(nullptr);
+    mythreadname_set("bn",0,"");
+
+    bench = new cls_bench(p_argc, p_argv);
+    retcd = bench->run();
+    delete bench;
+
+    mydelete(motlog);
+
+    return retcd;
+}
@@ -0,0 +1,100 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * bench.hpp - Microbenchmarks of the image kernels
+ *
+ * The motion-bench program times the kernels which run on every image
+ * (detection, despeckle, labeling, rotation, format conversion, scaling,
+ * jpeg encoding and the text overlay) on synthetic images at the common
+ * camera sizes.  The results are given as cycles and nanoseconds per pixel
+ * and MB/s, and may be written as JSON to compare builds and machines.
+ */
+
+#ifndef _INCLUDE_BENCH_HPP_
+#define _INCLUDE_BENCH_HPP_
+
+    #define BENCH_SIZES_DEFAULT "640x480,1280x720,1920x1080,2592x1944"
+
+    /* Timing of one kernel at one image size */
+    struct ctx_bench_result {
+        std::string name;
+        std::string params;     /* Options of the kernel such as the detect_params */
+        int         width;
+        int         height;
+        int         iterations;
+        int64_t     ns;         /* Total of all iterations */
+        int64_t     cycles;     /* Total of all iterations or -1 when not counted */
+        int64_t     bytes;      /* Bytes read by one iteration */
+    };
+
+    class cls_bench {
+        public:
+            cls_bench(int p_argc, char **p_argv);
+            ~cls_bench();
+            int run();
+
+        private:
+            int         argc;
+            char        **argv;
+            cls_motapp  *app;
+            cls_camera  *cam;
+            std::vector<std::string>    sizes;
+            std::string filter;         /* Only run kernels with names containing this */
+            std::string json_file;
+            int         min_ms;         /* Minimum time for each kernel */
+            int         width;
+            int         height;
+            int         perf_fd;        /* Cycle counter or -1 when not available */
+            u_char      *img_ref;       /* Synthetic reference image */
+            u_char      *img_cur;       /* Reference with moving objects and noise */
+            u_char      *img_mask;      /* Motion image with speckles */
+            u_char      *img_src;       /* Source for the converters */
+            u_char      *img_dst;
+            std::vector<ctx_bench_result> results;
+            ctx_bench_result    rslt;
+            struct timespec     mark_ts;
+            int64_t             mark_cycles;
+
+            void usage();
+            bool cmdline();
+            void perf_open();
+            int64_t perf_read();
+            void images_init();
+            void images_deinit();
+            void init_cam();
+            void deinit_cam();
+            void alg_new(std::string detect_params);
+            void run_start(std::string name, std::string params, int64_t bytes);
+            bool run_more();
+            void run_end(bool multithread);
+            void mark_start();
+            void mark_stop();
+            void bench_diff(std::string detect_params, bool multithread);
+            void bench_despeckle(std::string detect_params);
+            void bench_labeling(std::string detect_params);
+            void bench_rotate();
+            void bench_convert();
+            void bench_scale();
+            void bench_jpeg();
+            void bench_text();
+            void report_line(ctx_bench_result *res);
+            void report_json();
+    };
+
+#endif /* _INCLUDE_BENCH_HPP_ */
@@ -28,6 +28,7 @@
 #include "video_loopback.hpp"
 #include "netcam.hpp"
 #include "conf.hpp"
+#include "alg_simd.hpp"
 #include "alg.hpp"
 #include "alg_sec.hpp"
 #include "picture.hpp"
@@ -35,6 +36,10 @@
 #include "dbse.hpp"
 #include "draw.hpp"
 #include "webu_getimg.hpp"
+#include "stage.hpp"
+#include "framepool.hpp"
+#include "metrics.hpp"
+#include "pacer.hpp"
 
 static void *camera_handler(void *arg)
 {
@@ -42,6 +47,93 @@ static void *camera_handler(void *arg)
     return nullptr;
 }
 
+static void ring_buf_attach(ctx_image_data *img, ctx_image_buf *buf)
+{
+    img->buf = buf;
+    img->image_norm = buf->image_norm;
+    img->image_high = buf->image_high;
+    img->image_motion = buf->image_motion;
+    img->image_virgin = buf->image_virgin;
+}
+
+/* Allocate the buffers for a slot of the image ring */
+ctx_image_buf *cls_camera::ring_buf_alloc()
+{
+    ctx_image_buf *buf;
+
+    buf = (ctx_image_buf*)mymalloc(sizeof(ctx_image_buf));
+    buf->image_norm = pool->get((size_t)imgs.size_norm);
+    memset(buf->image_norm, 0x80, (uint)imgs.size_norm);
+    if (imgs.size_high > 0) {
+        buf->image_high = pool->get((size_t)imgs.size_high);
+        memset(buf->image_high, 0x80, (uint)imgs.size_high);
+    }
+    buf->image_motion = pool->get((size_t)imgs.size_norm);
+    memset(buf->image_motion, 0x80, (uint)imgs.size_norm);
+    buf->image_virgin = pool->get((size_t)imgs.size_norm);
+    memset(buf->image_virgin, 0x80, (uint)imgs.size_norm);
+    buf->refcnt = 0;
+    buf->in_ring = true;
+
+    return buf;
+}
+
+void cls_camera::ring_buf_free(ctx_image_buf *buf)
+{
+    pool->put(buf->image_norm);
+    pool->put(buf->image_high);
+    pool->put(buf->image_motion);
+    pool->put(buf->image_virgin);
+    myfree(buf);
+}
+
+/*
+ * Give the slot other buffers when an output stage still holds its
+ * buffers.  The held buffers become spares once they are released.
+ */
+void cls_camera::ring_buf_check(ctx_image_data *img)
+{
+    ctx_image_buf *buf;
+
+    pthread_mutex_lock(&ring_mutex);
+        if (img->buf->refcnt == 0) {
+            pthread_mutex_unlock(&ring_mutex);
+            return;
+        }
+        img->buf->in_ring = false;
+        buf = nullptr;
+        if (ring_spare.empty() == false) {
+            buf = ring_spare.back();
+            ring_spare.pop_back();
+        }
+    pthread_mutex_unlock(&ring_mutex);
+
+    if (buf == nullptr) {
+        buf = ring_buf_alloc();
+        ring_buf_cnt++;
+    }
+    buf->in_ring = true;
+    ring_buf_attach(img, buf);
+}
+
+/* Hold the buffers of the image for an output stage */
+void cls_camera::frame_hold(ctx_image_data *img)
+{
+    pthread_mutex_lock(&ring_mutex);
+        img->buf->refcnt++;
+    pthread_mutex_unlock(&ring_mutex);
+}
+
+void cls_camera::frame_release(ctx_image_data *img)
+{
+    pthread_mutex_lock(&ring_mutex);
+        img->buf->refcnt--;
+        if ((img->buf->refcnt == 0) && (img->buf->in_ring == false)) {
+            ring_spare.push_back(img->buf);
+        }
+    pthread_mutex_unlock(&ring_mutex);
+}
+
 /* Resize the image ring */
 void cls_camera::ring_resize()
 {
@@ -59,13 +151,9 @@ void cls_camera::ring_resize()
     tmp =(ctx_image_data*) mymalloc((uint)new_size * sizeof(ctx_image_data));
 
     for(i = 0; i < new_size; i++) {
-        tmp[i].image_norm =(u_char*) mymalloc((uint)imgs.size_norm);
-        memset(tmp[i].image_norm, 0x80, (uint)imgs.size_norm);
-        if (imgs.size_high > 0) {
-            tmp[i].image_high =(u_char*) mymalloc((uint)imgs.size_high);
-            memset(tmp[i].image_high, 0x80, (uint)imgs.size_high);
-        }
+        ring_buf_attach(&tmp[i], ring_buf_alloc());
     }
+    ring_buf_cnt = 0;
 
     imgs.image_ring = tmp;
     current_image = NULL;
@@ -85,16 +173,30 @@ void cls_camera::ring_destroy()
     }
 
     for (i = 0; i < imgs.ring_size; i++) {
-        myfree(imgs.image_ring[i].image_norm);
-        myfree(imgs.image_ring[i].image_high);
+        ring_buf_free(imgs.image_ring[i].buf);
     }
     myfree(imgs.image_ring);
 
+    if (ring_buf_cnt > 0) {
+        MOTION_LOG(INF, TYPE_ALL, NO_ERRNO
+            , _("Image ring used %d extra buffers for the output stages")
+            , ring_buf_cnt);
+    }
+    for (i = 0; i < (int)ring_spare.size(); i++) {
+        ring_buf_free(ring_spare[i]);
+    }
+    ring_spare.clear();
+    ring_buf_cnt = 0;
+
     /*
      * current_image is an alias from the pointers above which have
      * already been freed so we just set it equal to NULL here
     */
     current_image = NULL;
+    imgs.image_virgin = NULL;
+    if (imgs.det_scale == 1) {
+        imgs.image_detect = NULL;
+    }
 
     imgs.ring_size = 0;
 }
@@ -104,6 +206,18 @@ void cls_camera::ring_process_debug()
 {
     char tmp[32];
     const char *t;
+    int refcnt;
+
+    /*
+     * The stages may still be reading the image so only draw on one they
+     * have released.  The holds are only taken on this thread.
+     */
+    pthread_mutex_lock(&ring_mutex);
+        refcnt = current_image->buf->refcnt;
+    pthread_mutex_unlock(&ring_mutex);
+    if (refcnt > 0) {
+        return;
+    }
 
     if (current_image->trigger) {
         t = "Trigger";
@@ -118,10 +232,10 @@ void cls_camera::ring_process_debug()
     }
 
     mystrftime(this, tmp, sizeof(tmp), "%H%M%S-%q", NULL);
-    draw->text(imgs.image_ring[imgs.ring_out].image_norm
+    draw->text(current_image->image_norm
             , imgs.width, imgs.height
             , 10, 20, tmp, text_scale);
-    draw->text(imgs.image_ring[imgs.ring_out].image_norm
+    draw->text(current_image->image_norm
             , imgs.width, imgs.height
             , 10, 30, t, text_scale);
 }
@@ -132,18 +246,9 @@ void cls_camera::ring_process_image()
         picture->process_norm();
     }
     if (current_image->save_movie) {
-        if (movie_norm->put_image(current_image
-                , &current_image->imgts) == -1) {
-            MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO, _("Error encoding image"));
-        }
-        if (movie_motion->put_image(&imgs.image_motion
-                , &imgs.image_motion.imgts) == -1) {
-            MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO, _("Error encoding image"));
-        }
-        if (movie_extpipe->put_image(current_image
-                , &current_image->imgts) == -1) {
-            MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO, _("Error encoding image"));
-        }
+        movie_put(movie_norm, current_image, false);
+        movie_put(movie_motion, current_image, true);
+        movie_put(movie_extpipe, current_image, false);
     }
 }
 
@@ -201,6 +306,25 @@ void cls_camera::info_reset()
     info_sdev_tot = 0;
 }
 
+/* Queue the image for the encoder thread of the movie */
+void cls_camera::movie_put(cls_movie *movie, ctx_image_data *img, bool motion)
+{
+    if (movie->is_running == false) {
+        return;
+    }
+
+    if (motion) {
+        movie->stage->push(STAGE_JOB_MOVIE_MOTION, img, movie);
+    } else if (movie_passthrough) {
+        /* The netcam only keeps the packets for passthrough briefly */
+        if (movie->put_image(img, &img->imgts) == -1) {
+            MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO, _("Error encoding image"));
+        }
+    } else {
+        movie->stage->push(STAGE_JOB_MOVIE, img, movie);
+    }
+}
+
 void cls_camera::movie_start()
 {
     movie_start_time = frame_curr_ts.tv_sec;
@@ -233,6 +357,7 @@ void cls_camera::detected_trigger()
             info_reset();
             event_prev_nbr = event_curr_nbr;
             movie_nbr = 0;
+            metrics->count(METRICS_EVENTS);
 
             algsec->detected = false;
 
@@ -307,8 +432,9 @@ void cls_camera::detected()
 
     if (current_image->shot <= cfg->framerate) {
         if ((cfg->stream_motion == true) &&
-            (current_image->shot != 1)) {
-            webu_getimg_main(this);
+            (current_image->shot != 1) &&
+            webu_getimg_active(this)) {
+            stage_stream->push(STAGE_JOB_STREAM, current_image, nullptr);
         }
         picture->process_motion();
     }
@@ -316,53 +442,24 @@ void cls_camera::detected()
     track_move();
 }
 
-/* Apply the privacy mask to image*/
-void cls_camera::mask_privacy()
+/*
+ * Apply the privacy mask to one image.  When
+ * keep is given, the image before the mask is written to it in the same pass.
+ */
+static void mask_privacy_plane(u_char *image, u_char *keep
+    , const u_char *mask, const u_char *maskuv, int index_y, int index_crcb)
 {
-    if (imgs.mask_privacy == NULL) {
-        return;
-    }
-
     /*
     * This function uses long operations to process 4 (32 bit) or 8 (64 bit)
     * bytes at a time, providing a significant boost in performance.
     * Then a trailer loop takes care of any remaining bytes.
     */
-    u_char *image;
-    const u_char *mask;
-    const u_char *maskuv;
-
-    int index_y;
-    int index_crcb;
+    unsigned long val;
     int increment;
-    int indx_img;                /* Counter for how many images we need to apply the mask to */
-    int indx_max;                /* 1 if we are only doing norm, 2 if we are doing both norm and high */
 
-    indx_img = 1;
-    if (imgs.size_high > 0) {
-        indx_max = 2;
-    } else {
-        indx_max = 1;
-    }
     increment = sizeof(unsigned long);
 
-    while (indx_img <= indx_max) {
-        if (indx_img == 1) {
-            /* Normal Resolution */
-            index_y = imgs.height * imgs.width;
-            image = current_image->image_norm;
-            mask = imgs.mask_privacy;
-            index_crcb = imgs.size_norm - index_y;
-            maskuv = imgs.mask_privacy_uv;
-        } else {
-            /* High Resolution */
-            index_y = imgs.height_high * imgs.width_high;
-            image = current_image->image_high;
-            mask = imgs.mask_privacy_high;
-            index_crcb = imgs.size_high - index_y;
-            maskuv = imgs.mask_privacy_high_uv;
-        }
-
+    if (keep == nullptr) {
         while (index_y >= increment) {
             *((unsigned long *)image) &= *((unsigned long *)mask);
             image += increment;
@@ -372,34 +469,93 @@ void cls_camera::mask_privacy()
         while (--index_y >= 0) {
             *(image++) &= *(mask++);
         }
-
-        /* Mask chrominance. */
-        while (index_crcb >= increment) {
-            index_crcb -= increment;
-            /*
-            * Replace the masked bytes with 0x080. This is done using two masks:
-            * the normal privacy mask is used to clear the masked bits, the
-            * "or" privacy mask is used to write 0x80. The benefit of that method
-            * is that we process 4 or 8 bytes in just two operations.
-            */
-            *((unsigned long *)image) &= *((unsigned long *)mask);
-            mask += increment;
-            *((unsigned long *)image) |= *((unsigned long *)maskuv);
-            maskuv += increment;
+    } else {
+        while (index_y >= increment) {
+            val = *((unsigned long *)image);
+            *((unsigned long *)keep) = val;
+            *((unsigned long *)image) = val & *((unsigned long *)mask);
             image += increment;
+            keep += increment;
+            mask += increment;
+            index_y -= increment;
+        }
+        while (--index_y >= 0) {
+            *(keep++) = *image;
+            *(image++) &= *(mask++);
         }
+    }
 
-        while (--index_crcb >= 0) {
-            if (*(mask++) == 0x00) {
-                *image = 0x80; // Mask last remaining bytes.
-            }
-            image += 1;
+    /* Mask chrominance. */
+    while (index_crcb >= increment) {
+        index_crcb -= increment;
+        /*
+        * Replace the masked bytes with 0x080. This is done using two masks:
+        * the normal privacy mask is used to clear the masked bits, the
+        * "or" privacy mask is used to write 0x80. The benefit of that method
+        * is that we process 4 or 8 bytes in just two operations.
+        */
+        val = *((unsigned long *)image);
+        if (keep != nullptr) {
+            *((unsigned long *)keep) = val;
+            keep += increment;
+        }
+        *((unsigned long *)image) = (val & *((unsigned long *)mask))
+            | *((unsigned long *)maskuv);
+        mask += increment;
+        maskuv += increment;
+        image += increment;
+    }
+
+    while (--index_crcb >= 0) {
+        if (keep != nullptr) {
+            *(keep++) = *image;
+        }
+        if (*(mask++) == 0x00) {
+            *image = 0x80; // Mask last remaining bytes.
+        }
+        image += 1;
+    }
+}
+
+/*
+ * Apply the privacy mask to the image.  When virgin is given, the normal
+ * image without the mask is kept in it while the mask is applied.
+ */
+void cls_camera::mask_privacy(u_char *virgin)
+{
+    int index_y;
+
+    if (imgs.mask_privacy == NULL) {
+        if (virgin != nullptr) {
+            memcpy(virgin, current_image->image_norm, (uint)imgs.size_norm);
         }
+        return;
+    }
+
+    index_y = imgs.height * imgs.width;
+    mask_privacy_plane(current_image->image_norm, virgin
+        , imgs.mask_privacy, imgs.mask_privacy_uv
+        , index_y, imgs.size_norm - index_y);
 
-        indx_img++;
+    if (imgs.size_high > 0) {
+        index_y = imgs.height_high * imgs.width_high;
+        mask_privacy_plane(current_image->image_high, nullptr
+            , imgs.mask_privacy_high, imgs.mask_privacy_high_uv
+            , index_y, imgs.size_high - index_y);
     }
 }
 
+/*
+ * Keep the captured image in its ring slot as the virgin image while the
+ * privacy mask is applied and reduce it to the detection plane
+ */
+void cls_camera::prepare_image()
+{
+    mask_privacy(current_image->image_virgin);
+    imgs.image_virgin = current_image->image_virgin;
+    detect_image();
+}
+
 /* Close and clean up camera*/
 void cls_camera::cam_close()
 {
@@ -594,13 +750,10 @@ void cls_camera::init_areadetect()
 /** Allocate the required buffers */
 void cls_camera::init_buffers()
 {
-    imgs.ref =(u_char*) mymalloc((uint)imgs.size_norm);
+    imgs.ref =(u_char*) mymalloc((uint)imgs.det_size);
     imgs.image_motion.image_norm = (u_char*)mymalloc((uint)imgs.size_norm);
-    imgs.ref_dyn =(int*) mymalloc((uint)imgs.motionsize * sizeof(*imgs.ref_dyn));
-    imgs.image_virgin =(u_char*) mymalloc((uint)imgs.size_norm);
-    imgs.image_vprvcy = (u_char*)mymalloc((uint)imgs.size_norm);
-    imgs.labels =(int*)mymalloc((uint)imgs.motionsize * sizeof(*imgs.labels));
-    imgs.labelsize =(int*) mymalloc((uint)(imgs.motionsize/2+1) * sizeof(*imgs.labelsize));
+    imgs.labels =(int*)mymalloc((uint)imgs.det_size * sizeof(*imgs.labels));
+    imgs.labelsize =(int*) mymalloc((uint)(imgs.det_size/2+1) * sizeof(*imgs.labelsize));
     imgs.image_preview.image_norm =(u_char*) mymalloc((uint)imgs.size_norm);
     imgs.common_buffer =(u_char*) mymalloc((uint)(3 * imgs.width * imgs.height));
     imgs.image_secondary =(u_char*) mymalloc((uint)(3 * imgs.width * imgs.height));
@@ -609,6 +762,12 @@ void cls_camera::init_buffers()
     } else {
         imgs.image_preview.image_high = NULL;
     }
+    if (imgs.det_scale > 1) {
+        imgs.image_detect =(u_char*) mymalloc((uint)imgs.det_size);
+        imgs.image_detect_motion =(u_char*) mymalloc((uint)((imgs.det_size * 3) / 2));
+    } else {
+        imgs.image_detect_motion = imgs.image_motion.image_norm;
+    }
 
 }
 
@@ -694,18 +853,54 @@ void cls_camera::init_cam_start()
     imgs.size_high  = (imgs.width_high * imgs.height_high * 3) / 2;
     imgs.labelsize_max = 0;
     imgs.largest_label = 0;
+
+    init_detect();
 }
 
-/* initialize reference images*/
-void cls_camera::init_ref()
+/* Set the size of the plane used for motion detection */
+void cls_camera::init_detect()
 {
-    memcpy(imgs.image_virgin, current_image->image_norm
-        , (uint)imgs.size_norm);
+    imgs.det_scale = cfg->parm_cam.detection_scale;
+    if ((imgs.det_scale != 1) && (imgs.det_scale != 2) && (imgs.det_scale != 4)) {
+        MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+            ,_("Invalid detection_scale %d.  Using 1"), imgs.det_scale);
+        imgs.det_scale = 1;
+    }
+    if ((imgs.width % imgs.det_scale) || (imgs.height % imgs.det_scale)) {
+        MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+            ,_("Image %dx%d not divisible by detection_scale %d.  Using 1")
+            ,imgs.width, imgs.height, imgs.det_scale);
+        imgs.det_scale = 1;
+    }
 
-    mask_privacy();
+    imgs.det_width = imgs.width / imgs.det_scale;
+    imgs.det_height = imgs.height / imgs.det_scale;
+    imgs.det_size = imgs.det_width * imgs.det_height;
 
-    memcpy(imgs.image_vprvcy, current_image->image_norm
-        , (uint)imgs.size_norm);
+    if (imgs.det_scale > 1) {
+        MOTION_LOG(INF, TYPE_ALL, NO_ERRNO
+            ,_("Motion detection at %dx%d"), imgs.det_width, imgs.det_height);
+    }
+}
+
+/*
+ * Reduce the image with the privacy mask to the detection plane.  At full
+ * size the detection reads the image itself before any overlay is drawn.
+ */
+void cls_camera::detect_image()
+{
+    if (imgs.det_scale > 1) {
+        alg_simd_downscale(current_image->image_norm, imgs.width, imgs.height
+            , imgs.det_scale, imgs.image_detect);
+    } else {
+        imgs.image_detect = current_image->image_norm;
+    }
+}
+
+/* initialize reference images*/
+void cls_camera::init_ref()
+{
+    prepare_image();
 
     alg->ref_frame_reset();
 }
@@ -720,6 +915,7 @@ void cls_camera::cleanup()
             picture->process_preview();
             imgs.image_preview.diffs = 0;
         }
+        stage_pic->drain();
         if (cfg->on_event_end != "") {
             util_exec_command(this, cfg->on_event_end.c_str(), NULL);
         }
@@ -727,15 +923,37 @@ void cls_camera::cleanup()
         app->dbse->exec(this, "", "event_end");
     }
 
+    mydelete(stage_side);
+    mydelete(stage_stream);
+    mydelete(stage_pic);
+
     webu_getimg_deinit(this);
 
     cam_close();
 
+    cleanup_buffers();
+
+    /* The next start may have other image sizes */
+    pool->stats_log();
+    pool->trim();
+
+    if (pipe != -1) {
+        close(pipe);
+        pipe = -1;
+    }
+
+    if (mpipe != -1) {
+        close(mpipe);
+        mpipe = -1;
+    }
+
+}
+
+/** Free the image buffers and the classes created by init */
+void cls_camera::cleanup_buffers()
+{
     myfree(imgs.image_motion.image_norm);
     myfree(imgs.ref);
-    myfree(imgs.ref_dyn);
-    myfree(imgs.image_virgin);
-    myfree(imgs.image_vprvcy);
     myfree(imgs.labels);
     myfree(imgs.labelsize);
     myfree(imgs.mask);
@@ -747,6 +965,11 @@ void cls_camera::cleanup()
     myfree(imgs.image_secondary);
     myfree(imgs.image_preview.image_norm);
     myfree(imgs.image_preview.image_high);
+    if (imgs.det_scale > 1) {
+        myfree(imgs.image_detect);
+        myfree(imgs.image_detect_motion);
+        myfree(imgs.mask_detect);
+    }
 
     ring_destroy(); /* Cleanup the precapture ring buffer */
 
@@ -760,17 +983,6 @@ void cls_camera::cleanup()
     mydelete(movie_extpipe);
     mydelete(draw);
     mydelete(cleandir);
-
-    if (pipe != -1) {
-        close(pipe);
-        pipe = -1;
-    }
-
-    if (mpipe != -1) {
-        close(mpipe);
-        mpipe = -1;
-    }
-
 }
 
 void cls_camera::init_cleandir_default()
@@ -1174,6 +1386,10 @@ void cls_camera::init()
 
     check_szimg();
 
+    pool->name = cfg->device_name;
+    pool->hugepages = cfg->parm_cam.image_hugepages;
+    pacer->burst = (cfg->framerate_catchup == "burst");
+
     ring_resize();
 
     init_buffers();
@@ -1194,6 +1410,12 @@ void cls_camera::init()
     movie_motion = new cls_movie(this, "motion");
     movie_timelapse = new cls_movie(this, "timelapse");
     movie_extpipe = new cls_movie(this, "extpipe");
+    stage_side = new cls_stage(this, "side", "cs", 1, STAGE_DEPTH);
+    stage_stream = new cls_stage(this, "stream", "cw", 1, 1);
+    stage_stream->keep_latest = true;
+    stage_pic = new cls_stage(this, "picture", "cp"
+        , cfg->picture_writers, cfg->picture_queue);
+    stage_pic->drop_full = true;
 
     init_cleandir();
 
@@ -1294,6 +1516,7 @@ void cls_camera::resetimages()
     }
 
     current_image = &imgs.image_ring[imgs.ring_in];
+    ring_buf_check(current_image);
     current_image->diffs = 0;
     current_image->trigger = false;
     current_image->motion = false;
@@ -1342,11 +1565,8 @@ int cls_camera::capture()
             }
         }
         missing_frame_counter = 0;
-        memcpy(imgs.image_virgin, current_image->image_norm
-            , (uint)imgs.size_norm);
-        mask_privacy();
-        memcpy(imgs.image_vprvcy, current_image->image_norm
-            , (uint)imgs.size_norm);
+        metrics->count(METRICS_FRAMES);
+        prepare_image();
 
     } else {
         if (connectionlosttime.tv_sec == 0) {
@@ -1354,12 +1574,22 @@ int cls_camera::capture()
         }
 
         missing_frame_counter++;
+        metrics->count(METRICS_MISSED);
+
+        /* Carry the last image without overlays into this slot */
+        if (current_image->image_virgin != imgs.image_virgin) {
+            memcpy(current_image->image_virgin, imgs.image_virgin
+                , (uint)imgs.size_norm);
+            imgs.image_virgin = current_image->image_virgin;
+        }
 
         if ((device_status == STATUS_OPENED) &&
             (missing_frame_counter <
                 (cfg->device_tmo * cfg->framerate))) {
-            memcpy(current_image->image_norm, imgs.image_vprvcy
+            memcpy(current_image->image_norm, imgs.image_virgin
                 , (uint)imgs.size_norm);
+            mask_privacy(nullptr);
+            detect_image();
         } else {
             lost_connection = true;
             if (device_status == STATUS_OPENED) {
@@ -1413,6 +1643,12 @@ void cls_camera::detection()
         return;
     }
 
+    /* The grey image shown for a lost camera is not detected */
+    if (lost_connection) {
+        current_image->diffs = 0;
+        return;
+    }
+
     if (pause == false) {
         alg->diff();
     } else {
@@ -1429,6 +1665,14 @@ void cls_camera::tuning()
         return;
     }
 
+    /*
+     * The detection image of a lost camera is not a fresh capture and may
+     * have overlays drawn on it so it is kept out of the reference frame.
+     */
+    if (lost_connection) {
+        return;
+    }
+
     if ((cfg->noise_tune && shots_mt == 0) && (pause == false) &&
           (!detecting_motion && (current_image->diffs <= threshold))) {
         alg->noise_tune();
@@ -1541,6 +1785,23 @@ void cls_camera::overlay()
     }
 }
 
+/* Keep the motion image with the frame for the output stages */
+void cls_camera::ring_keep_images()
+{
+    if ((restart == true) || (handler_stop == true)) {
+        return;
+    }
+
+    if (cfg->movie_output_motion || (mpipe >= 0) ||
+        (cfg->picture_output_motion == "on") ||
+        (stream.motion.jpg_cnct > 0) ||
+        (stream.motion.ts_cnct > 0) ||
+        (stream.motion.all_cnct > 0)) {
+        memcpy(current_image->image_motion, imgs.image_motion.image_norm
+            , (uint)imgs.size_norm);
+    }
+}
+
 /* emulate motion */
 void cls_camera::actions_emulate()
 {
@@ -1647,6 +1908,8 @@ void cls_camera::actions_event()
                 picture->process_preview();
                 imgs.image_preview.diffs = 0;
             }
+            /* Save the queued pictures of the event before it ends */
+            stage_pic->drain();
             if (cfg->on_event_end != "") {
                 util_exec_command(this, cfg->on_event_end.c_str(), NULL);
             }
@@ -1697,6 +1960,7 @@ void cls_camera::actions()
      if ((current_image->diffs > threshold) &&
         (current_image->diffs < threshold_maximum)) {
         current_image->motion = true;
+        metrics->count(METRICS_MOTION);
         info_diff_cnt++;
         info_diff_tot += (uint)current_image->diffs;
         info_sdev_tot += (uint)current_image->location.stddev_xy;
@@ -1805,10 +2069,7 @@ void cls_camera::timelapse()
             frame_curr_ts.tv_sec % cfg->timelapse_interval <=
             frame_last_ts.tv_sec % cfg->timelapse_interval) {
             movie_timelapse->start();
-            if (movie_timelapse->put_image(
-                current_image, &current_image->imgts) == -1) {
-                MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO, _("Error encoding image"));
-            }
+            movie_put(movie_timelapse, current_image, false);
         }
 
     } else if (movie_timelapse->is_running) {
@@ -1828,10 +2089,13 @@ void cls_camera::loopback()
         return;
     }
 
-    vlp_putpipe(this);
+    if ((pipe >= 0) || (mpipe >= 0)) {
+        stage_side->push(STAGE_JOB_LOOPBACK, current_image, nullptr);
+    }
 
-    if (!cfg->stream_motion || shots_mt == 0) {
-        webu_getimg_main(this);
+    if ((!cfg->stream_motion || shots_mt == 0) &&
+        webu_getimg_active(this)) {
+        stage_stream->push(STAGE_JOB_STREAM, current_image, nullptr);
     }
 
 }
@@ -1897,27 +2161,21 @@ void cls_camera::check_schedule()
 /* sleep the loop to get framerate requested */
 void cls_camera::frametiming()
 {
-    struct timespec ts2;
-    int64_t sleeptm;
-
     if ((restart == true) || (handler_stop == true)) {
         return;
     }
 
-    clock_gettime(CLOCK_MONOTONIC, &ts2);
-
-    sleeptm = ((1000000L / cfg->framerate) -
-          (1000000L * (ts2.tv_sec - frame_curr_ts.tv_sec)) -
-          ((ts2.tv_nsec - frame_curr_ts.tv_nsec)/1000))*1000;
-
-    /* If over 1 second, just do one*/
-    if (sleeptm > 999999999L) {
-        SLEEP(1, 0);
-    } else if (sleeptm > 0) {
-        SLEEP(0, sleeptm);
+    if (pacer->wait(cfg->framerate)) {
+        metrics->count(METRICS_LATE);
     }
 
-    passflag = true;
+    if (passflag == false) {
+        /* Wake the all camera connections waiting for the first pass */
+        pthread_mutex_lock(&stream.mutex);
+            passflag = true;
+            pthread_cond_broadcast(&stream.cond);
+        pthread_mutex_unlock(&stream.mutex);
+    }
 }
 
 void cls_camera::handler()
@@ -1927,16 +2185,27 @@ void cls_camera::handler()
 
     while (handler_stop == false) {
         init();
+        metrics->start();
         prepare();
+        metrics->mark(METRICS_PREPARE);
         resetimages();
         capture();
+        metrics->mark(METRICS_CAPTURE);
         detection();
+        metrics->mark(METRICS_DETECTION);
         tuning();
+        metrics->mark(METRICS_TUNING);
         overlay();
+        metrics->mark(METRICS_OVERLAY);
+        ring_keep_images();
         actions();
+        metrics->mark(METRICS_ACTIONS);
         snapshot();
+        metrics->mark(METRICS_SNAPSHOT);
         timelapse();
+        metrics->mark(METRICS_TIMELAPSE);
         loopback();
+        metrics->mark(METRICS_LOOPBACK);
         check_schedule();
         frametiming();
     }
@@ -2025,6 +2294,16 @@ cls_camera::cls_camera(cls_motapp *p_app)
     netcam_high = nullptr;
     draw = nullptr;
     picture = nullptr;
+    movie_norm = nullptr;
+    movie_motion = nullptr;
+    movie_timelapse = nullptr;
+    movie_extpipe = nullptr;
+    stage_side = nullptr;
+    stage_stream = nullptr;
+    stage_pic = nullptr;
+    pool = new cls_framepool("camera");
+    metrics = new cls_metrics(this);
+    pacer = new cls_pacer();
 
     threadnr = -1;
     noise = -1;
@@ -2071,10 +2350,13 @@ cls_camera::cls_camera(cls_motapp *p_app)
     finish = false;
     watchdog = 90;
     passflag = false;
-    pthread_mutex_init(&stream.mutex, NULL);
+    pthread_mutex_init(&ring_mutex, NULL);
+    ring_buf_cnt = 0;
     device_status = STATUS_CLOSED;
     memset(&imgs, 0, sizeof(ctx_images));
     memset(&stream, 0, sizeof(ctx_stream));
+    pthread_mutex_init(&stream.mutex, NULL);
+    mycond_init(&stream.cond);
     memset(&all_loc, 0, sizeof(ctx_all_loc));
     memset(&all_sizes, 0, sizeof(ctx_all_sizes));
     all_sizes.reset = true;
@@ -2084,7 +2366,12 @@ cls_camera::~cls_camera()
 {
     mydelete(conf_src);
     mydelete(cfg);
+    mydelete(pool);
+    mydelete(metrics);
+    mydelete(pacer);
+    pthread_cond_destroy(&stream.cond);
     pthread_mutex_destroy(&stream.mutex);
+    pthread_mutex_destroy(&ring_mutex);
     device_status = STATUS_CLOSED;
 }
 
@@ -51,9 +51,22 @@ struct ctx_coord {
     int stddev_xy;
 };
 
+/* Buffers of a ring slot.  The output stages hold a reference while they use them */
+struct ctx_image_buf {
+    u_char  *image_norm;
+    u_char  *image_high;
+    u_char  *image_motion;
+    u_char  *image_virgin;
+    int     refcnt;
+    bool    in_ring;        /* False once the slot has been given other buffers */
+};
+
 struct ctx_image_data {
     u_char       *image_norm;
     u_char       *image_high;
+    u_char       *image_motion;     /* Motion image of the frame for the output stages */
+    u_char       *image_virgin;     /* Image without overlays for the output stages */
+    ctx_image_buf       *buf;
     int                 diffs;
     int                 diffs_raw;
     int                 diffs_ratio;
@@ -83,13 +96,15 @@ struct ctx_images {
     u_char *mask;              /* Buffer for the mask file */
     u_char *common_buffer;
     u_char *image_substream;
-    u_char *image_virgin;            /* Last picture frame with no text or locate overlay */
-    u_char *image_vprvcy;            /* Virgin image with the privacy mask applied */
+    u_char *image_virgin;            /* Last picture frame with no text or locate overlay, kept in its ring slot */
     u_char *mask_privacy;            /* Buffer for the privacy mask values */
     u_char *mask_privacy_uv;         /* Buffer for the privacy U&V values */
     u_char *mask_privacy_high;       /* Buffer for the privacy mask values */
     u_char *mask_privacy_high_uv;    /* Buffer for the privacy U&V values */
     u_char *image_secondary;         /* Buffer for JPG from alg_sec methods */
+    u_char *image_detect;            /* Luma of the masked image at the detection size */
+    u_char *image_detect_motion;     /* Motion image at the detection size */
+    u_char *mask_detect;             /* Mask file reduced to the detection size */
 
     int ring_size;
     int ring_in;                /* Index in image ring buffer we last added a image into */
@@ -108,6 +123,10 @@ struct ctx_images {
     int size_high;                 /* Number of bytes for high resolution image */
 
     int motionsize;
+    int det_scale;                  /* Width and height divisor for the detection plane */
+    int det_width;
+    int det_height;
+    int det_size;                   /* Number of pixels in the detection plane */
     int labelgroup_max;
     int labels_above;
     int labelsize_max;
@@ -137,6 +156,8 @@ struct ctx_cleandir {
 };
 
 class cls_camera {
+    friend class cls_replay;    /* Runs the detection stages on recorded frames */
+    friend class cls_bench;     /* Times the image kernels */
     public:
         cls_camera(cls_motapp *p_app);
         ~cls_camera();
@@ -156,6 +177,12 @@ class cls_camera {
         ctx_all_sizes   all_sizes;
         cls_draw        *draw;
         cls_picture     *picture;
+        cls_stage       *stage_side;    /* Loopback devices */
+        cls_stage       *stage_stream;  /* Web stream images */
+        cls_stage       *stage_pic;     /* Picture files */
+        cls_framepool   *pool;          /* Image buffers */
+        cls_metrics     *metrics;       /* Loop timing and counters */
+        cls_pacer       *pacer;         /* Frame rate schedule */
 
         bool            handler_stop;
         bool            handler_running;
@@ -163,6 +190,8 @@ class cls_camera {
         void            handler();
         void            handler_startup();
         void            handler_shutdown();
+        void            frame_hold(ctx_image_data *img);
+        void            frame_release(ctx_image_data *img);
 
         bool    restart;
         bool    finish;
@@ -175,6 +204,7 @@ class cls_camera {
         int     threshold;
         int     lastrate;
         int     frame_skip;
+        int     shots_mt;   /* Monotonic clock shots count*/
         bool    lost_connection;
         int     text_scale;
         int     watchdog;
@@ -242,30 +272,38 @@ class cls_camera {
         int             threshold_maximum;
 
         int                     postcap;                             /* downcounter, frames left to to send post event */
-        int                     shots_mt;   /* Monotonic clock shots count*/
         int                     shots_rt;   /* Realtime  clock shots count*/
         struct timespec         frame_curr_ts;
         struct timespec         frame_last_ts;
         time_t                  lasttime;
         time_t                  movie_start_time;
         int                     startup_frames;
+        pthread_mutex_t         ring_mutex;
+        std::vector<ctx_image_buf *> ring_spare;    /* Free buffers for slots still held by a stage */
+        int                     ring_buf_cnt;       /* Buffers allocated beyond the ring size */
         int area_minx[9], area_miny[9], area_maxx[9], area_maxy[9];
         int                     areadetect_eventnbr;
         int previous_diffs, previous_location_x, previous_location_y;
 
+        ctx_image_buf *ring_buf_alloc();
+        void ring_buf_free(ctx_image_buf *buf);
+        void ring_buf_check(ctx_image_data *img);
         void ring_resize();
         void ring_destroy();
+        void ring_keep_images();
         void ring_process_debug();
         void ring_process_image();
         void ring_process();
         void info_reset();
+        void movie_put(cls_movie *movie, ctx_image_data *img, bool motion);
         void movie_start();
         void movie_end();
         void detected_trigger();
         void track_center();
         void track_move();
         void detected();
-        void mask_privacy();
+        void mask_privacy(u_char *virgin);
+        void prepare_image();
         void cam_close();
         void cam_start();
         int cam_next(ctx_image_data *img_data);
@@ -277,11 +315,14 @@ class cls_camera {
         void init_values();
         void init_cam_start();
         void init_ref();
+        void init_detect();
+        void detect_image();
         void init_schedule();
         void init_cleandir_runtime();
         void init_cleandir_default();
         void init_cleandir();
         void cleanup();
+        void cleanup_buffers();
         void init();
         void areadetect();
         void prepare();
@@ -95,8 +95,10 @@ ctx_parm config_parms[] = {
     {"width",                     PARM_TYP_INT,    PARM_CAT_03, PARM_LEVEL_LIMITED,  false},
     {"height",                    PARM_TYP_INT,    PARM_CAT_03, PARM_LEVEL_LIMITED,  false},
     {"framerate",                 PARM_TYP_INT,    PARM_CAT_03, PARM_LEVEL_LIMITED,  false},
+    {"framerate_catchup",         PARM_TYP_LIST,   PARM_CAT_03, PARM_LEVEL_ADVANCED, false},  /* Read at camera start */
     {"rotate",                    PARM_TYP_LIST,   PARM_CAT_03, PARM_LEVEL_LIMITED,  false},
     {"flip_axis",                 PARM_TYP_LIST,   PARM_CAT_03, PARM_LEVEL_LIMITED,  false},
+    {"image_hugepages",           PARM_TYP_BOOL,   PARM_CAT_03, PARM_LEVEL_ADVANCED, false},  /* Buffers allocated at camera start */
 
     /* Category 04 - Overlay parameters - HOT RELOADABLE */
     {"locate_motion_mode",        PARM_TYP_LIST,   PARM_CAT_04, PARM_LEVEL_LIMITED,  true},
@@ -119,6 +121,8 @@ ctx_parm config_parms[] = {
     {"threshold_tune",            PARM_TYP_BOOL,   PARM_CAT_05, PARM_LEVEL_LIMITED,  true},
     {"secondary_method",          PARM_TYP_LIST,   PARM_CAT_05, PARM_LEVEL_LIMITED,  false},  /* May need model reload */
     {"secondary_params",          PARM_TYP_PARAMS, PARM_CAT_05, PARM_LEVEL_LIMITED,  false},  /* May need model reload */
+    {"detect_params",             PARM_TYP_PARAMS, PARM_CAT_05, PARM_LEVEL_ADVANCED, false},  /* Read at camera start */
+    {"detection_scale",           PARM_TYP_INT,    PARM_CAT_05, PARM_LEVEL_ADVANCED, false},  /* Buffers sized at camera start */
 
     /* Category 06 - Mask parameters - mostly HOT RELOADABLE */
     {"noise_level",               PARM_TYP_INT,    PARM_CAT_06, PARM_LEVEL_LIMITED,  true},
@@ -161,6 +165,8 @@ ctx_parm config_parms[] = {
     {"picture_filename",          PARM_TYP_STRING, PARM_CAT_09, PARM_LEVEL_LIMITED,  true},
     {"snapshot_interval",         PARM_TYP_INT,    PARM_CAT_09, PARM_LEVEL_LIMITED,  true},
     {"snapshot_filename",         PARM_TYP_STRING, PARM_CAT_09, PARM_LEVEL_LIMITED,  true},
+    {"picture_writers",           PARM_TYP_INT,    PARM_CAT_09, PARM_LEVEL_ADVANCED, false},  /* Threads started at camera start */
+    {"picture_queue",             PARM_TYP_INT,    PARM_CAT_09, PARM_LEVEL_ADVANCED, false},  /* Queue sized at camera start */
 
     /* Category 10 - Movie parameters - mostly NOT hot reloadable */
     {"movie_output",              PARM_TYP_BOOL,   PARM_CAT_10, PARM_LEVEL_LIMITED,  false},  /* Recording state */
@@ -171,6 +177,7 @@ ctx_parm config_parms[] = {
     {"movie_encoder_preset",      PARM_TYP_LIST,   PARM_CAT_10, PARM_LEVEL_LIMITED,  false},  /* Encoder config */
     {"movie_container",           PARM_TYP_STRING, PARM_CAT_10, PARM_LEVEL_LIMITED,  false},  /* Encoder config */
     {"movie_passthrough",         PARM_TYP_BOOL,   PARM_CAT_10, PARM_LEVEL_LIMITED,  false},  /* Encoder config */
+    {"movie_queue_policy",        PARM_TYP_LIST,   PARM_CAT_10, PARM_LEVEL_ADVANCED, true},   /* Read at movie start */
     {"movie_filename",            PARM_TYP_STRING, PARM_CAT_10, PARM_LEVEL_LIMITED,  true},
     {"movie_retain",              PARM_TYP_LIST,   PARM_CAT_10, PARM_LEVEL_LIMITED,  true},
     {"movie_all_frames",          PARM_TYP_BOOL,   PARM_CAT_10, PARM_LEVEL_LIMITED,  false},  /* Encoder config */
@@ -635,6 +642,7 @@ void cls_config::dispatch_edit(const std::string& name, std::string& parm, enum
     if (name == "daemon") return edit_generic_bool(daemon, parm, pact, false);
     if (name == "native_language") return edit_generic_bool(native_language, parm, pact, true);
     if (name == "emulate_motion") return edit_generic_bool(emulate_motion, parm, pact, false);
+    if (name == "image_hugepages") return edit_generic_bool(parm_cam.image_hugepages, parm, pact, false);
     if (name == "threshold_tune") return edit_generic_bool(threshold_tune, parm, pact, false);
     if (name == "noise_tune") return edit_generic_bool(noise_tune, parm, pact, true);
     if (name == "movie_output") return edit_generic_bool(movie_output, parm, pact, true);
@@ -669,6 +677,7 @@ void cls_config::dispatch_edit(const std::string& name, std::string& parm, enum
     if (name == "threshold_sdevxy") return edit_generic_int(threshold_sdevxy, parm, pact, 0, 0, INT_MAX);
     if (name == "threshold_ratio") return edit_generic_int(threshold_ratio, parm, pact, 0, 0, 100);
     if (name == "threshold_ratio_change") return edit_generic_int(threshold_ratio_change, parm, pact, 64, 0, 255);
+    if (name == "detection_scale") return edit_generic_int(parm_cam.detection_scale, parm, pact, 1, 1, 4);
     if (name == "noise_level") return edit_generic_int(noise_level, parm, pact, 32, 1, 255);
     if (name == "smart_mask_speed") return edit_generic_int(smart_mask_speed, parm, pact, 0, 0, 10);
     if (name == "lightswitch_percent") return edit_generic_int(lightswitch_percent, parm, pact, 0, 0, 100);
@@ -680,6 +689,8 @@ void cls_config::dispatch_edit(const std::string& name, std::string& parm, enum
     if (name == "post_capture") return edit_generic_int(post_capture, parm, pact, 10, 0, 2147483647);
     if (name == "picture_quality") return edit_generic_int(picture_quality, parm, pact, 75, 1, 100);
     if (name == "snapshot_interval") return edit_generic_int(snapshot_interval, parm, pact, 0, 0, 2147483647);
+    if (name == "picture_writers") return edit_generic_int(picture_writers, parm, pact, 1, 0, 8);
+    if (name == "picture_queue") return edit_generic_int(picture_queue, parm, pact, 8, 1, 64);
     if (name == "movie_max_time") return edit_generic_int(movie_max_time, parm, pact, 120, 0, 2147483647);
     if (name == "movie_bps") return edit_generic_int(movie_bps, parm, pact, 400000, 0, INT_MAX);
     if (name == "movie_quality") return edit_generic_int(movie_quality, parm, pact, 60, 1, 100);
@@ -755,6 +766,7 @@ void cls_config::dispatch_edit(const std::string& name, std::string& parm, enum
     if (name == "mask_file") return edit_generic_string(mask_file, parm, pact, "");
     if (name == "mask_privacy") return edit_generic_string(mask_privacy, parm, pact, "");
     if (name == "secondary_params") return edit_generic_string(secondary_params, parm, pact, "");
+    if (name == "detect_params") return edit_generic_string(parm_cam.detect_params, parm, pact, "");
     if (name == "on_event_start") return edit_generic_string(on_event_start, parm, pact, "");
     if (name == "on_event_end") return edit_generic_string(on_event_end, parm, pact, "");
     if (name == "on_picture_save") return edit_generic_string(on_picture_save, parm, pact, "");
@@ -813,6 +825,9 @@ void cls_config::dispatch_edit(const std::string& name, std::string& parm, enum
     static const std::vector<std::string> flip_axis_values = {"none","vertical","horizontal"};
     if (name == "flip_axis") return edit_generic_list(flip_axis, parm, pact, "none", flip_axis_values);
 
+    static const std::vector<std::string> framerate_catchup_values = {"skip","burst"};
+    if (name == "framerate_catchup") return edit_generic_list(framerate_catchup, parm, pact, "skip", framerate_catchup_values);
+
     static const std::vector<std::string> locate_motion_mode_values = {"off","on","preview"};
     if (name == "locate_motion_mode") return edit_generic_list(locate_motion_mode, parm, pact, "off", locate_motion_mode_values);
 
@@ -839,6 +854,9 @@ void cls_config::dispatch_edit(const std::string& name, std::string& parm, enum
 
     if (name == "movie_passthrough") return edit_generic_bool(movie_passthrough, parm, pact, false);
 
+    static const std::vector<std::string> movie_queue_policy_values = {"block","drop","quality"};
+    if (name == "movie_queue_policy") return edit_generic_list(movie_queue_policy, parm, pact, "block", movie_queue_policy_values);
+
     static const std::vector<std::string> timelapse_mode_values = {"off","hourly","daily","weekly","monthly"};
     if (name == "timelapse_mode") return edit_generic_list(timelapse_mode, parm, pact, "off", timelapse_mode_values);
 
@@ -150,6 +150,7 @@
             int&            width                   = parm_cam.width;
             int&            height                  = parm_cam.height;
             int&            framerate               = parm_cam.framerate;
+            std::string&    framerate_catchup       = parm_cam.framerate_catchup;
             int&            rotate                  = parm_cam.rotate;
             std::string&    flip_axis               = parm_cam.flip_axis;
 
@@ -218,6 +219,8 @@
             /* Snapshot parameters (-> parm_cam) */
             int&            snapshot_interval       = parm_cam.snapshot_interval;
             std::string&    snapshot_filename       = parm_cam.snapshot_filename;
+            int&            picture_writers         = parm_cam.picture_writers;
+            int&            picture_queue           = parm_cam.picture_queue;
 
             /* Movie output parameters (-> parm_cam) */
             bool&           movie_output            = parm_cam.movie_output;
@@ -226,6 +229,7 @@
             int&            movie_bps               = parm_cam.movie_bps;
             int&            movie_quality           = parm_cam.movie_quality;
             std::string&    movie_encoder_preset    = parm_cam.movie_encoder_preset;
+            std::string&    movie_queue_policy      = parm_cam.movie_queue_policy;
             std::string&    movie_container         = parm_cam.movie_container;
             bool&           movie_passthrough       = parm_cam.movie_passthrough;
             std::string&    movie_filename          = parm_cam.movie_filename;
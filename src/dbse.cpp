@@ -1126,6 +1126,22 @@ void cls_dbse::exec(cls_camera *cam, std::string fname, std::string cmd)
 
 void cls_dbse::filelist_add(cls_camera *cam, timespec *ts1, std::string ftyp
     ,std::string filenm, std::string fullnm, std::string dirnm)
+{
+    cam->watchdog = cam->cfg->watchdog_tmo;
+
+    filelist_add(cam->cfg->device_id, ts1, ftyp, filenm, fullnm, dirnm
+        , cam->info_diff_tot, cam->info_diff_cnt, cam->info_sdev_tot
+        , cam->info_sdev_min, cam->info_sdev_max);
+}
+
+/*
+ * Add the file with the motion stats of the camera given as values so that
+ * the picture writer threads do not read them from the camera.
+ */
+void cls_dbse::filelist_add(int device_id, timespec *ts1, std::string ftyp
+    ,std::string filenm, std::string fullnm, std::string dirnm
+    ,uint64_t diff_tot, uint64_t diff_cnt, uint64_t sdev_tot
+    ,int sdev_min, int sdev_max)
 {
     std::string sqlquery;
     struct stat statbuf;
@@ -1141,8 +1157,6 @@ void cls_dbse::filelist_add(cls_camera *cam, timespec *ts1, std::string ftyp
         return;
     }
 
-    cam->watchdog = cam->cfg->watchdog_tmo;
-
     if (stat(fullnm.c_str(), &statbuf) == 0) {
         bsz = statbuf.st_size;
     } else {
@@ -1153,13 +1167,13 @@ void cls_dbse::filelist_add(cls_camera *cam, timespec *ts1, std::string ftyp
     strftime(tmc, 11, "%I:%M%p"  , &timestamp_tm);
     strftime(tml, 11, "%H:%M:%S" , &timestamp_tm);
 
-    if (cam->info_diff_cnt != 0) {
-        diff_avg = (cam->info_diff_tot / cam->info_diff_cnt);
+    if (diff_cnt != 0) {
+        diff_avg = (diff_tot / diff_cnt);
     } else {
         diff_avg =0;
     }
-    if (cam->info_diff_cnt != 0) {
-        sdev_avg = (cam->info_sdev_tot / cam->info_diff_cnt);
+    if (diff_cnt != 0) {
+        sdev_avg = (sdev_tot / diff_cnt);
     } else {
         sdev_avg =0;
     }
@@ -1169,7 +1183,7 @@ void cls_dbse::filelist_add(cls_camera *cam, timespec *ts1, std::string ftyp
     sqlquery += " , full_nm, file_sz, file_dtl";
     sqlquery += " , file_tmc, file_tml, diff_avg";
     sqlquery += " , sdev_min, sdev_max, sdev_avg)";
-    sqlquery += " values ("+std::to_string(cam->cfg->device_id);
+    sqlquery += " values ("+std::to_string(device_id);
     /* Use SQL escaping to prevent injection attacks */
     sqlquery += " ,'" + dbse_escape_sql_string(filenm) + "'";
     sqlquery += " ,'" + dbse_escape_sql_string(ftyp) + "'";
@@ -1180,8 +1194,8 @@ void cls_dbse::filelist_add(cls_camera *cam, timespec *ts1, std::string ftyp
     sqlquery += " ,'" + std::string(tmc)+ "'";
     sqlquery += " ,'" + std::string(tml)+ "'";
     sqlquery += " ,"  + std::to_string(diff_avg);
-    sqlquery += " ,"  + std::to_string(cam->info_sdev_min);
-    sqlquery += " ,"  + std::to_string(cam->info_sdev_max);
+    sqlquery += " ,"  + std::to_string(sdev_min);
+    sqlquery += " ,"  + std::to_string(sdev_max);
     sqlquery += " ,"  + std::to_string(sdev_avg);
     sqlquery += ")";
 
@@ -90,6 +90,10 @@ class cls_dbse {
         void exec_sql(std::string sql);
         void filelist_add(cls_camera *cam, timespec *ts1, std::string ftyp
             ,std::string filenm, std::string fullnm, std::string dirnm);
+        void filelist_add(int device_id, timespec *ts1, std::string ftyp
+            ,std::string filenm, std::string fullnm, std::string dirnm
+            ,uint64_t diff_tot, uint64_t diff_cnt, uint64_t sdev_tot
+            ,int sdev_min, int sdev_max);
         void filelist_get(std::string sql, vec_files &p_flst);
         bool restart;
         bool finish;
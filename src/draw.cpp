@@ -21,6 +21,7 @@
 #include "camera.hpp"
 #include "conf.hpp"
 #include "logger.hpp"
+#include "alg_simd.hpp"
 #include "alg.hpp"
 #include "draw.hpp"
 
@@ -1438,9 +1439,16 @@ void cls_draw::locate()
 
 }
 
+/* Index in the detection plane buffers of image pixel x,y */
+int cls_draw::det_indx(int x, int y)
+{
+    return ((y / cam->imgs.det_scale) * cam->imgs.det_width) +
+        (x / cam->imgs.det_scale);
+}
+
 void cls_draw::smartmask()
 {
-    int i, x, v, width, height, line;
+    int i, x, v, width, height;
     ctx_images *imgs = &cam->imgs;
     u_char *mask_final = cam->alg->smartmask_final;
     u_char *out_y, *out_u, *out_v;
@@ -1455,11 +1463,10 @@ void cls_draw::smartmask()
     out_v = out + v;
     out_u = out + i;
     for (i = 0; i < height; i += 2) {
-        line = i * width;
         for (x = 0; x < width; x += 2) {
-            if (mask_final[line + x] == 0 || mask_final[line + x + 1] == 0 ||
-                mask_final[line + width + x] == 0 ||
-                mask_final[line + width + x + 1] == 0) {
+            if (mask_final[det_indx(x, i)] == 0 || mask_final[det_indx(x + 1, i)] == 0 ||
+                mask_final[det_indx(x, i + 1)] == 0 ||
+                mask_final[det_indx(x + 1, i + 1)] == 0) {
 
                 *out_v = 255;
                 *out_u = 128;
@@ -1470,11 +1477,13 @@ void cls_draw::smartmask()
     }
     out_y = out;
     /* Set colour intensity for smartmask. */
-    for (i = 0; i < imgs->motionsize; i++) {
-        if (mask_final[i] == 0) {
-            *out_y = 0;
+    for (i = 0; i < height; i++) {
+        for (x = 0; x < width; x++) {
+            if (mask_final[det_indx(x, i)] == 0) {
+                *out_y = 0;
+            }
+            out_y++;
         }
-        out_y++;
     }
 }
 
@@ -1520,7 +1529,7 @@ void cls_draw::fixed_mask()
 
 void cls_draw::largest_label()
 {
-    int i, x, v, width, height, line;
+    int i, x, v, width, height;
     ctx_images *imgs = &cam->imgs;
     int *labels = imgs->labels;
     u_char *out_y, *out_u, *out_v;
@@ -1535,11 +1544,10 @@ void cls_draw::largest_label()
     out_u = out + i;
     out_v = out + v;
     for (i = 0; i < height; i += 2) {
-        line = i * width;
         for (x = 0; x < width; x += 2) {
-            if (labels[line + x] & 32768 || labels[line + x + 1] & 32768 ||
-                labels[line + width + x] & 32768 ||
-                labels[line + width + x + 1] & 32768) {
+            if (labels[det_indx(x, i)] & 32768 || labels[det_indx(x + 1, i)] & 32768 ||
+                labels[det_indx(x, i + 1)] & 32768 ||
+                labels[det_indx(x + 1, i + 1)] & 32768) {
 
                 *out_u = 255;
                 *out_v = 128;
@@ -1550,11 +1558,13 @@ void cls_draw::largest_label()
     }
     out_y = out;
     /* Set intensity for coloured label to have better visibility. */
-    for (i = 0; i < imgs->motionsize; i++) {
-        if (*labels++ & 32768) {
-            *out_y = 0;
+    for (i = 0; i < height; i++) {
+        for (x = 0; x < width; x++) {
+            if (labels[det_indx(x, i)] & 32768) {
+                *out_y = 0;
+            }
+            out_y++;
         }
-        out_y++;
     }
 }
 
@@ -43,6 +43,7 @@
                 , const char *text, int len, int factor);
             void init_chars(void);
             void init_scale();
+            int det_indx(int x, int y);
             void location(ctx_coord *cent
                 , ctx_images *imgs, int width, u_char *new_var);
             void red_location(ctx_coord *cent
@@ -0,0 +1,219 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <sys/mman.h>
+#include "motion.hpp"
+#include "util.hpp"
+#include "logger.hpp"
+#include "framepool.hpp"
+
+/* Find or add the list for the size.  Called with the mutex locked */
+ctx_framepool_list *cls_framepool::list_get(size_t sz)
+{
+    ctx_framepool_list lst;
+    int indx;
+
+    for (indx = 0; indx < (int)lists.size(); indx++) {
+        if (lists[indx].size == sz) {
+            return &lists[indx];
+        }
+    }
+    lst.size = sz;
+    lst.used = 0;
+    lists.push_back(lst);
+
+    return &lists.back();
+}
+
+u_char *cls_framepool::buf_alloc(size_t sz)
+{
+    void *mem;
+    size_t mem_sz, mem_align;
+    ctx_framepool_hdr *hdr;
+    int retcd;
+
+    mem_sz = sz + FRAMEPOOL_ALIGN;
+    mem_align = FRAMEPOOL_ALIGN;
+    if (hugepages && (sz >= FRAMEPOOL_HUGE_SZ)) {
+        mem_align = FRAMEPOOL_HUGE_SZ;
+        mem_sz = ((mem_sz + FRAMEPOOL_HUGE_SZ - 1) / FRAMEPOOL_HUGE_SZ)
+            * FRAMEPOOL_HUGE_SZ;
+    }
+
+    retcd = posix_memalign(&mem, mem_align, mem_sz);
+    if (retcd != 0) {
+        MOTION_LOG(EMG, TYPE_ALL, NO_ERRNO
+            , _("Could not allocate %llu bytes of memory!")
+            , (unsigned long long)mem_sz);
+        exit(1);
+    }
+
+    hdr = (ctx_framepool_hdr *)mem;
+    hdr->size = sz;
+    hdr->huge = false;
+    if (mem_align == FRAMEPOOL_HUGE_SZ) {
+        #ifdef MADV_HUGEPAGE
+            if (madvise(mem, mem_sz, MADV_HUGEPAGE) == 0) {
+                hdr->huge = true;
+            }
+        #endif
+        if (hdr->huge == false) {
+            MOTION_LOG(DBG, TYPE_ALL, SHOW_ERRNO
+                , _("Pool %s: huge pages not available"), name.c_str());
+        }
+    }
+    memset((u_char *)mem + FRAMEPOOL_ALIGN, 0, sz);
+
+    return (u_char *)mem + FRAMEPOOL_ALIGN;
+}
+
+void cls_framepool::buf_free(u_char *buf)
+{
+    free(buf - FRAMEPOOL_ALIGN);
+}
+
+/* Get a buffer of at least sz bytes */
+u_char *cls_framepool::get(size_t sz)
+{
+    ctx_framepool_list *lst;
+    u_char *buf;
+
+    sz = ((sz + FRAMEPOOL_ALIGN - 1) / FRAMEPOOL_ALIGN) * FRAMEPOOL_ALIGN;
+
+    pthread_mutex_lock(&mutex);
+        lst = list_get(sz);
+        buf = nullptr;
+        if (lst->free_bufs.empty() == false) {
+            buf = lst->free_bufs.back();
+            lst->free_bufs.pop_back();
+            bufs_free--;
+        }
+        lst->used++;
+        bufs_used++;
+        if (bufs_used > bufs_max) {
+            bufs_max = bufs_used;
+        }
+        bytes_used += (int64_t)sz;
+        gets++;
+        if (buf == nullptr) {
+            allocs++;
+            bytes_total += (int64_t)sz;
+        }
+    pthread_mutex_unlock(&mutex);
+
+    if (buf == nullptr) {
+        buf = buf_alloc(sz);
+    }
+
+    return buf;
+}
+
+/* Return the buffer to its free list and clear the pointer */
+void cls_framepool::put(u_char *&buf)
+{
+    ctx_framepool_hdr *hdr;
+    ctx_framepool_list *lst;
+
+    if (buf == nullptr) {
+        return;
+    }
+    hdr = (ctx_framepool_hdr *)(buf - FRAMEPOOL_ALIGN);
+
+    pthread_mutex_lock(&mutex);
+        lst = list_get(hdr->size);
+        lst->free_bufs.push_back(buf);
+        lst->used--;
+        bufs_used--;
+        bufs_free++;
+        bytes_used -= (int64_t)hdr->size;
+    pthread_mutex_unlock(&mutex);
+
+    buf = nullptr;
+}
+
+/* Release the memory of the free buffers such as after a size change */
+void cls_framepool::trim()
+{
+    int indx, bufnbr;
+
+    pthread_mutex_lock(&mutex);
+        for (indx = 0; indx < (int)lists.size(); indx++) {
+            for (bufnbr = 0; bufnbr < (int)lists[indx].free_bufs.size(); bufnbr++) {
+                buf_free(lists[indx].free_bufs[bufnbr]);
+                bytes_total -= (int64_t)lists[indx].size;
+                bufs_free--;
+            }
+            lists[indx].free_bufs.clear();
+        }
+        indx = 0;
+        while (indx < (int)lists.size()) {
+            if (lists[indx].used == 0) {
+                lists.erase(lists.begin() + indx);
+            } else {
+                indx++;
+            }
+        }
+    pthread_mutex_unlock(&mutex);
+}
+
+void cls_framepool::stats_log()
+{
+    int indx;
+
+    pthread_mutex_lock(&mutex);
+        MOTION_LOG(INF, TYPE_ALL, NO_ERRNO
+            , _("Pool %s: %d buffers in use (max %d), %d free, %lld of %lld KB in use"
+                ", %lld gets with %lld allocations")
+            , name.c_str(), bufs_used, bufs_max, bufs_free
+            , (long long)(bytes_used / 1024), (long long)(bytes_total / 1024)
+            , (long long)gets, (long long)allocs);
+        for (indx = 0; indx < (int)lists.size(); indx++) {
+            MOTION_LOG(DBG, TYPE_ALL, NO_ERRNO
+                , _("Pool %s: size %llu, %d in use, %d free")
+                , name.c_str(), (unsigned long long)lists[indx].size
+                , lists[indx].used, (int)lists[indx].free_bufs.size());
+        }
+    pthread_mutex_unlock(&mutex);
+}
+
+cls_framepool::cls_framepool(std::string p_name)
+{
+    name = p_name;
+    hugepages = false;
+    bufs_used = 0;
+    bufs_free = 0;
+    bufs_max = 0;
+    bytes_used = 0;
+    bytes_total = 0;
+    gets = 0;
+    allocs = 0;
+    pthread_mutex_init(&mutex, NULL);
+}
+
+cls_framepool::~cls_framepool()
+{
+    if (gets > 0) {
+        stats_log();
+    }
+    if (bufs_used > 0) {
+        MOTION_LOG(WRN, TYPE_ALL, NO_ERRNO
+            , _("Pool %s: %d buffers were not returned"), name.c_str(), bufs_used);
+    }
+    trim();
+    pthread_mutex_destroy(&mutex);
+}
@@ -0,0 +1,78 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * framepool.hpp - Pool of image buffers
+ *
+ * Each camera (and the all camera view) owns a pool which hands out the
+ * YUV buffers for the image ring, the streams and the scaled copies.  The
+ * buffers start on a 64 byte boundary and, when image_hugepages is on, the
+ * large ones are backed by transparent huge pages.  A buffer which is put
+ * back goes onto the free list of its size and is handed out again by the
+ * next get of that size, so once the lists are filled no memory is
+ * allocated for each image.  Reused buffers are not cleared.
+ */
+
+#ifndef _INCLUDE_FRAMEPOOL_HPP_
+#define _INCLUDE_FRAMEPOOL_HPP_
+
+    #define FRAMEPOOL_ALIGN     64
+    #define FRAMEPOOL_HUGE_SZ   (2 * 1024 * 1024)
+
+    /* Kept in front of each buffer */
+    struct ctx_framepool_hdr {
+        size_t  size;       /* Size of the list the buffer belongs to */
+        bool    huge;
+    };
+
+    /* Buffers of one size */
+    struct ctx_framepool_list {
+        size_t                  size;
+        int                     used;
+        std::vector<u_char*>    free_bufs;
+    };
+
+    class cls_framepool {
+        public:
+            cls_framepool(std::string p_name);
+            ~cls_framepool();
+            u_char *get(size_t sz);
+            void put(u_char *&buf);
+            void trim();
+            void stats_log();
+
+            std::string name;
+            bool        hugepages;      /* Back the large buffers with huge pages */
+            int         bufs_used;      /* Buffers handed out */
+            int         bufs_free;      /* Buffers on the free lists */
+            int         bufs_max;       /* Most buffers handed out at once */
+            int64_t     bytes_used;
+            int64_t     bytes_total;    /* Memory held by the pool */
+            int64_t     gets;
+            int64_t     allocs;         /* Gets which needed new memory */
+
+        private:
+            pthread_mutex_t mutex;
+            std::vector<ctx_framepool_list> lists;
+
+            ctx_framepool_list *list_get(size_t sz);
+            u_char *buf_alloc(size_t sz);
+            void buf_free(u_char *buf);
+    };
+
+#endif /* _INCLUDE_FRAMEPOOL_HPP_ */
@@ -23,6 +23,7 @@
 #include "conf.hpp"
 #include "logger.hpp"
 #include "jpegutils.hpp"
+#include "metrics.hpp"
 #include <setjmp.h>
 #include <jpeglib.h>
 #include <jerror.h>
@@ -176,6 +177,8 @@ struct ctx_exif_info {
     uint datasize;
     uint ifds_size;
     struct tiff_writing writing;
+    uint dt_pos[2];     /* Where the date times are in the marker */
+    uint tz_pos;        /* Where the time zone offset is in the marker */
 };
 
 void jpgutl_exif_date(ctx_exif_info *exif_info)
@@ -281,6 +284,8 @@ void jpgutl_exif_writeifd0(ctx_exif_info *exif_info)
     if (exif_info->datetime) {
         put_stringentry(&exif_info->writing
             , TIFF_TAG_DATETIME, exif_info->datetime, 1);
+        exif_info->dt_pos[0] = 6 + exif_info->writing.data_offset -
+            ((uint)strlen(exif_info->datetime) + 1);
     }
 
     if (exif_info->ifd1_tagcount > 0) {
@@ -295,6 +300,8 @@ void jpgutl_exif_writeifd0(ctx_exif_info *exif_info)
         memcpy(exif_info->writing.buf, exif_tzoffset_tag, 12);
         put_sint16(exif_info->writing.buf+8
             , (int)(exif_info->timestamp_tm.tm_gmtoff / 3600));
+        exif_info->tz_pos = 6 + (uint)(exif_info->writing.buf + 8 -
+            exif_info->writing.base);
         exif_info->writing.buf += 12;
     }
 
@@ -315,6 +322,8 @@ void jpgutl_exif_writeifd1(ctx_exif_info *exif_info)
         if (exif_info->datetime) {
             put_stringentry(&exif_info->writing
                 , EXIF_TAG_ORIGINAL_DATETIME, exif_info->datetime, 1);
+            exif_info->dt_pos[1] = 6 + exif_info->writing.data_offset -
+                ((uint)strlen(exif_info->datetime) + 1);
         }
 
         if (exif_info->box) {
@@ -332,24 +341,20 @@ void jpgutl_exif_writeifd1(ctx_exif_info *exif_info)
 
 }
 
-uint jpgutl_exif(u_char **exif, cls_camera *cam, timespec *ts_in1, ctx_coord *box)
+/* Build the marker.  The positions of the fields are left in exif_info */
+static uint jpgutl_exif_build(u_char **exif, ctx_exif_info *exif_info)
 {
-    struct ctx_exif_info *exif_info;
     uint buffer_size;
     uint marker_len;
     JOCTET *marker;
 
-    exif_info = (ctx_exif_info*)mymalloc(sizeof(ctx_exif_info));
-    memset(exif_info, 0, sizeof(sizeof(ctx_exif_info)));
-    exif_info->cam = cam;
-    exif_info->ts_in1 = ts_in1;
-    exif_info->box = box;
-
     jpgutl_exif_date(exif_info);
 
     jpgutl_exif_tags(exif_info);
 
     if (exif_info->ifds_size == 0) {
+        myfree(exif_info->description);
+        myfree(exif_info->datetime);
         return 0;
     }
 
@@ -371,13 +376,23 @@ uint jpgutl_exif(u_char **exif, cls_camera *cam, timespec *ts_in1, ctx_coord *bo
     myfree(exif_info->description);
     myfree(exif_info->datetime);
 
-    myfree(exif_info);
-
     *exif = marker;
 
     return marker_len;
 }
 
+uint jpgutl_exif(u_char **exif, cls_camera *cam, timespec *ts_in1, ctx_coord *box)
+{
+    struct ctx_exif_info exif_info;
+
+    memset(&exif_info, 0, sizeof(ctx_exif_info));
+    exif_info.cam = cam;
+    exif_info.ts_in1 = ts_in1;
+    exif_info.box = box;
+
+    return jpgutl_exif_build(exif, &exif_info);
+}
+
 struct jpgutl_error_mgr {
     struct jpeg_error_mgr pub;   /* "public" fields */
     jmp_buf setjmp_buffer;       /* For return to caller */
@@ -712,25 +727,6 @@ static GLOBAL(int) _jpeg_mem_size(j_compress_ptr cinfo)
     return (int)dest->jpegsize;
 }
 
-/*
- * put_jpeg_exif writes the EXIF APP1 chunk to the jpeg file.
- * It must be called after jpeg_start_compress() but before
- * any image data is written by jpeg_write_scanlines().
- */
-static void put_jpeg_exif(j_compress_ptr cinfo, cls_camera *cam,
-        timespec *ts1, ctx_coord *box)
-{
-    u_char *exif = NULL;
-    uint exif_len = jpgutl_exif(&exif, cam, ts1, box);
-
-    if(exif_len > 0) {
-        /* EXIF data lives in a JPEG APP1 marker */
-        jpeg_write_marker(cinfo, JPEG_APP0 + 1, exif, exif_len);
-        free(exif);
-    }
-}
-
-
 /**
  * jpgutl_decode_jpeg
  *  Purpose:  Decompress the jpeg data_in into the img_out buffer.
@@ -845,67 +841,159 @@ int jpgutl_decode_jpeg (u_char *jpeg_data_in, int jpeg_data_len,
 
 }
 
-int jpgutl_put_yuv420p(u_char *dest_image, int image_size,
-        u_char *input_image, int width, int height, int quality,
-        cls_camera *cam, timespec *ts1, ctx_coord *box)
+/* Compress state kept by cls_jpgenc between images */
+struct ctx_jpgenc {
+    struct jpeg_compress_struct cinfo;
+    struct jpgutl_error_mgr     jerr;
+    bool    created;
+    int     width;      /* Parameters of the tables in cinfo.  Zero when none */
+    int     height;
+    int     quality;
+};
+
+static void jpgenc_create(ctx_jpgenc *enc)
+{
+    if (enc->created) {
+        return;
+    }
+    enc->cinfo.err = jpeg_std_error (&enc->jerr.pub);
+    enc->jerr.pub.error_exit = jpgutl_error_exit;
+    /* Also hook the emit_message routine to note corrupt-data warnings. */
+    enc->jerr.original_emit_message = enc->jerr.pub.emit_message;
+    enc->jerr.pub.emit_message = jpgutl_emit_message;
+    enc->jerr.warning_seen = 0;
+    jpeg_create_compress(&enc->cinfo);
+    enc->created = true;
+    enc->width = 0;
+    enc->height = 0;
+    enc->quality = 0;
+}
 
+/* Drop the state after an error so the next image starts clean */
+static void jpgenc_destroy(ctx_jpgenc *enc)
+{
+    if (enc->created) {
+        jpeg_destroy_compress(&enc->cinfo);
+        enc->created = false;
+    }
+}
+
+/* Write the exif marker.  Called after jpeg_start_compress */
+void cls_jpgenc::put_exif(struct jpeg_compress_struct *cinfo
+    , timespec *ts1, ctx_coord *box)
+{
+    ctx_exif_info exif_info;
+    struct tm timestamp_tm;
+    struct timespec ts;
+    char tmpbuf[45];
+    u_char *marker;
+    uint marker_len;
+
+    if (cam == nullptr) {
+        return;
+    }
+
+    /* The subject area and a formatted description change with each image */
+    if ((box != nullptr) ||
+        (cam->cfg->picture_exif.find('%') != std::string::npos)) {
+        marker = nullptr;
+        marker_len = jpgutl_exif(&marker, cam, ts1, box);
+        if (marker_len > 0) {
+            jpeg_write_marker(cinfo, JPEG_APP0 + 1, marker, marker_len);
+            free(marker);
+        }
+        return;
+    }
+
+    if ((exif == nullptr) || (exif_desc != cam->cfg->picture_exif)) {
+        myfree(exif);
+        memset(&exif_info, 0, sizeof(ctx_exif_info));
+        exif_info.cam = cam;
+        exif_info.ts_in1 = ts1;
+        exif_len = jpgutl_exif_build(&exif, &exif_info);
+        exif_dt_pos[0] = exif_info.dt_pos[0];
+        exif_dt_pos[1] = exif_info.dt_pos[1];
+        exif_tz_pos = exif_info.tz_pos;
+        exif_desc = cam->cfg->picture_exif;
+    } else {
+        /* Only the time changes */
+        if (ts1 == nullptr) {
+            clock_gettime(CLOCK_REALTIME, &ts);
+        } else {
+            ts = *ts1;
+        }
+        localtime_r(&ts.tv_sec, &timestamp_tm);
+        snprintf(tmpbuf, 45, "%04d:%02d:%02d %02d:%02d:%02d",
+            timestamp_tm.tm_year + 1900, timestamp_tm.tm_mon + 1,
+            timestamp_tm.tm_mday, timestamp_tm.tm_hour,
+            timestamp_tm.tm_min, timestamp_tm.tm_sec);
+        memcpy(exif + exif_dt_pos[0], tmpbuf, 19);
+        memcpy(exif + exif_dt_pos[1], tmpbuf, 19);
+        put_sint16(exif + exif_tz_pos, (int)(timestamp_tm.tm_gmtoff / 3600));
+    }
+
+    if (exif_len > 0) {
+        jpeg_write_marker(cinfo, JPEG_APP0 + 1, exif, exif_len);
+    }
+}
+
+int cls_jpgenc::put_yuv420p(u_char *dest_image, int image_size,
+        u_char *input_image, int width, int height, int quality,
+        timespec *ts1, ctx_coord *box)
 {
     int i, j, jpeg_image_size;
 
     JSAMPROW y[16],cb[16],cr[16]; // y[2][5] = color sample of row 2 and pixel column 5; (one plane)
     JSAMPARRAY data[3]; // t[0][2][5] = color sample 0 of row 2 and column 5
 
-    struct jpeg_compress_struct cinfo;
-    struct jpgutl_error_mgr jerr;
+    ctx_jpgenc *enc = yuv;
 
     data[0] = y;
     data[1] = cb;
     data[2] = cr;
 
-    cinfo.err = jpeg_std_error (&jerr.pub);
-    jerr.pub.error_exit = jpgutl_error_exit;
-    /* Also hook the emit_message routine to note corrupt-data warnings. */
-    jerr.original_emit_message = jerr.pub.emit_message;
-    jerr.pub.emit_message = jpgutl_emit_message;
-    jerr.warning_seen = 0;
-
-    jpeg_create_compress(&cinfo);
+    jpgenc_create(enc);
 
     /* Establish the setjmp return context for jpgutl_error_exit to use. */
-    if (setjmp (jerr.setjmp_buffer)) {
+    if (setjmp (enc->jerr.setjmp_buffer)) {
         /* If we get here, the JPEG code has signaled an error. */
-        jpeg_destroy_compress (&cinfo);
+        jpgenc_destroy(enc);
         return -1;
     }
 
-    cinfo.image_width = (uint)width;
-    cinfo.image_height = (uint)height;
-    cinfo.input_components = 3;
-    jpeg_set_defaults(&cinfo);
-
-    jpeg_set_colorspace(&cinfo, JCS_YCbCr);
-
-    cinfo.raw_data_in = TRUE; // Supply downsampled data
-    #if JPEG_LIB_VERSION >= 70
-        cinfo.do_fancy_downsampling = FALSE;  // Fix segfault with v7
-    #endif
-    cinfo.comp_info[0].h_samp_factor = 2;
-    cinfo.comp_info[0].v_samp_factor = 2;
-    cinfo.comp_info[1].h_samp_factor = 1;
-    cinfo.comp_info[1].v_samp_factor = 1;
-    cinfo.comp_info[2].h_samp_factor = 1;
-    cinfo.comp_info[2].v_samp_factor = 1;
-
-    jpeg_set_quality(&cinfo, quality, TRUE);
-    cinfo.dct_method = JDCT_FASTEST;
+    /* The defaults and tables are only set up when the parameters change */
+    if ((enc->width != width) || (enc->height != height) ||
+        (enc->quality != quality)) {
+        enc->cinfo.image_width = (uint)width;
+        enc->cinfo.image_height = (uint)height;
+        enc->cinfo.input_components = 3;
+        jpeg_set_defaults(&enc->cinfo);
+
+        jpeg_set_colorspace(&enc->cinfo, JCS_YCbCr);
+
+        enc->cinfo.raw_data_in = TRUE; // Supply downsampled data
+        #if JPEG_LIB_VERSION >= 70
+            enc->cinfo.do_fancy_downsampling = FALSE;  // Fix segfault with v7
+        #endif
+        enc->cinfo.comp_info[0].h_samp_factor = 2;
+        enc->cinfo.comp_info[0].v_samp_factor = 2;
+        enc->cinfo.comp_info[1].h_samp_factor = 1;
+        enc->cinfo.comp_info[1].v_samp_factor = 1;
+        enc->cinfo.comp_info[2].h_samp_factor = 1;
+        enc->cinfo.comp_info[2].v_samp_factor = 1;
+
+        jpeg_set_quality(&enc->cinfo, quality, TRUE);
+        enc->cinfo.dct_method = JDCT_FASTEST;
+        enc->width = width;
+        enc->height = height;
+        enc->quality = quality;
+    }
 
-    _jpeg_mem_dest(&cinfo, dest_image, (uint)image_size);
+    _jpeg_mem_dest(&enc->cinfo, dest_image, (uint)image_size);
 
-    jpeg_start_compress(&cinfo, TRUE);
+    jpeg_start_compress(&enc->cinfo, TRUE);
 
-    if (cam != NULL) {
-        put_jpeg_exif(&cinfo, cam, ts1, box);
-    }
+    put_exif(&enc->cinfo, ts1, box);
 
     /* If the image is not a multiple of 16, this overruns the buffers
      * we'll just pad those last bytes with zeros
@@ -924,70 +1012,114 @@ int jpgutl_put_yuv420p(u_char *dest_image, int image_size,
                 cr[i] = 0x00;
             }
         }
-        jpeg_write_raw_data(&cinfo, data, 16);
+        jpeg_write_raw_data(&enc->cinfo, data, 16);
     }
 
-    jpeg_finish_compress(&cinfo);
-    jpeg_image_size = _jpeg_mem_size(&cinfo);
-    jpeg_destroy_compress(&cinfo);
+    jpeg_finish_compress(&enc->cinfo);
+    jpeg_image_size = _jpeg_mem_size(&enc->cinfo);
+
+    if (cam != NULL) {
+        cam->metrics->count(METRICS_JPEG);
+    }
 
     return jpeg_image_size;
 }
 
-
-int jpgutl_put_grey(u_char *dest_image, int image_size,
+int cls_jpgenc::put_grey(u_char *dest_image, int image_size,
         u_char *input_image, int width, int height, int quality,
-        cls_camera *cam, timespec *ts1, ctx_coord *box)
+        timespec *ts1, ctx_coord *box)
 {
     int y, dest_image_size;
     JSAMPROW row_ptr[1];
-    struct jpeg_compress_struct cjpeg;
-    struct jpgutl_error_mgr jerr;
-
-    cjpeg.err = jpeg_std_error (&jerr.pub);
-    jerr.pub.error_exit = jpgutl_error_exit;
-    /* Also hook the emit_message routine to note corrupt-data warnings. */
-    jerr.original_emit_message = jerr.pub.emit_message;
-    jerr.pub.emit_message = jpgutl_emit_message;
-    jerr.warning_seen = 0;
+    ctx_jpgenc *enc = grey;
 
-    jpeg_create_compress(&cjpeg);
+    jpgenc_create(enc);
 
     /* Establish the setjmp return context for jpgutl_error_exit to use. */
-    if (setjmp (jerr.setjmp_buffer)) {
+    if (setjmp (enc->jerr.setjmp_buffer)) {
         /* If we get here, the JPEG code has signaled an error. */
-        jpeg_destroy_compress (&cjpeg);
+        jpgenc_destroy(enc);
         return -1;
     }
 
-    cjpeg.image_width = (uint)width;
-    cjpeg.image_height = (uint)height;
-    cjpeg.input_components = 1; /* One colour component */
-    cjpeg.in_color_space = JCS_GRAYSCALE;
+    if ((enc->width != width) || (enc->height != height) ||
+        (enc->quality != quality)) {
+        enc->cinfo.image_width = (uint)width;
+        enc->cinfo.image_height = (uint)height;
+        enc->cinfo.input_components = 1; /* One colour component */
+        enc->cinfo.in_color_space = JCS_GRAYSCALE;
 
-    jpeg_set_defaults(&cjpeg);
+        jpeg_set_defaults(&enc->cinfo);
 
-    jpeg_set_quality(&cjpeg, quality, TRUE);
-    cjpeg.dct_method = JDCT_FASTEST;
-    _jpeg_mem_dest(&cjpeg, dest_image, (uint)image_size);
+        jpeg_set_quality(&enc->cinfo, quality, TRUE);
+        enc->cinfo.dct_method = JDCT_FASTEST;
+        enc->width = width;
+        enc->height = height;
+        enc->quality = quality;
+    }
+    _jpeg_mem_dest(&enc->cinfo, dest_image, (uint)image_size);
 
-    jpeg_start_compress (&cjpeg, TRUE);
+    jpeg_start_compress (&enc->cinfo, TRUE);
 
-    if (cam != NULL) {
-        put_jpeg_exif(&cjpeg, cam, ts1, box);
-    }
+    put_exif(&enc->cinfo, ts1, box);
 
     row_ptr[0] = input_image;
 
     for (y = 0; y < height; y++) {
-        jpeg_write_scanlines(&cjpeg, row_ptr, 1);
+        jpeg_write_scanlines(&enc->cinfo, row_ptr, 1);
         row_ptr[0] += width;
     }
 
-    jpeg_finish_compress(&cjpeg);
-    dest_image_size = _jpeg_mem_size(&cjpeg);
-    jpeg_destroy_compress(&cjpeg);
+    jpeg_finish_compress(&enc->cinfo);
+    dest_image_size = _jpeg_mem_size(&enc->cinfo);
+
+    if (cam != NULL) {
+        cam->metrics->count(METRICS_JPEG);
+    }
 
     return dest_image_size;
 }
 
+cls_jpgenc::cls_jpgenc(cls_camera *p_cam)
+{
+    cam = p_cam;
+    yuv = new ctx_jpgenc;
+    yuv->created = false;
+    grey = new ctx_jpgenc;
+    grey->created = false;
+    exif = nullptr;
+    exif_len = 0;
+    exif_dt_pos[0] = 0;
+    exif_dt_pos[1] = 0;
+    exif_tz_pos = 0;
+}
+
+cls_jpgenc::~cls_jpgenc()
+{
+    jpgenc_destroy(yuv);
+    jpgenc_destroy(grey);
+    mydelete(yuv);
+    mydelete(grey);
+    myfree(exif);
+}
+
+/* Encode with a compressor set up for this image only */
+int jpgutl_put_yuv420p(u_char *dest_image, int image_size,
+        u_char *input_image, int width, int height, int quality,
+        cls_camera *cam, timespec *ts1, ctx_coord *box)
+{
+    cls_jpgenc jpgenc(cam);
+
+    return jpgenc.put_yuv420p(dest_image, image_size, input_image
+        , width, height, quality, ts1, box);
+}
+
+int jpgutl_put_grey(u_char *dest_image, int image_size,
+        u_char *input_image, int width, int height, int quality,
+        cls_camera *cam, timespec *ts1, ctx_coord *box)
+{
+    cls_jpgenc jpgenc(cam);
+
+    return jpgenc.put_grey(dest_image, image_size, input_image
+        , width, height, quality, ts1, box);
+}
@@ -32,4 +32,38 @@
     uint jpgutl_exif(u_char **exif, cls_camera *cam
         , timespec *ts_in1, ctx_coord *box);
 
+    struct jpeg_compress_struct;
+    struct ctx_jpgenc;
+
+    /*
+     * Encoder kept by a caller between images.  The compress objects and
+     * their tables are only set up again when the size or quality changes
+     * and the exif marker is built once with just its times updated for
+     * each image.  Not thread safe; each thread needs its own.
+     */
+    class cls_jpgenc {
+        public:
+            cls_jpgenc(cls_camera *p_cam);
+            ~cls_jpgenc();
+            int put_yuv420p(u_char *dest_image, int image_size,
+                u_char *input_image, int width, int height, int quality,
+                timespec *ts1, ctx_coord *box);
+            int put_grey(u_char *dest_image, int image_size,
+                u_char *input_image, int width, int height, int quality,
+                timespec *ts1, ctx_coord *box);
+
+        private:
+            cls_camera  *cam;       /* Null for no exif */
+            ctx_jpgenc  *yuv;
+            ctx_jpgenc  *grey;
+            u_char      *exif;
+            uint        exif_len;
+            uint        exif_dt_pos[2];
+            uint        exif_tz_pos;
+            std::string exif_desc;  /* picture_exif the marker was built with */
+
+            void put_exif(struct jpeg_compress_struct *cinfo
+                , timespec *ts1, ctx_coord *box);
+    };
+
 #endif /*  _INCLUDE_JPEGUTILS_HPP_ */
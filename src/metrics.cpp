@@ -0,0 +1,458 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "motion.hpp"
+#include "util.hpp"
+#include "camera.hpp"
+#include "conf.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+
+static const char *metrics_stage_nm[METRICS_STAGE_CNT] = {
+    "prepare", "capture", "detection", "tuning", "overlay"
+    , "actions", "snapshot", "timelapse", "loopback"
+};
+
+static const char *metrics_count_nm[METRICS_COUNT_CNT] = {
+    "frames_captured", "frames_missed", "frames_motion"
+    , "events", "jpeg_encodes", "movie_frames", "frames_late"
+};
+
+static const char *metrics_count_help[METRICS_COUNT_CNT] = {
+    "Images received from the camera"
+    , "Capture attempts which returned no image"
+    , "Images with changes between threshold and threshold_maximum"
+    , "Events started"
+    , "Images encoded as jpeg"
+    , "Images passed to the movie encoders"
+    , "Passes of the camera loop which missed their scheduled time"
+};
+
+/* Names of the stages as given to cls_stage and as reported */
+static const char *metrics_out_stage[METRICS_OUT_CNT] = {
+    "side", "stream", "picture", "movie norm", "movie motion"
+    , "movie timelapse", "movie extpipe"
+};
+
+static const char *metrics_out_nm[METRICS_OUT_CNT] = {
+    "side", "stream", "picture", "movie_norm", "movie_motion"
+    , "movie_timelapse", "movie_extpipe"
+};
+
+/* Values reported for each output stage */
+#define METRICS_OUT_ITEMS   7
+
+static const char *metrics_out_item_nm[METRICS_OUT_ITEMS] = {
+    "motion_output_jobs_total", "motion_output_busy_seconds_total"
+    , "motion_output_stalls_total", "motion_output_stall_seconds_total"
+    , "motion_output_dropped_total", "motion_output_queue_depth"
+    , "motion_output_queue_depth_max"
+};
+
+static const char *metrics_out_item_help[METRICS_OUT_ITEMS] = {
+    "Jobs completed by the output stage"
+    , "Time the output stage spent running its jobs"
+    , "Frames which waited for room in the queue of the output stage"
+    , "Time the camera loop waited for room in the queue of the output stage"
+    , "Frames discarded since the queue of the output stage was full"
+    , "Jobs waiting in the queue of the output stage"
+    , "Most jobs waiting in the queue of the output stage"
+};
+
+static const char *metrics_out_item_type[METRICS_OUT_ITEMS] = {
+    "counter", "counter", "counter", "counter", "counter", "gauge", "gauge"
+};
+
+/* Powers of two microseconds used as the buckets of the metrics page */
+#define METRICS_LE_MIN  4
+#define METRICS_LE_MAX  23
+
+/* Upper bound (exclusive) in microseconds of the values in the bin */
+static int64_t metrics_bin_upper(int indx)
+{
+    int shift;
+
+    if (indx < METRICS_SUB) {
+        return indx + 1;
+    }
+    shift = (indx / METRICS_SUB) - 1;
+    return ((int64_t)(indx % METRICS_SUB) + METRICS_SUB + 1) << shift;
+}
+
+static int metrics_bin(int64_t val)
+{
+    int shift, indx;
+
+    if (val < METRICS_SUB) {
+        return (val < 0) ? 0 : (int)val;
+    }
+    shift = (63 - __builtin_clzll((unsigned long long)val)) - METRICS_SUB_BITS;
+    indx = (METRICS_SUB * shift) + (int)(val >> shift);
+    if (indx >= METRICS_BINS) {
+        indx = METRICS_BINS - 1;
+    }
+    return indx;
+}
+
+static std::string metrics_fmt(const char *fmt, double val)
+{
+    char buf[32];
+
+    snprintf(buf, sizeof(buf), fmt, val);
+    return std::string(buf);
+}
+
+/* Escape a label value of the metrics page */
+static std::string metrics_esc(std::string val)
+{
+    std::string retstr;
+    size_t indx;
+
+    for (indx = 0; indx < val.length(); indx++) {
+        if ((val[indx] == '\\') || (val[indx] == '"')) {
+            retstr += '\\';
+            retstr += val[indx];
+        } else if (val[indx] == '\n') {
+            retstr += "\\n";
+        } else {
+            retstr += val[indx];
+        }
+    }
+    return retstr;
+}
+
+void cls_metrics::hist_add(ctx_metrics_hist *hst, int64_t val)
+{
+    hst->bins[metrics_bin(val)].fetch_add(1, std::memory_order_relaxed);
+    hst->cnt.fetch_add(1, std::memory_order_relaxed);
+    hst->sum_us.fetch_add(val, std::memory_order_relaxed);
+    /* Only the camera thread adds values */
+    if (val > hst->max_us.load(std::memory_order_relaxed)) {
+        hst->max_us.store(val, std::memory_order_relaxed);
+    }
+}
+
+/* Percentile in microseconds.  Reported as the top of its bin */
+int64_t cls_metrics::hist_pct(ctx_metrics_hist *hst, int pct)
+{
+    int64_t cnt, target, cumul, mx;
+    int indx;
+
+    cnt = hst->cnt.load(std::memory_order_relaxed);
+    mx = hst->max_us.load(std::memory_order_relaxed);
+    if (cnt == 0) {
+        return 0;
+    }
+    target = ((cnt * pct) + 99) / 100;
+    cumul = 0;
+    for (indx = 0; indx < METRICS_BINS; indx++) {
+        cumul += hst->bins[indx].load(std::memory_order_relaxed);
+        if (cumul >= target) {
+            return std::min(metrics_bin_upper(indx) - 1, mx);
+        }
+    }
+    return mx;
+}
+
+/* Mark the start of the loop */
+void cls_metrics::start()
+{
+    clock_gettime(CLOCK_MONOTONIC, &mark_ts);
+}
+
+/* Record the time since the last mark against the stage */
+void cls_metrics::mark(METRICS_STAGE stage)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    hist_add(&hist[stage]
+        , ((int64_t)(ts.tv_sec - mark_ts.tv_sec) * 1000000L)
+            + ((ts.tv_nsec - mark_ts.tv_nsec) / 1000));
+    mark_ts = ts;
+}
+
+void cls_metrics::count(METRICS_COUNT item)
+{
+    counts[item].fetch_add(1, std::memory_order_relaxed);
+}
+
+/* Index of the output stage with the name or -1 */
+int cls_metrics::out_index(std::string name)
+{
+    int indx;
+
+    for (indx = 0; indx < METRICS_OUT_CNT; indx++) {
+        if (name == metrics_out_stage[indx]) {
+            return indx;
+        }
+    }
+    return -1;
+}
+
+void cls_metrics::out_job(int out, int64_t ns)
+{
+    if (out < 0) {
+        return;
+    }
+    outs[out].jobs.fetch_add(1, std::memory_order_relaxed);
+    outs[out].busy_us.fetch_add(ns / 1000, std::memory_order_relaxed);
+}
+
+void cls_metrics::out_stall(int out, int64_t ns)
+{
+    if (out < 0) {
+        return;
+    }
+    outs[out].stall_cnt.fetch_add(1, std::memory_order_relaxed);
+    outs[out].stall_us.fetch_add(ns / 1000, std::memory_order_relaxed);
+}
+
+void cls_metrics::out_drop(int out)
+{
+    if (out < 0) {
+        return;
+    }
+    outs[out].drop_cnt.fetch_add(1, std::memory_order_relaxed);
+}
+
+/* Called with the stage mutex held so only one thread stores at a time */
+void cls_metrics::out_depth(int out, int depth)
+{
+    if (out < 0) {
+        return;
+    }
+    outs[out].depth.store(depth, std::memory_order_relaxed);
+    if (depth > outs[out].depth_max.load(std::memory_order_relaxed)) {
+        outs[out].depth_max.store(depth, std::memory_order_relaxed);
+    }
+}
+
+std::string cls_metrics::labels()
+{
+    return "camera=\"" + std::to_string(cam->cfg->device_id) + "\""
+        ",name=\"" + metrics_esc(cam->cfg->device_name) + "\"";
+}
+
+/* Add the counters and stage times as a json object */
+void cls_metrics::json(std::string &page)
+{
+    int indx;
+    int64_t cnt;
+    ctx_metrics_hist *hst;
+    ctx_metrics_out *out;
+
+    page += "{";
+    for (indx = 0; indx < METRICS_COUNT_CNT; indx++) {
+        if (indx > 0) {
+            page += ",";
+        }
+        page += "\"" + std::string(metrics_count_nm[indx]) + "\":" +
+            std::to_string(counts[indx].load(std::memory_order_relaxed));
+    }
+
+    page += ",\"stages\":{";
+    for (indx = 0; indx < METRICS_STAGE_CNT; indx++) {
+        hst = &hist[indx];
+        cnt = hst->cnt.load(std::memory_order_relaxed);
+        if (indx > 0) {
+            page += ",";
+        }
+        page += "\"" + std::string(metrics_stage_nm[indx]) + "\":{";
+        page += "\"count\":" + std::to_string(cnt);
+        if (cnt > 0) {
+            page += ",\"mean_ms\":" + metrics_fmt("%.3f"
+                , (double)hst->sum_us.load(std::memory_order_relaxed)
+                    / (double)cnt / 1000.0);
+        } else {
+            page += ",\"mean_ms\":0";
+        }
+        page += ",\"p50_ms\":" + metrics_fmt("%.3f", (double)hist_pct(hst, 50) / 1000.0);
+        page += ",\"p90_ms\":" + metrics_fmt("%.3f", (double)hist_pct(hst, 90) / 1000.0);
+        page += ",\"p99_ms\":" + metrics_fmt("%.3f", (double)hist_pct(hst, 99) / 1000.0);
+        page += ",\"max_ms\":" + metrics_fmt("%.3f"
+            , (double)hst->max_us.load(std::memory_order_relaxed) / 1000.0);
+        page += "}";
+    }
+    page += "}";
+
+    page += ",\"outputs\":{";
+    for (indx = 0; indx < METRICS_OUT_CNT; indx++) {
+        out = &outs[indx];
+        if (indx > 0) {
+            page += ",";
+        }
+        page += "\"" + std::string(metrics_out_nm[indx]) + "\":{";
+        page += "\"jobs\":" + std::to_string(out->jobs.load(std::memory_order_relaxed));
+        page += ",\"busy_ms\":" + metrics_fmt("%.3f"
+            , (double)out->busy_us.load(std::memory_order_relaxed) / 1000.0);
+        page += ",\"stalls\":" +
+            std::to_string(out->stall_cnt.load(std::memory_order_relaxed));
+        page += ",\"stall_ms\":" + metrics_fmt("%.3f"
+            , (double)out->stall_us.load(std::memory_order_relaxed) / 1000.0);
+        page += ",\"dropped\":" +
+            std::to_string(out->drop_cnt.load(std::memory_order_relaxed));
+        page += ",\"depth\":" +
+            std::to_string(out->depth.load(std::memory_order_relaxed));
+        page += ",\"depth_max\":" +
+            std::to_string(out->depth_max.load(std::memory_order_relaxed));
+        page += "}";
+    }
+    page += "}";
+
+    page += "}";
+}
+
+void cls_metrics::prom_count(std::string &page, int item)
+{
+    page += "motion_" + std::string(metrics_count_nm[item]) +
+        "_total{" + labels() + "} " +
+        std::to_string(counts[item].load(std::memory_order_relaxed)) + "\n";
+}
+
+void cls_metrics::prom_hist(std::string &page, int stage)
+{
+    int indx, expn;
+    int64_t cumul, le;
+    ctx_metrics_hist *hst;
+    std::string lbl;
+
+    hst = &hist[stage];
+    lbl = labels() + ",stage=\"" + metrics_stage_nm[stage] + "\"";
+
+    cumul = 0;
+    indx = 0;
+    for (expn = METRICS_LE_MIN; expn <= METRICS_LE_MAX; expn++) {
+        le = (int64_t)1 << expn;
+        while ((indx < METRICS_BINS) && (metrics_bin_upper(indx) <= le)) {
+            cumul += hst->bins[indx].load(std::memory_order_relaxed);
+            indx++;
+        }
+        page += "motion_stage_duration_seconds_bucket{" + lbl +
+            ",le=\"" + metrics_fmt("%.6f", (double)le / 1000000.0) + "\"} " +
+            std::to_string(cumul) + "\n";
+    }
+    while (indx < METRICS_BINS) {
+        cumul += hst->bins[indx].load(std::memory_order_relaxed);
+        indx++;
+    }
+    page += "motion_stage_duration_seconds_bucket{" + lbl +
+        ",le=\"+Inf\"} " + std::to_string(cumul) + "\n";
+    page += "motion_stage_duration_seconds_sum{" + lbl + "} " +
+        metrics_fmt("%.6f", (double)hst->sum_us.load(std::memory_order_relaxed)
+            / 1000000.0) + "\n";
+    page += "motion_stage_duration_seconds_count{" + lbl + "} " +
+        std::to_string(cumul) + "\n";
+}
+
+void cls_metrics::prom_out(std::string &page, int item)
+{
+    int indx;
+    ctx_metrics_out *out;
+    std::string val;
+
+    for (indx = 0; indx < METRICS_OUT_CNT; indx++) {
+        out = &outs[indx];
+        if (item == 0) {
+            val = std::to_string(out->jobs.load(std::memory_order_relaxed));
+        } else if (item == 1) {
+            val = metrics_fmt("%.6f"
+                , (double)out->busy_us.load(std::memory_order_relaxed) / 1000000.0);
+        } else if (item == 2) {
+            val = std::to_string(out->stall_cnt.load(std::memory_order_relaxed));
+        } else if (item == 3) {
+            val = metrics_fmt("%.6f"
+                , (double)out->stall_us.load(std::memory_order_relaxed) / 1000000.0);
+        } else if (item == 4) {
+            val = std::to_string(out->drop_cnt.load(std::memory_order_relaxed));
+        } else if (item == 5) {
+            val = std::to_string(out->depth.load(std::memory_order_relaxed));
+        } else {
+            val = std::to_string(out->depth_max.load(std::memory_order_relaxed));
+        }
+        page += std::string(metrics_out_item_nm[item]) + "{" + labels() +
+            ",output=\"" + metrics_out_nm[indx] + "\"} " + val + "\n";
+    }
+}
+
+/* Build the metrics page in the Prometheus text format */
+void metrics_prom(cls_motapp *app, int st, int en, std::string &page)
+{
+    int indx, indx_cam;
+    std::string nm;
+
+    for (indx = 0; indx < METRICS_COUNT_CNT; indx++) {
+        nm = "motion_" + std::string(metrics_count_nm[indx]) + "_total";
+        page += "# HELP " + nm + " " + metrics_count_help[indx] + "\n";
+        page += "# TYPE " + nm + " counter\n";
+        for (indx_cam = st; indx_cam < en; indx_cam++) {
+            app->cam_list[indx_cam]->metrics->prom_count(page, indx);
+        }
+    }
+
+    nm = "motion_stage_duration_seconds";
+    page += "# HELP " + nm + " Time spent in each step of the camera loop\n";
+    page += "# TYPE " + nm + " histogram\n";
+    for (indx_cam = st; indx_cam < en; indx_cam++) {
+        for (indx = 0; indx < METRICS_STAGE_CNT; indx++) {
+            app->cam_list[indx_cam]->metrics->prom_hist(page, indx);
+        }
+    }
+
+    for (indx = 0; indx < METRICS_OUT_ITEMS; indx++) {
+        nm = metrics_out_item_nm[indx];
+        page += "# HELP " + nm + " " + metrics_out_item_help[indx] + "\n";
+        page += "# TYPE " + nm + " " + metrics_out_item_type[indx] + "\n";
+        for (indx_cam = st; indx_cam < en; indx_cam++) {
+            app->cam_list[indx_cam]->metrics->prom_out(page, indx);
+        }
+    }
+}
+
+cls_metrics::cls_metrics(cls_camera *p_cam)
+{
+    int indx, bin;
+
+    cam = p_cam;
+    for (indx = 0; indx < METRICS_STAGE_CNT; indx++) {
+        for (bin = 0; bin < METRICS_BINS; bin++) {
+            hist[indx].bins[bin] = 0;
+        }
+        hist[indx].cnt = 0;
+        hist[indx].sum_us = 0;
+        hist[indx].max_us = 0;
+    }
+    for (indx = 0; indx < METRICS_COUNT_CNT; indx++) {
+        counts[indx] = 0;
+    }
+    for (indx = 0; indx < METRICS_OUT_CNT; indx++) {
+        outs[indx].jobs = 0;
+        outs[indx].busy_us = 0;
+        outs[indx].stall_cnt = 0;
+        outs[indx].stall_us = 0;
+        outs[indx].drop_cnt = 0;
+        outs[indx].depth = 0;
+        outs[indx].depth_max = 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &mark_ts);
+}
+
+cls_metrics::~cls_metrics()
+{
+    cam = nullptr;
+}
@@ -0,0 +1,125 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * metrics.hpp - Camera loop timing and counters
+ *
+ * The camera thread records how long each step of its loop takes into a
+ * log linear histogram (four bins for each power of two microseconds) and
+ * counts the frames, events and encodes.  The output stages add their
+ * jobs, stalls and drops here as well since the stages themselves go away
+ * when the camera restarts.  Recording is a clock read and a few relaxed
+ * atomic adds.  The text is only built when the metrics page or the
+ * status is requested.
+ */
+
+#ifndef _INCLUDE_METRICS_HPP_
+#define _INCLUDE_METRICS_HPP_
+
+    #include <atomic>
+
+    #define METRICS_SUB_BITS    2
+    #define METRICS_SUB         (1 << METRICS_SUB_BITS)
+    #define METRICS_BINS        112     /* Up to about 9 minutes */
+
+    enum METRICS_STAGE {
+        METRICS_PREPARE,
+        METRICS_CAPTURE,
+        METRICS_DETECTION,
+        METRICS_TUNING,
+        METRICS_OVERLAY,
+        METRICS_ACTIONS,
+        METRICS_SNAPSHOT,
+        METRICS_TIMELAPSE,
+        METRICS_LOOPBACK,
+        METRICS_STAGE_CNT
+    };
+
+    enum METRICS_COUNT {
+        METRICS_FRAMES,
+        METRICS_MISSED,
+        METRICS_MOTION,
+        METRICS_EVENTS,
+        METRICS_JPEG,
+        METRICS_MOVIE,
+        METRICS_LATE,
+        METRICS_COUNT_CNT
+    };
+
+    /* Output stages by the name given to cls_stage */
+    enum METRICS_OUT {
+        METRICS_OUT_SIDE,
+        METRICS_OUT_STREAM,
+        METRICS_OUT_PICTURE,
+        METRICS_OUT_MOVIE_NORM,
+        METRICS_OUT_MOVIE_MOTION,
+        METRICS_OUT_MOVIE_TIMELAPSE,
+        METRICS_OUT_MOVIE_EXTPIPE,
+        METRICS_OUT_CNT
+    };
+
+    struct ctx_metrics_out {
+        std::atomic<int64_t>    jobs;
+        std::atomic<int64_t>    busy_us;
+        std::atomic<int64_t>    stall_cnt;
+        std::atomic<int64_t>    stall_us;
+        std::atomic<int64_t>    drop_cnt;
+        std::atomic<int>        depth;
+        std::atomic<int>        depth_max;
+    };
+
+    /* Durations in microseconds */
+    struct ctx_metrics_hist {
+        std::atomic<int64_t>    bins[METRICS_BINS];
+        std::atomic<int64_t>    cnt;
+        std::atomic<int64_t>    sum_us;
+        std::atomic<int64_t>    max_us;
+    };
+
+    class cls_metrics {
+        public:
+            cls_metrics(cls_camera *p_cam);
+            ~cls_metrics();
+            void start();
+            void mark(METRICS_STAGE stage);
+            void count(METRICS_COUNT item);
+            int out_index(std::string name);
+            void out_job(int out, int64_t ns);
+            void out_stall(int out, int64_t ns);
+            void out_drop(int out);
+            void out_depth(int out, int depth);
+            void json(std::string &page);
+            void prom_count(std::string &page, int item);
+            void prom_hist(std::string &page, int stage);
+            void prom_out(std::string &page, int item);
+
+        private:
+            cls_camera          *cam;
+            struct timespec     mark_ts;
+            ctx_metrics_hist    hist[METRICS_STAGE_CNT];
+            std::atomic<int64_t> counts[METRICS_COUNT_CNT];
+            ctx_metrics_out     outs[METRICS_OUT_CNT];
+
+            void hist_add(ctx_metrics_hist *hst, int64_t val);
+            int64_t hist_pct(ctx_metrics_hist *hst, int pct);
+            std::string labels();
+    };
+
+    void metrics_prom(cls_motapp *app, int st, int en, std::string &page);
+
+#endif /* _INCLUDE_METRICS_HPP_ */
@@ -33,6 +33,8 @@
 
 volatile enum MOTION_SIGNAL motsignal;
 
+#ifndef MOTION_TOOL
+
 /** Handle signals sent */
 static void sig_handler(int signo)
 {
@@ -110,6 +112,8 @@ static void setup_signals(void)
     sigaction(SIGVTALRM, &sig_handler_action, NULL);
 }
 
+#endif /* MOTION_TOOL */
+
 void cls_motapp::signal_process()
 {
     int indx;
@@ -647,6 +651,8 @@ void cls_motapp::camera_delete()
 
 }
 
+#ifndef MOTION_TOOL
+
 /** Main entry point of Motion. */
 int main (int p_argc, char **p_argv)
 {
@@ -689,6 +695,8 @@ int main (int p_argc, char **p_argv)
     return 0;
 }
 
+#endif /* MOTION_TOOL */
+
 cls_motapp::cls_motapp()
 {
 
@@ -56,6 +56,7 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <thread>
+#include <atomic>
 #include "zlib.h"
 
 #if defined(HAVE_PTHREAD_NP_H)
@@ -103,7 +104,14 @@ class cls_log;
 class cls_movie;
 class cls_netcam;
 class cls_picture;
+class cls_replay;
+class cls_bench;
 class cls_rotate;
+class cls_stage;
+class cls_framepool;
+class cls_metrics;
+class cls_pacer;
+class cls_jpgenc;
 class cls_v4l2cam;
 class cls_convert;
 class cls_libcam;
@@ -114,10 +122,13 @@ class cls_webu_html;
 class cls_webu_json;
 class cls_webu_text;
 class cls_webu_mpegts;
+class cls_webu_tsenc;
 class cls_webu_post;
 class cls_webu_common;
 class cls_webu_stream;
 
+struct ctx_stage_pic;
+
 enum MOTION_SIGNAL {
     MOTION_SIGNAL_NONE,
     MOTION_SIGNAL_ALARM,
@@ -156,18 +167,36 @@ struct ctx_all_sizes {
     bool    reset;
 };
 
+#define STREAM_JPG_HDR  80  /* Room for the multipart header in front of the jpg */
+
+/*
+ * Encoded image shared by the stream connections.  It is not changed once
+ * published.  Each connection sending it holds a reference and the buffer
+ * goes back to the pool with the last one.
+ */
+struct ctx_stream_jpg {
+    std::atomic<int>    refcnt;
+    cls_framepool       *pool;
+    u_char              *buf;       /* Multipart header, jpg and CRLF */
+    int                 jpg_sz;     /* The jpg starts at STREAM_JPG_HDR */
+    int                 part_off;   /* Start of the multipart header */
+    int                 part_sz;    /* Header, jpg and CRLF */
+};
+
 struct ctx_stream_data {
-    u_char  *jpg_data;  /* Image compressed as JPG */
-    int     jpg_sz;     /* The number of bytes for jpg */
+    ctx_stream_jpg  *jpg;   /* Latest image compressed as JPG */
+    int64_t gen;        /* Count of the jpg images published */
     int     consumed;   /* Bool for whether the jpeg data was consumed*/
     u_char  *img_data;  /* The base data used for image */
     int     jpg_cnct;   /* Counter of the number of jpg connections*/
     int     ts_cnct;    /* Counter of the number of mpegts connections */
     int     all_cnct;   /* Counter of the number of all camera connections */
+    cls_webu_tsenc  *tsenc; /* Transport stream encoder shared by the ts connections */
 };
 
 struct ctx_stream {
     pthread_mutex_t  mutex;
+    pthread_cond_t   cond;       /* Signalled when an image is published */
     ctx_stream_data  norm;       /* Copy of the image to use for web stream*/
     ctx_stream_data  sub;        /* Copy of the image to use for web stream*/
     ctx_stream_data  motion;     /* Copy of the image to use for web stream*/
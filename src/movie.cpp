@@ -25,6 +25,8 @@
 #include "dbse.hpp"
 #include "alg_sec.hpp"
 #include "movie.hpp"
+#include "stage.hpp"
+#include "metrics.hpp"
 
 int movie_interrupt(void *ctx)
 {
@@ -233,7 +235,7 @@ int cls_movie::set_pts(const struct timespec *ts1)
         pts_interval = ((1000000L * (ts1->tv_sec - start_time.tv_sec)) + (ts1->tv_nsec/1000) - (start_time.tv_nsec/1000));
         if (pts_interval < 0) {
             /* This can occur when we have pre-capture frames.  Reset start time of video. */
-            reset_start_time(ts1);
+            reset_pts(ts1);
             pts_interval = 0;
         }
         if (last_pts < 0) {
@@ -269,6 +271,7 @@ int cls_movie::set_quality()
     int quality;
 
     opts = 0;
+    crf_base = -1;
     quality = cam->cfg->movie_quality;
     if (quality > 100) {
         quality = 100;
@@ -303,6 +306,8 @@ int cls_movie::set_quality()
             char crf[10];
             quality = (int)(( (100-quality) * 51)/100);
             snprintf(crf, 10, "%d", quality);
+            crf_base = quality;
+            crf_curr = quality;
             if (ctx_codec->codec_id == AV_CODEC_ID_H264) {
                 av_opt_set(ctx_codec->priv_data, "profile", "high", 0);
             }
@@ -1226,6 +1231,14 @@ void cls_movie::stop()
         return;
     }
 
+    /* Finish the images queued for the movie before closing it */
+    stage->drain();
+    if (quality_cnt > 0) {
+        MOTION_LOG(INF, TYPE_ENCODER, NO_ERRNO
+            , _("%lld images encoded with a lowered quality")
+            , (long long)quality_cnt);
+    }
+
     clock_gettime(CLOCK_MONOTONIC, &cb_st_ts);
 
     if (movie_type == "extpipe") {
@@ -1288,14 +1301,14 @@ void cls_movie::stop()
 
 }
 
-int cls_movie::extpipe_put()
+int cls_movie::extpipe_put(ctx_image_data *img_data)
 {
     int retcd;
 
     retcd = 0;
     if (fileno(extpipe_stream) > 0) {
         if ((cam->imgs.size_high > 0) && (cam->movie_passthrough == false)) {
-            if (!fwrite(cam->current_image->image_high
+            if (!fwrite(img_data->image_high
                     , (uint)cam->imgs.size_high, 1, extpipe_stream)) {
                 MOTION_LOG(ERR, TYPE_EVENTS, SHOW_ERRNO
                     , _("Error writing in pipe , state error %d")
@@ -1303,7 +1316,7 @@ int cls_movie::extpipe_put()
                 retcd = -1;
             }
         } else {
-            if (!fwrite(cam->current_image->image_norm
+            if (!fwrite(img_data->image_norm
                     , (uint)cam->imgs.size_norm, 1, extpipe_stream)) {
                 MOTION_LOG(ERR, TYPE_EVENTS, SHOW_ERRNO
                   ,_("Error writing in pipe , state error %d")
@@ -1324,10 +1337,11 @@ int cls_movie::put_image(ctx_image_data *img_data, const struct timespec *ts1)
         return 0;
     }
 
+    cam->metrics->count(METRICS_MOVIE);
     clock_gettime(CLOCK_MONOTONIC, &cb_st_ts);
 
     if (movie_type == "extpipe") {
-        extpipe_put();
+        extpipe_put(img_data);
         return 0;
     }
 
@@ -1337,6 +1351,9 @@ int cls_movie::put_image(ctx_image_data *img_data, const struct timespec *ts1)
     }
 
     if (picture) {
+        if (queue_policy == "quality") {
+            quality_adjust();
+        }
         put_pix_yuv420(img_data);
 
         gop_cnt ++;
@@ -1374,9 +1391,44 @@ int cls_movie::put_image(ctx_image_data *img_data, const struct timespec *ts1)
     return retcd;
 }
 
-void cls_movie::reset_start_time(const struct timespec *ts1)
+/*
+ * Raise the CRF while the queue of the encoder is nearly full and
+ * step it back once the queue has emptied.  Only libx264 applies a
+ * crf option changed after the encoder was opened, on the next frame.
+ * start() uses the drop policy for the other encoders.
+ */
+void cls_movie::quality_adjust()
 {
-    int64_t one_frame_interval = av_rescale_q(1,av_make_q(1, fps), strm_video->time_base);
+    int depth, crf_new;
+    char crf[10];
+
+    if (crf_base < 0) {
+        return;
+    }
+
+    depth = stage->pending();
+    crf_new = crf_curr;
+    if (depth >= (stage->size - 1)) {
+        crf_new = MIN(crf_curr + 3, MIN(crf_base + 12, 51));
+    } else if ((depth == 0) && (crf_curr > crf_base)) {
+        crf_new = crf_curr - 1;
+    }
+    if (crf_new != crf_curr) {
+        crf_curr = crf_new;
+        snprintf(crf, 10, "%d", crf_curr);
+        av_opt_set(ctx_codec->priv_data, "crf", crf, 0);
+    }
+    if (crf_curr > crf_base) {
+        quality_cnt++;
+    }
+}
+
+/* Encoder thread part of the reset of the start time */
+void cls_movie::reset_pts(const struct timespec *ts1)
+{
+    int64_t one_frame_interval;
+
+    one_frame_interval = av_rescale_q(1,av_make_q(1, fps), strm_video->time_base);
     if (one_frame_interval <= 0) {
         one_frame_interval = 1;
     }
@@ -1387,6 +1439,13 @@ void cls_movie::reset_start_time(const struct timespec *ts1)
 
 }
 
+void cls_movie::reset_start_time(const struct timespec *ts1)
+{
+    /* The encoder thread uses the times so let it finish first */
+    stage->drain();
+    reset_pts(ts1);
+}
+
 void cls_movie::init_container()
 {
     int codenbr;
@@ -1656,6 +1715,9 @@ void cls_movie::start()
         return;
     }
 
+    queue_policy = cam->cfg->movie_queue_policy;
+    quality_cnt = 0;
+
     if (movie_type == "norm") {
         start_norm();
     } else if (movie_type == "motion") {
@@ -1667,6 +1729,22 @@ void cls_movie::start()
     } else {
         MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO,_("Invalid movie type"));
     }
+
+    if ((queue_policy == "quality") &&
+        ((crf_base < 0) || (ctx_codec == nullptr) ||
+         (ctx_codec->codec == nullptr) ||
+         (strcmp(ctx_codec->codec->name, "libx264") != 0))) {
+        MOTION_LOG(NTC, TYPE_ENCODER, NO_ERRNO
+            ,_("The quality queue policy needs libx264.  Using block"));
+        queue_policy = "block";
+    }
+
+    /* Timelapse images are rare and each one is kept */
+    if ((queue_policy == "drop") && (tlapse == TIMELAPSE_NONE)) {
+        stage->drop_full = true;
+    } else {
+        stage->drop_full = false;
+    }
 }
 
 void cls_movie::init_vars()
@@ -1703,6 +1781,10 @@ void cls_movie::init_vars()
     high_resolution = false;
     motion_images = false;
     passthrough = false;
+    queue_policy = "block";
+    crf_base = -1;
+    crf_curr = -1;
+    quality_cnt = 0;
 
     nal_info = nullptr;
     nal_info_len = 0;
@@ -1721,10 +1803,14 @@ cls_movie::cls_movie(cls_camera *p_cam, std::string pmovie_type)
     movie_type = pmovie_type;
 
     init_vars();
+
+    /* Thread names are mn, mm, mt and me */
+    stage = new cls_stage(cam, "movie " + movie_type
+        , "m" + movie_type.substr(0, 1), 1, STAGE_DEPTH);
 }
 
 cls_movie::~cls_movie()
 {
-
+    mydelete(stage);
 }
 
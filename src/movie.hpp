@@ -43,6 +43,7 @@ class cls_movie {
         std::string         file_nm;
         std::string         file_dir;
         bool                is_running;
+        cls_stage           *stage;         /* Encoder thread and its queue */
 
     private:
         cls_camera *cam;
@@ -56,7 +57,9 @@ class cls_movie {
         void free_context();
         int get_oformat();
         int set_pts(const struct timespec *ts1);
+        void reset_pts(const struct timespec *ts1);
         int set_quality();
+        void quality_adjust();
         int set_codec_preferred();
         int set_codec();
         int set_stream();
@@ -85,7 +88,7 @@ class cls_movie {
         void start_motion();
         void start_timelapse();
         void start_extpipe();
-        int extpipe_put();
+        int extpipe_put(ctx_image_data *img_data);
         void on_movie_start();
         void on_movie_end();
 
@@ -112,6 +115,10 @@ class cls_movie {
         bool                high_resolution;
         bool                motion_images;
         bool                passthrough;
+        std::string         queue_policy;
+        int                 crf_base;       /* CRF from movie_quality or -1 when not used */
+        int                 crf_curr;
+        int64_t             quality_cnt;    /* Frames encoded with a lowered quality */
 
         char                *nal_info;
         int                 nal_info_len;
@@ -0,0 +1,114 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "motion.hpp"
+#include "util.hpp"
+#include "logger.hpp"
+#include "pacer.hpp"
+
+static int64_t pacer_ns(struct timespec *ts1, struct timespec *ts2)
+{
+    return ((int64_t)(ts2->tv_sec - ts1->tv_sec) * 1000000000L)
+        + (ts2->tv_nsec - ts1->tv_nsec);
+}
+
+void cls_pacer::ts_add(struct timespec *ts, int64_t nsec)
+{
+    nsec += ts->tv_nsec;
+    ts->tv_sec += (time_t)(nsec / 1000000000L);
+    ts->tv_nsec = (long)(nsec % 1000000000L);
+}
+
+/* Start a new cadence from now */
+void cls_pacer::reset()
+{
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    win_ts = deadline;
+    win_cnt = 0;
+}
+
+/*
+ * Sleep until the next deadline for the rate.  Returns true when the
+ * pass was already past its deadline.
+ */
+bool cls_pacer::wait(int p_fps)
+{
+    struct timespec now;
+    int64_t late, elapsed;
+    bool retcd;
+    int rc;
+
+    if (p_fps < 1) {
+        p_fps = 1;
+    }
+    if (p_fps != rate) {
+        rate = p_fps;
+        period = 1000000000L / rate;
+        reset();
+    }
+
+    ts_add(&deadline, period);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    late = pacer_ns(&deadline, &now);
+
+    retcd = false;
+    if (late > 0) {
+        missed.fetch_add(1, std::memory_order_relaxed);
+        retcd = true;
+        /* Burst only while less than a second behind */
+        if ((burst == false) || (late >= 1000000000L)) {
+            skipped.fetch_add(late / period, std::memory_order_relaxed);
+            deadline = now;
+        }
+    } else {
+        do {
+            rc = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        } while (rc == EINTR);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    }
+
+    passes.fetch_add(1, std::memory_order_relaxed);
+    win_cnt++;
+    elapsed = pacer_ns(&win_ts, &now);
+    if (elapsed >= 1000000000L) {
+        fps.store(((double)win_cnt * 1000000000.0) / (double)elapsed
+            , std::memory_order_relaxed);
+        win_cnt = 0;
+        win_ts = now;
+    }
+
+    return retcd;
+}
+
+cls_pacer::cls_pacer()
+{
+    burst = false;
+    passes = 0;
+    missed = 0;
+    skipped = 0;
+    fps = 0;
+    rate = 0;
+    period = 1000000000L;
+    win_cnt = 0;
+    reset();
+}
+
+cls_pacer::~cls_pacer()
+{
+
+}
@@ -0,0 +1,61 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * pacer.hpp - Fixed rate loop timing
+ *
+ * The pacer sleeps until the next deadline of a fixed cadence using an
+ * absolute wake up time so the time taken by the loop and the sleep
+ * itself do not add up over time.  When the loop runs past a deadline
+ * the pacer either skips the lost time and starts the cadence again from
+ * now, or with burst on it runs the following passes without sleeping
+ * until the loop is back on the cadence.  A rate change starts a new
+ * cadence.
+ */
+
+#ifndef _INCLUDE_PACER_HPP_
+#define _INCLUDE_PACER_HPP_
+
+    #include <atomic>
+
+    class cls_pacer {
+        public:
+            cls_pacer();
+            ~cls_pacer();
+            void reset();
+            bool wait(int fps);
+
+            bool    burst;          /* Catch up on late passes */
+
+            /* Written by the paced thread and read by the web pages */
+            std::atomic<int64_t>    passes;
+            std::atomic<int64_t>    missed;     /* Passes which were past their deadline */
+            std::atomic<int64_t>    skipped;    /* Whole periods given up by skip */
+            std::atomic<double>     fps;        /* Rate achieved over the last second */
+
+        private:
+            int             rate;
+            int64_t         period;     /* Nanoseconds */
+            struct timespec deadline;
+            struct timespec win_ts;
+            int             win_cnt;
+
+            void ts_add(struct timespec *ts, int64_t nsec);
+    };
+
+#endif /* _INCLUDE_PACER_HPP_ */
@@ -162,8 +162,10 @@ struct ctx_parm_cam {
     int             width;
     int             height;
     int             framerate;
+    std::string     framerate_catchup;
     int             rotate;
     std::string     flip_axis;
+    bool            image_hugepages;
 
     /* Overlay parameters (PARM_CAT_04) */
     std::string     locate_motion_mode;
@@ -186,6 +188,8 @@ struct ctx_parm_cam {
     bool            threshold_tune;
     std::string     secondary_method;
     std::string     secondary_params;
+    std::string     detect_params;
+    int             detection_scale;
 
     /* Mask parameters (PARM_CAT_06) */
     int             noise_level;
@@ -228,6 +232,8 @@ struct ctx_parm_cam {
     std::string     picture_filename;
     int             snapshot_interval;
     std::string     snapshot_filename;
+    int             picture_writers;
+    int             picture_queue;
 
     /* Movie output parameters (PARM_CAT_10) */
     bool            movie_output;
@@ -238,6 +244,7 @@ struct ctx_parm_cam {
     std::string     movie_encoder_preset;
     std::string     movie_container;
     bool            movie_passthrough;
+    std::string     movie_queue_policy;
     std::string     movie_filename;
     std::string     movie_retain;
     bool            movie_all_frames;
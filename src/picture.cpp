@@ -20,11 +20,12 @@
 #include "camera.hpp"
 #include "conf.hpp"
 #include "logger.hpp"
+#include "alg_simd.hpp"
 #include "picture.hpp"
 #include "jpegutils.hpp"
 #include "draw.hpp"
 #include "dbse.hpp"
-#include "picture.hpp"
+#include "stage.hpp"
 
 
 void cls_picture::picname(char* fullname, std::string fmtstr
@@ -57,6 +58,75 @@ void cls_picture::on_picture_save_command(char *fname)
     }
 }
 
+/*
+ * Queue the image for the picture writers.  The names, the command and
+ * the query are made here since they use the values of this image.
+ */
+void cls_picture::queue(ctx_image_data *img, u_char *image
+    , bool roi, bool replace, std::string link_nm)
+{
+    ctx_stage_pic pic;
+
+    pic.image = image;
+    pic.roi = roi;
+    pic.replace = replace;
+    pic.full_nm = full_nm;
+    pic.file_nm = file_nm;
+    pic.file_dir = file_dir;
+    pic.link_nm = link_nm;
+    pic.cmd = "";
+    if (cam->cfg->on_picture_save != "") {
+        mystrftime(cam, pic.cmd, cam->cfg->on_picture_save, full_nm);
+    }
+    pic.sql = "";
+    if (cam->app->cfg->database_type != "") {
+        mystrftime(cam, pic.sql, cam->cfg->sql_pic_save, full_nm);
+    }
+    pic.diff_tot = cam->info_diff_tot;
+    pic.diff_cnt = cam->info_diff_cnt;
+    pic.sdev_tot = cam->info_sdev_tot;
+    pic.sdev_min = cam->info_sdev_min;
+    pic.sdev_max = cam->info_sdev_max;
+
+    cam->stage_pic->push(img, &pic);
+}
+
+/* Save a queued picture.  This runs on a picture writer thread */
+void cls_picture::write(ctx_image_data *img, ctx_stage_pic *pic)
+{
+    if (pic->replace) {
+        remove(pic->full_nm.c_str());
+    }
+    if (pic->roi) {
+        save_roi(pic->full_nm.c_str(), pic->image, img);
+    } else {
+        save_norm(pic->full_nm.c_str(), pic->image, img);
+    }
+
+    MOTION_LOG(NTC, TYPE_EVENTS, NO_ERRNO
+        , _("File saved to: %s"), pic->full_nm.c_str());
+    if (pic->cmd != "") {
+        util_exec_stamp(pic->cmd);
+    }
+    if (pic->sql != "") {
+        MOTION_LOG(DBG, TYPE_DB, NO_ERRNO, "pic_save query: %s"
+            , pic->sql.c_str());
+        cam->app->dbse->exec_sql(pic->sql);
+    }
+    cam->app->dbse->filelist_add(cam->cfg->device_id, &img->imgts
+        ,"pic", pic->file_nm, pic->full_nm, pic->file_dir
+        , pic->diff_tot, pic->diff_cnt, pic->sdev_tot
+        , pic->sdev_min, pic->sdev_max);
+
+    if (pic->link_nm != "") {
+        remove(pic->link_nm.c_str());
+        if (symlink(pic->full_nm.c_str(), pic->link_nm.c_str())) {
+            MOTION_LOG(ERR, TYPE_EVENTS, SHOW_ERRNO
+                ,_("Could not create symbolic link [%s]"), pic->full_nm.c_str());
+        }
+    }
+}
+
 void cls_picture::process_norm()
 {
     char filename[PATH_MAX];
@@ -66,14 +136,12 @@ void cls_picture::process_norm()
             , cam->cfg->picture_filename
             , cam->cfg->picture_type);
         if ((cam->imgs.size_high > 0) && (cam->movie_passthrough == false)) {
-            save_norm(filename, cam->current_image->image_high);
+            queue(cam->current_image, cam->current_image->image_high
+                , false, false, "");
         } else {
-            save_norm(filename,cam->current_image->image_norm);
+            queue(cam->current_image, cam->current_image->image_norm
+                , false, false, "");
         }
-        on_picture_save_command(filename);
-        cam->app->dbse->exec(cam, filename, "pic_save");
-        cam->app->dbse->filelist_add(cam, &cam->current_image->imgts
-            ,"pic", file_nm, full_nm, file_dir);
     }
 }
 
@@ -82,21 +150,15 @@ void cls_picture::process_motion()
     char filename[PATH_MAX];
 
     if (cam->cfg->picture_output_motion == "on") {
+        /* The motion image was kept with the frame by ring_keep_images */
         picname(filename,"%s/%sm.%s", cam->cfg->picture_filename, cam->cfg->picture_type);
-        save_norm(filename, cam->imgs.image_motion.image_norm);
-        on_picture_save_command(filename);
-        cam->app->dbse->exec(cam, filename, "pic_save");
-        cam->app->dbse->filelist_add(cam, &cam->imgs.image_motion.imgts
-            ,"pic", file_nm, full_nm, file_dir);
-
+        queue(cam->current_image, cam->current_image->image_motion
+            , false, false, "");
 
     } else if (cam->cfg->picture_output_motion == "roi") {
         picname(filename,"%s/%sr.%s", cam->cfg->picture_filename, cam->cfg->picture_type);
-        save_roi(filename, cam->current_image->image_norm);
-        on_picture_save_command(filename);
-        cam->app->dbse->exec(cam, filename, "pic_save");
-        cam->app->dbse->filelist_add(cam, &cam->current_image->imgts
-            ,"pic", file_nm, full_nm, file_dir);
+        queue(cam->current_image, cam->current_image->image_norm
+            , true, false, "");
 
     }
 }
@@ -106,50 +168,32 @@ void cls_picture::process_snapshot()
     char filename[PATH_MAX];
     char linkpath[PATH_MAX];
     int offset;
+    u_char *image;
 
     offset = (int)cam->cfg->snapshot_filename.length() - 8;
     if (offset < 0) {
         offset = 1;
     }
 
+    if ((cam->imgs.size_high > 0) && (cam->movie_passthrough == false)) {
+        image = cam->current_image->image_high;
+    } else {
+        image = cam->current_image->image_norm;
+    }
+
     if (cam->cfg->snapshot_filename.compare((uint)offset, 8, "lastsnap") != 0) {
+        /* Name the symbolic link first since picname sets the file names */
+        picname(linkpath,"%s/%s.%s"
+            , "lastsnap", cam->cfg->picture_type);
         picname(filename,"%s/%s.%s"
             , cam->cfg->snapshot_filename
             , cam->cfg->picture_type);
-        if ((cam->imgs.size_high > 0) && (cam->movie_passthrough == false)) {
-            save_norm(filename, cam->current_image->image_high);
-        } else {
-            save_norm(filename, cam->current_image->image_norm);
-        }
-        on_picture_save_command(filename);
-        cam->app->dbse->exec(cam, filename, "pic_save");
-        cam->app->dbse->filelist_add(cam, &cam->current_image->imgts
-            ,"pic", file_nm, full_nm, file_dir);
-
-        /* Update symbolic link */
-        picname(linkpath,"%s/%s.%s"
-            , "lastsnap", cam->cfg->picture_type);
-        remove(linkpath);
-        if (symlink(filename, linkpath)) {
-            MOTION_LOG(ERR, TYPE_EVENTS, SHOW_ERRNO
-                ,_("Could not create symbolic link [%s]"), filename);
-            return;
-        }
-
+        queue(cam->current_image, image, false, false, linkpath);
     } else {
         picname(filename,"%s/%s.%s"
             , cam->cfg->snapshot_filename
             , cam->cfg->picture_type);
-        remove(filename);
-        if ((cam->imgs.size_high > 0) && (cam->movie_passthrough == false)) {
-            save_norm(filename, cam->current_image->image_high);
-        } else {
-            save_norm(filename, cam->current_image->image_norm);
-        }
-        on_picture_save_command(filename);
-        cam->app->dbse->exec(cam, filename, "pic_save");
-        cam->app->dbse->filelist_add(cam, &cam->current_image->imgts
-            ,"pic", file_nm, full_nm, file_dir);
+        queue(cam->current_image, image, false, true, "");
     }
 
     cam->action_snapshot = false;
@@ -172,9 +216,11 @@ void cls_picture::process_preview()
             , cam->cfg->picture_type);
 
         if ((cam->imgs.size_high > 0) && (cam->movie_passthrough == false)) {
-            save_norm(filename, cam->imgs.image_preview.image_high);
+            save_norm(filename, cam->imgs.image_preview.image_high
+                , &cam->imgs.image_preview);
         } else {
-            save_norm(filename, cam->imgs.image_preview.image_norm);
+            save_norm(filename, cam->imgs.image_preview.image_norm
+                , &cam->imgs.image_preview);
         }
         on_picture_save_command(filename);
         cam->app->dbse->exec(cam, filename, "pic_save");
@@ -298,18 +344,50 @@ void cls_picture::save_webp(FILE *fp, u_char *image, int width, int height
     #endif /* HAVE_WEBP */
 }
 
+/*
+ * Take an encoder for this thread.  The pictures are written on several
+ * threads and the stream images on another so each takes an idle one.
+ */
+cls_jpgenc *cls_picture::jpgenc_get()
+{
+    cls_jpgenc *jpgenc;
+
+    jpgenc = nullptr;
+    pthread_mutex_lock(&jpgenc_mutex);
+        if (jpgenc_free.empty() == false) {
+            jpgenc = jpgenc_free.back();
+            jpgenc_free.pop_back();
+        }
+    pthread_mutex_unlock(&jpgenc_mutex);
+
+    if (jpgenc == nullptr) {
+        jpgenc = new cls_jpgenc(cam);
+    }
+    return jpgenc;
+}
+
+void cls_picture::jpgenc_put(cls_jpgenc *jpgenc)
+{
+    pthread_mutex_lock(&jpgenc_mutex);
+        jpgenc_free.push_back(jpgenc);
+    pthread_mutex_unlock(&jpgenc_mutex);
+}
+
 /** Save image as yuv420p jpeg to file */
 void cls_picture::save_yuv420p(FILE *fp, u_char *image, int width, int height
         , timespec *ts1, ctx_coord *box)
 {
 
     int sz, image_size;
+    cls_jpgenc *jpgenc;
 
     image_size = (width * height * 3)/2;
     u_char *buf =(u_char*) mymalloc((uint)image_size);
 
-    sz = jpgutl_put_yuv420p(buf, image_size, image, width, height
-        , cam->cfg->picture_quality, cam ,ts1, box);
+    jpgenc = jpgenc_get();
+    sz = jpgenc->put_yuv420p(buf, image_size, image, width, height
+        , cam->cfg->picture_quality, ts1, box);
+    jpgenc_put(jpgenc);
     fwrite(buf, (uint)sz, 1, fp);
 
     free(buf);
@@ -321,13 +399,16 @@ void cls_picture::save_grey(FILE *picture, u_char *image, int width, int height
         , timespec *ts1, ctx_coord *box)
 {
     int sz, image_size;
+    cls_jpgenc *jpgenc;
 
     image_size = (width * height * 3)/2;
 
     u_char *buf =(u_char*) mymalloc((uint)image_size);
 
-    sz = jpgutl_put_grey(buf, image_size, image, width, height
-        , cam->cfg->picture_quality, cam ,ts1, box);
+    jpgenc = jpgenc_get();
+    sz = jpgenc->put_grey(buf, image_size, image, width, height
+        , cam->cfg->picture_quality, ts1, box);
+    jpgenc_put(jpgenc);
     fwrite(buf, (uint)sz, 1, picture);
 
     free(buf);
@@ -404,21 +485,24 @@ int cls_picture::put_memory(u_char *img_dst, int image_size
 {
     struct timespec ts1;
     int retcd;
+    cls_jpgenc *jpgenc;
 
     clock_gettime(CLOCK_REALTIME, &ts1);
+    jpgenc = jpgenc_get();
     if (cam->cfg->stream_grey) {
-        retcd = jpgutl_put_grey(img_dst, image_size, image
-            , width, height, quality, cam, &ts1, NULL);
+        retcd = jpgenc->put_grey(img_dst, image_size, image
+            , width, height, quality, &ts1, NULL);
     } else {
-        retcd = jpgutl_put_yuv420p(img_dst, image_size, image
-            , width, height, quality, cam, &ts1, NULL);
+        retcd = jpgenc->put_yuv420p(img_dst, image_size, image
+            , width, height, quality, &ts1, NULL);
     }
+    jpgenc_put(jpgenc);
 
     return retcd;
 }
 
 /* Write the picture to a file */
-void cls_picture::pic_write(FILE *picture, u_char *image)
+void cls_picture::pic_write(FILE *picture, u_char *image, ctx_image_data *img)
 {
     int width, height;
 
@@ -434,18 +518,18 @@ void cls_picture::pic_write(FILE *picture, u_char *image)
         save_ppm(picture, image, width, height);
     } else if (cam->cfg->picture_type == "webp") {
         save_webp(picture, image, width, height
-            , &(cam->current_image->imgts), &(cam->current_image->location));
+            , &(img->imgts), &(img->location));
     } else if (cam->cfg->picture_type == "grey") {
         save_grey(picture, image, width, height
-            , &(cam->current_image->imgts), &(cam->current_image->location));
+            , &(img->imgts), &(img->location));
     } else {
         save_yuv420p(picture, image, width, height
-            , &(cam->current_image->imgts), &(cam->current_image->location));
+            , &(img->imgts), &(img->location));
     }
 }
 
 /* Saves image to a file in format requested */
-void cls_picture::save_norm(char *file, u_char *image)
+void cls_picture::save_norm(const char *file, u_char *image, ctx_image_data *img)
 {
     FILE *picture;
 
@@ -456,20 +540,21 @@ void cls_picture::save_norm(char *file, u_char *image)
         return;
     }
 
-    pic_write(picture, image);
+    pic_write(picture, image, img);
 
     myfclose(picture);
 }
 
 /* Saves image to a file in format requested */
-void cls_picture::save_roi(char *file, u_char *image)
+void cls_picture::save_roi(const char *file, u_char *image, ctx_image_data *img)
 {
     FILE *picture;
     int image_size, sz, indxh;
     ctx_coord *bx;
-    u_char *buf, *img;
+    u_char *buf, *roi;
+    cls_jpgenc *jpgenc;
 
-    bx = &cam->current_image->location;
+    bx = &img->location;
 
     if ((bx->width <64) || (bx->height <64)) {
         return;
@@ -485,23 +570,25 @@ void cls_picture::save_roi(char *file, u_char *image)
     image_size = bx->width * bx->height;
 
     buf =(u_char*) mymalloc((uint)image_size);
-    img =(u_char*) mymalloc((uint)image_size);
+    roi =(u_char*) mymalloc((uint)image_size);
 
     for (indxh=bx->miny; indxh< bx->miny + bx->height; indxh++){
-        memcpy(img+((indxh - bx->miny)* bx->width)
+        memcpy(roi+((indxh - bx->miny)* bx->width)
             , image+(indxh*cam->imgs.width) + bx->minx
             , (uint)bx->width);
     }
 
-    sz = jpgutl_put_grey(buf, image_size, img
+    jpgenc = jpgenc_get();
+    sz = jpgenc->put_grey(buf, image_size, roi
         , bx->width, bx->height
-        , cam->cfg->picture_quality, cam
-        ,&(cam->current_image->imgts), bx);
+        , cam->cfg->picture_quality
+        ,&(img->imgts), bx);
+    jpgenc_put(jpgenc);
 
     fwrite(buf, (uint)sz, 1, picture);
 
     free(buf);
-    free(img);
+    free(roi);
 
     myfclose(picture);
 }
@@ -835,17 +922,32 @@ void cls_picture::init_mask()
     } else {
         cam->imgs.mask = NULL;
     }
+
+    if ((cam->imgs.mask != NULL) && (cam->imgs.det_scale > 1)) {
+        cam->imgs.mask_detect =(u_char*) mymalloc((uint)cam->imgs.det_size);
+        alg_simd_downscale(cam->imgs.mask, cam->imgs.width, cam->imgs.height
+            , cam->imgs.det_scale, cam->imgs.mask_detect);
+    } else {
+        cam->imgs.mask_detect = cam->imgs.mask;
+    }
 }
 
 cls_picture::cls_picture(cls_camera *p_cam)
 {
     cam = p_cam;
+    pthread_mutex_init(&jpgenc_mutex, NULL);
     init_mask();
     init_privacy();
 }
 
 cls_picture::~cls_picture()
 {
+    uint indx;
 
+    for (indx = 0; indx < jpgenc_free.size(); indx++) {
+        delete jpgenc_free[indx];
+    }
+    jpgenc_free.clear();
+    pthread_mutex_destroy(&jpgenc_mutex);
 }
 
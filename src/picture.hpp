@@ -37,10 +37,14 @@ class cls_picture {
         void process_motion();
         void process_snapshot();
         void process_preview();
+        void write(ctx_image_data *img, ctx_stage_pic *pic);
 
     private:
         cls_camera *cam;
 
+        pthread_mutex_t             jpgenc_mutex;
+        std::vector<cls_jpgenc*>    jpgenc_free;    /* Idle encoders */
+
         std::string         full_nm;
         std::string         file_nm;
         std::string         file_dir;
@@ -49,6 +53,8 @@ class cls_picture {
             void webp_exif(WebPMux* webp_mux
                 , timespec *ts1, ctx_coord *box);
         #endif
+        cls_jpgenc *jpgenc_get();
+        void jpgenc_put(cls_jpgenc *jpgenc);
         void save_webp(FILE *fp, u_char *image
             , int width, int height
             , timespec *ts1, ctx_coord *box);
@@ -58,10 +64,12 @@ class cls_picture {
         void save_grey(FILE *picture, u_char *image
             , int width, int height
             , timespec *ts1, ctx_coord *box);
-        void save_norm( char *file, u_char *image);
-        void save_roi( char *file, u_char *image);
+        void save_norm(const char *file, u_char *image, ctx_image_data *img);
+        void save_roi(const char *file, u_char *image, ctx_image_data *img);
         void save_ppm(FILE *picture, u_char *image, int width, int height);
-        void pic_write(FILE *picture, u_char *image);
+        void pic_write(FILE *picture, u_char *image, ctx_image_data *img);
+        void queue(ctx_image_data *img, u_char *image
+            , bool roi, bool replace, std::string link_nm);
         u_char *load_pgm(FILE *picture, int width, int height);
         void write_mask(const char *file);
         void init_privacy();
@@ -0,0 +1,467 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include "motion.hpp"
+#include "util.hpp"
+#include "logger.hpp"
+#include "camera.hpp"
+#include "conf.hpp"
+#include "conf_file.hpp"
+#include "alg_simd.hpp"
+#include "alg.hpp"
+#include "picture.hpp"
+#include "draw.hpp"
+#include "replay.hpp"
+
+static const char *replay_stage_nm[REPLAY_STAGE_CNT] = {
+    "privacy", "diff", "despeckle", "labeling", "location", "tuning"
+};
+
+static int64_t replay_ns(struct timespec *st)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t)(ts.tv_sec - st->tv_sec) * 1000000000L)
+        + (ts.tv_nsec - st->tv_nsec);
+}
+
+void cls_replay::usage()
+{
+    printf("Motion version %s, Copyright 2020-2025\n",PACKAGE_VERSION);
+    printf("\nusage:\tmotion-replay -i input -s WIDTHxHEIGHT [options]\n");
+    printf("\n");
+    printf("Runs raw YUV420P frames through the motion detection and reports\n");
+    printf("the results of each frame and the time spent in each stage.\n");
+    printf("\n\n");
+    printf("Possible options:\n\n");
+    printf("-i input\t\tFile of frames or directory with one frame in each file.\n");
+    printf("-s size\t\t\tWidth and height of the frames such as 640x480.\n");
+    printf("-c config\t\tCamera config file with the detection options.\n");
+    printf("-o name=value\t\tSet a config option.  May be repeated.\n");
+    printf("-n frames\t\tStop after this many frames.\n");
+    printf("-l log file \t\tFull path and filename of log file.\n");
+    printf("-q\t\t\tOnly show the summary.\n");
+    printf("-h\t\t\tShow this screen.\n");
+    printf("\n");
+    printf("Events are not run.  The camera is detecting motion from the\n");
+    printf("first image over the threshold until the next image below it.\n");
+    printf("\n");
+}
+
+bool cls_replay::cmdline()
+{
+    int c;
+    size_t xpos;
+
+    while ((c = getopt(argc, argv, "i:s:c:o:n:l:qh?")) != EOF)
+        switch (c) {
+        case 'i':
+            src_path = optarg;
+            break;
+        case 's':
+            xpos = std::string(optarg).find('x');
+            if (xpos != std::string::npos) {
+                width = mtoi(std::string(optarg).substr(0, xpos));
+                height = mtoi(std::string(optarg).substr(xpos + 1));
+            }
+            break;
+        case 'c':
+            conf_file = optarg;
+            break;
+        case 'o':
+            parms.push_back(optarg);
+            break;
+        case 'n':
+            frames_max = mtoi(optarg);
+            break;
+        case 'l':
+            log_file = optarg;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        case 'h':
+        case '?':
+        default:
+            usage();
+            return false;
+        }
+
+    if ((src_path == "") || (width < 64) || (height < 64) ||
+        (width % 8) || (height % 8)) {
+        usage();
+        return false;
+    }
+
+    return true;
+}
+
+/* Open the input as a file of frames or a directory of frame files */
+bool cls_replay::src_open()
+{
+    DIR *dp;
+    dirent *ep;
+    std::string file;
+
+    dp = opendir(src_path.c_str());
+    if (dp != nullptr) {
+        while ((ep = readdir(dp)) != nullptr) {
+            file = ep->d_name;
+            if (file.substr(0, 1) != ".") {
+                src_files.push_back(src_path + "/" + file);
+            }
+        }
+        closedir(dp);
+        std::sort(src_files.begin(), src_files.end());
+        if (src_files.size() == 0) {
+            MOTION_LOG(ERR, TYPE_ALL, NO_ERRNO
+                , _("No frames found in %s"), src_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    src_fp = myfopen(src_path.c_str(), "rbe");
+    if (src_fp == nullptr) {
+        MOTION_LOG(ERR, TYPE_ALL, SHOW_ERRNO
+            , _("Unable to open %s"), src_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/* Read the next frame.  Each file of a directory holds one frame */
+bool cls_replay::src_next(u_char *img)
+{
+    FILE *fp;
+    size_t sz, imgsz;
+
+    imgsz = (size_t)((width * height * 3) / 2);
+
+    if (src_fp != nullptr) {
+        return (fread(img, 1, imgsz, src_fp) == imgsz);
+    }
+
+    if (src_indx >= (int)src_files.size()) {
+        return false;
+    }
+
+    fp = myfopen(src_files[(uint)src_indx].c_str(), "rbe");
+    src_indx++;
+    if (fp == nullptr) {
+        MOTION_LOG(ERR, TYPE_ALL, SHOW_ERRNO
+            , _("Unable to open %s"), src_files[(uint)src_indx - 1].c_str());
+        return false;
+    }
+    sz = fread(img, 1, imgsz, fp);
+    myfclose(fp);
+
+    if (sz != imgsz) {
+        MOTION_LOG(ERR, TYPE_ALL, NO_ERRNO
+            , _("%s is not a %dx%d YUV420P frame")
+            , src_files[(uint)src_indx - 1].c_str(), width, height);
+        return false;
+    }
+
+    return true;
+}
+
+void cls_replay::src_close()
+{
+    if (src_fp != nullptr) {
+        myfclose(src_fp);
+        src_fp = nullptr;
+    }
+    src_files.clear();
+}
+
+/*
+ * Set up the camera the same way as cls_camera::init but with the image
+ * size from the command line in place of a device.
+ */
+void cls_replay::init_cam()
+{
+    cls_config_file *conf;
+    size_t eqpos;
+    uint indx;
+
+    cam = new cls_camera(app);
+    cam->cfg = new cls_config(app);
+
+    if (conf_file != "") {
+        cam->cfg->conf_filename = conf_file;
+        conf = new cls_config_file(app, cam->cfg);
+        conf->process();
+        delete conf;
+    }
+    for (indx = 0; indx < parms.size(); indx++) {
+        eqpos = parms[indx].find('=');
+        if (eqpos == std::string::npos) {
+            MOTION_LOG(ERR, TYPE_ALL, NO_ERRNO
+                , _("Option %s is not name=value"), parms[indx].c_str());
+            continue;
+        }
+        cam->cfg->edit_set(parms[indx].substr(0, eqpos)
+            , parms[indx].substr(eqpos + 1));
+    }
+    cam->cfg->width = width;
+    cam->cfg->height = height;
+
+    mythreadname_set("rp", cam->cfg->device_id, cam->cfg->device_name.c_str());
+
+    cam->init_values();
+    cam->device_status = STATUS_OPENED;
+
+    cam->imgs.width = width;
+    cam->imgs.height = height;
+    cam->imgs.motionsize = (width * height);
+    cam->imgs.size_norm = (width * height * 3) / 2;
+    cam->imgs.size_high = 0;
+    cam->imgs.labelsize_max = 0;
+    cam->imgs.largest_label = 0;
+    cam->init_detect();
+
+    cam->ring_resize();
+    cam->init_buffers();
+    cam->current_image = &cam->imgs.image_ring[cam->imgs.ring_in];
+
+    cam->noise = cam->cfg->noise_level;
+    cam->threshold = cam->cfg->threshold;
+    if (cam->cfg->threshold_maximum > cam->cfg->threshold ) {
+        cam->threshold_maximum = cam->cfg->threshold_maximum;
+    } else {
+        cam->threshold_maximum = (height * width * 3) / 2;
+    }
+
+    cam->alg = new cls_alg(cam);
+    cam->picture = new cls_picture(cam);
+    cam->draw = new cls_draw(cam);
+    cam->init_areadetect();
+
+    cam->alg->timing = true;
+}
+
+void cls_replay::deinit_cam()
+{
+    if (cam == nullptr) {
+        return;
+    }
+    cam->cleanup_buffers();
+    mydelete(cam);
+}
+
+/*
+ * Stand in for the events of the camera loop.  The camera detects motion
+ * from the first image over the threshold until the next one below it.
+ */
+void cls_replay::frame_events()
+{
+    bool motion;
+
+    motion = ((cam->current_image->diffs > cam->threshold) &&
+        (cam->current_image->diffs < cam->threshold_maximum));
+
+    if (motion) {
+        motion_cnt++;
+        if (cam->detecting_motion == false) {
+            cam->event_prev_nbr = cam->event_curr_nbr;
+            cam->detecting_motion = true;
+        }
+    } else if (cam->detecting_motion) {
+        cam->event_curr_nbr++;
+        cam->detecting_motion = false;
+    }
+}
+
+void cls_replay::frame_log()
+{
+    ctx_image_data *img = cam->current_image;
+
+    if (quiet) {
+        return;
+    }
+
+    printf("%6d diffs %7d raw %7d ratio %3d labels %4d largest %7d"
+        " loc %4d,%4d box %4d-%4d,%4d-%4d noise %3d threshold %7d\n"
+        , frame_cnt, img->diffs, img->diffs_raw, img->diffs_ratio
+        , img->total_labels, cam->imgs.largest_label
+        , img->location.x, img->location.y
+        , img->location.minx, img->location.maxx
+        , img->location.miny, img->location.maxy
+        , cam->noise, cam->threshold);
+}
+
+/* Process one image that was read into the current image */
+void cls_replay::frame()
+{
+    struct timespec st;
+    int64_t loc_ns, tune_ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &st);
+    cam->prepare_image();
+    stage_ns[REPLAY_STAGE_PRIVACY] += replay_ns(&st);
+
+    cam->detection();
+
+    loc_ns = cam->alg->time_ns[ALG_TIME_LOCATION];
+    clock_gettime(CLOCK_MONOTONIC, &st);
+    cam->tuning();
+    tune_ns = replay_ns(&st);
+    loc_ns = cam->alg->time_ns[ALG_TIME_LOCATION] - loc_ns;
+    stage_ns[REPLAY_STAGE_TUNING] += (tune_ns - loc_ns);
+
+    frame_log();
+    frame_events();
+}
+
+void cls_replay::report()
+{
+    int indx;
+    int64_t total;
+    double secs;
+
+    stage_ns[REPLAY_STAGE_DIFF] = cam->alg->time_ns[ALG_TIME_DIFF];
+    stage_ns[REPLAY_STAGE_DESPECKLE] = cam->alg->time_ns[ALG_TIME_DESPECKLE];
+    stage_ns[REPLAY_STAGE_LABELING] = cam->alg->time_ns[ALG_TIME_LABELING];
+    stage_ns[REPLAY_STAGE_LOCATION] = cam->alg->time_ns[ALG_TIME_LOCATION];
+
+    printf("\n");
+    printf("Frames      : %d at %dx%d, detection at %dx%d\n"
+        , frame_cnt, width, height
+        , cam->imgs.det_width, cam->imgs.det_height);
+    printf("Motion      : %d frames over the threshold\n", motion_cnt);
+    if (frame_cnt == 0) {
+        return;
+    }
+
+    total = 0;
+    printf("Stage       :   ns/frame\n");
+    for (indx = 0; indx < REPLAY_STAGE_CNT; indx++) {
+        printf("  %-10s: %10lld\n", replay_stage_nm[indx]
+            , (long long)(stage_ns[indx] / frame_cnt));
+        total += stage_ns[indx];
+    }
+    printf("  %-10s: %10lld\n", "total", (long long)(total / frame_cnt));
+
+    secs = (double)total / 1000000000.0;
+    if (secs > 0) {
+        printf("Throughput  : %.1f frames/s, %.1f Mpixel/s\n"
+            , frame_cnt / secs
+            , ((double)frame_cnt * width * height) / secs / 1000000.0);
+    }
+    printf("Elapsed     : %.3f s including reading the frames\n"
+        , (double)elapsed_ns / 1000000000.0);
+}
+
+int cls_replay::run()
+{
+    struct timespec st;
+
+    if (cmdline() == false) {
+        return 1;
+    }
+
+    if (log_file != "") {
+        motlog->set_log_file(log_file);
+    }
+
+    if (src_open() == false) {
+        return 1;
+    }
+
+    init_cam();
+
+    clock_gettime(CLOCK_MONOTONIC, &st);
+
+    if (src_next(cam->current_image->image_norm) == false) {
+        MOTION_LOG(ERR, TYPE_ALL, NO_ERRNO
+            , _("Unable to read the first frame of %s"), src_path.c_str());
+        src_close();
+        return 1;
+    }
+    cam->init_ref();
+
+    while ((frames_max <= 0) || (frame_cnt < frames_max)) {
+        cam->shots_mt = frame_cnt % MAX(cam->cfg->framerate, 1);
+        cam->lastrate = cam->cfg->framerate;
+        cam->resetimages();
+        if (src_next(cam->current_image->image_norm) == false) {
+            break;
+        }
+        frame();
+        frame_cnt++;
+    }
+
+    elapsed_ns = replay_ns(&st);
+
+    report();
+
+    src_close();
+
+    return 0;
+}
+
+cls_replay::cls_replay(int p_argc, char **p_argv)
+{
+    argc = p_argc;
+    argv = p_argv;
+    app = new cls_motapp();
+    app->conf_src = nullptr;
+    app->user_pause = "off";
+    cam = nullptr;
+    src_path = "";
+    conf_file = "";
+    log_file = "";
+    src_fp = nullptr;
+    src_indx = 0;
+    width = 0;
+    height = 0;
+    frames_max = 0;
+    quiet = false;
+    frame_cnt = 0;
+    motion_cnt = 0;
+    memset(stage_ns, 0, sizeof(stage_ns));
+    elapsed_ns = 0;
+}
+
+cls_replay::~cls_replay()
+{
+    deinit_cam();
+    mydelete(app);
+}
+
+/** Main entry point of motion-replay. */
+int main (int p_argc, char **p_argv)
+{
+    cls_replay *replay;
+    int retcd;
+
+    motlog = new cls_log(nullptr);
+    mythreadname_set("rp",0,"");
+
+    replay = new cls_replay(p_argc, p_argv);
+    retcd = replay->run();
+    delete replay;
+
+    mydelete(motlog);
+
+    return retcd;
+}
@@ -0,0 +1,82 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * replay.hpp - Offline replay of recorded frames through the detection
+ *
+ * The motion-replay program reads raw YUV420P frames from a file or from a
+ * directory with one frame in each file and runs them through the same
+ * detection stages as the camera loop.  The results of each frame and the
+ * time spent in each stage are reported so changes to the detection can be
+ * measured and compared without a camera.
+ */
+
+#ifndef _INCLUDE_REPLAY_HPP_
+#define _INCLUDE_REPLAY_HPP_
+
+    enum REPLAY_STAGE {
+        REPLAY_STAGE_PRIVACY,
+        REPLAY_STAGE_DIFF,
+        REPLAY_STAGE_DESPECKLE,
+        REPLAY_STAGE_LABELING,
+        REPLAY_STAGE_LOCATION,
+        REPLAY_STAGE_TUNING,
+        REPLAY_STAGE_CNT
+    };
+
+    class cls_replay {
+        public:
+            cls_replay(int p_argc, char **p_argv);
+            ~cls_replay();
+            int run();
+
+        private:
+            int         argc;
+            char        **argv;
+            cls_motapp  *app;
+            cls_camera  *cam;
+            std::string src_path;
+            std::string conf_file;
+            std::string log_file;
+            std::vector<std::string> parms;     /* name=value from the command line */
+            std::vector<std::string> src_files; /* Frames when src_path is a directory */
+            FILE        *src_fp;
+            int         src_indx;
+            int         width;
+            int         height;
+            int         frames_max;
+            bool        quiet;
+            int         frame_cnt;
+            int         motion_cnt;
+            int64_t     stage_ns[REPLAY_STAGE_CNT];
+            int64_t     elapsed_ns;
+
+            void usage();
+            bool cmdline();
+            bool src_open();
+            bool src_next(u_char *img);
+            void src_close();
+            void init_cam();
+            void deinit_cam();
+            void frame();
+            void frame_events();
+            void frame_log();
+            void report();
+    };
+
+#endif /* _INCLUDE_REPLAY_HPP_ */
@@ -25,6 +25,7 @@ enum FLIP_TYPE {
 };
 
 class cls_rotate {
+    friend class cls_bench;
     public:
         cls_rotate(cls_camera *p_cam);
         ~cls_rotate();
@@ -0,0 +1,279 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "motion.hpp"
+#include "util.hpp"
+#include "logger.hpp"
+#include "conf.hpp"
+#include "camera.hpp"
+#include "movie.hpp"
+#include "video_loopback.hpp"
+#include "webu_getimg.hpp"
+#include "picture.hpp"
+#include "stage.hpp"
+#include "metrics.hpp"
+
+static void *stage_handler(void *arg)
+{
+    ((cls_stage *)arg)->handler();
+    return nullptr;
+}
+
+static int64_t stage_ns(struct timespec *ts1, struct timespec *ts2)
+{
+    return ((int64_t)(ts2->tv_sec - ts1->tv_sec) * 1000000000L)
+        + (ts2->tv_nsec - ts1->tv_nsec);
+}
+
+/* Run one job and release the image buffers it holds */
+void cls_stage::run(ctx_stage_job *job)
+{
+    if (job->type == STAGE_JOB_MOVIE) {
+        if (job->movie->put_image(&job->img, &job->img.imgts) == -1) {
+            MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO, _("Error encoding image"));
+        }
+    } else if (job->type == STAGE_JOB_MOVIE_MOTION) {
+        job->img.image_norm = job->img.image_motion;
+        job->img.image_high = nullptr;
+        if (job->movie->put_image(&job->img, &job->img.imgts) == -1) {
+            MOTION_LOG(ERR, TYPE_EVENTS, NO_ERRNO, _("Error encoding image"));
+        }
+    } else if (job->type == STAGE_JOB_LOOPBACK) {
+        vlp_putpipe(cam, &job->img);
+    } else if (job->type == STAGE_JOB_STREAM) {
+        webu_getimg_main(cam, &job->img);
+    } else if (job->type == STAGE_JOB_PICTURE) {
+        cam->picture->write(&job->img, &job->pic);
+    }
+
+    cam->frame_release(&job->img);
+}
+
+void cls_stage::handler()
+{
+    ctx_stage_job job;
+    struct timespec st_ts, en_ts;
+
+    mythreadname_set(abbr.c_str(), cam->cfg->device_id, cam->cfg->device_name.c_str());
+
+    pthread_mutex_lock(&mutex);
+    while (true) {
+        while ((depth == 0) && (handler_stop == false)) {
+            pthread_cond_wait(&cond_job, &mutex);
+        }
+        if (depth == 0) {
+            break;
+        }
+        job = queue[(uint)queue_head];
+        queue_head = (queue_head + 1) % size;
+        depth--;
+        cam->metrics->out_depth(out, depth);
+        busy++;
+        pthread_mutex_unlock(&mutex);
+
+        clock_gettime(CLOCK_MONOTONIC, &st_ts);
+        run(&job);
+        clock_gettime(CLOCK_MONOTONIC, &en_ts);
+
+        pthread_mutex_lock(&mutex);
+        busy--;
+        jobs++;
+        busy_ns += stage_ns(&st_ts, &en_ts);
+        cam->metrics->out_job(out, stage_ns(&st_ts, &en_ts));
+        pthread_cond_broadcast(&cond_room);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+/* Queue the job, waiting or dropping it when the queue is full */
+void cls_stage::put(ctx_stage_job *job)
+{
+    struct timespec st_ts, en_ts;
+    ctx_stage_job *old;
+
+    if (handler_running == 0) {
+        cam->frame_hold(&job->img);
+        run(job);
+        return;
+    }
+
+    pthread_mutex_lock(&mutex);
+        if ((depth == size) && drop_full) {
+            if (drop_cnt == 0) {
+                MOTION_LOG(NTC, TYPE_ALL, NO_ERRNO
+                    , _("Stage %s is full.  Dropping images."), name.c_str());
+            }
+            drop_cnt++;
+            cam->metrics->out_drop(out);
+            pthread_mutex_unlock(&mutex);
+            return;
+        }
+        if ((depth == size) && keep_latest) {
+            old = &queue[(uint)queue_head];
+            cam->frame_release(&old->img);
+            queue_head = (queue_head + 1) % size;
+            depth--;
+            drop_cnt++;
+            cam->metrics->out_drop(out);
+        }
+        if (depth == size) {
+            stall_cnt++;
+            clock_gettime(CLOCK_MONOTONIC, &st_ts);
+            while (depth == size) {
+                pthread_cond_wait(&cond_room, &mutex);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &en_ts);
+            stall_ns += stage_ns(&st_ts, &en_ts);
+            cam->metrics->out_stall(out, stage_ns(&st_ts, &en_ts));
+        }
+        cam->frame_hold(&job->img);
+        queue[(uint)((queue_head + depth) % size)] = *job;
+        depth++;
+        if (depth > depth_max) {
+            depth_max = depth;
+        }
+        cam->metrics->out_depth(out, depth);
+        pthread_cond_signal(&cond_job);
+    pthread_mutex_unlock(&mutex);
+}
+
+void cls_stage::push(enum STAGE_JOB type, ctx_image_data *img, cls_movie *movie)
+{
+    ctx_stage_job job;
+
+    job.type = type;
+    job.img = *img;
+    job.movie = movie;
+    put(&job);
+}
+
+void cls_stage::push(ctx_image_data *img, ctx_stage_pic *pic)
+{
+    ctx_stage_job job;
+
+    job.type = STAGE_JOB_PICTURE;
+    job.img = *img;
+    job.movie = nullptr;
+    job.pic = *pic;
+    put(&job);
+}
+
+/* Wait until all the queued jobs are done */
+void cls_stage::drain()
+{
+    pthread_mutex_lock(&mutex);
+        while ((depth > 0) || (busy > 0)) {
+            pthread_cond_wait(&cond_room, &mutex);
+        }
+    pthread_mutex_unlock(&mutex);
+}
+
+/* Jobs waiting in the queue */
+int cls_stage::pending()
+{
+    int cnt;
+
+    pthread_mutex_lock(&mutex);
+        cnt = depth;
+    pthread_mutex_unlock(&mutex);
+
+    return cnt;
+}
+
+void cls_stage::stats_log()
+{
+    if (handler_running == 0) {
+        return;
+    }
+    MOTION_LOG(INF, TYPE_ALL, NO_ERRNO
+        , _("Stage %s: %lld jobs, busy %lld ms, queue depth max %d/%d"
+            ", %lld stalls for %lld ms, %lld dropped")
+        , name.c_str(), (long long)jobs, (long long)(busy_ns / 1000000L)
+        , depth_max, size
+        , (long long)stall_cnt, (long long)(stall_ns / 1000000L)
+        , (long long)drop_cnt);
+}
+
+cls_stage::cls_stage(cls_camera *p_cam, std::string p_name, std::string p_abbr
+    , int p_threads, int p_size)
+{
+    int retcd, indx;
+    pthread_t thrd;
+
+    cam = p_cam;
+    name = p_name;
+    abbr = p_abbr;
+    out = cam->metrics->out_index(name);
+    size = p_size;
+    if (size < 1) {
+        size = 1;
+    }
+    depth = 0;
+    depth_max = 0;
+    jobs = 0;
+    stall_cnt = 0;
+    stall_ns = 0;
+    drop_cnt = 0;
+    drop_full = false;
+    keep_latest = false;
+    busy_ns = 0;
+    queue.resize((uint)size);
+    queue_head = 0;
+    busy = 0;
+    handler_stop = false;
+    handler_running = 0;
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond_job, NULL);
+    pthread_cond_init(&cond_room, NULL);
+
+    for (indx = 0; indx < p_threads; indx++) {
+        retcd = pthread_create(&thrd, NULL, &stage_handler, this);
+        if (retcd != 0) {
+            MOTION_LOG(ERR, TYPE_ALL, NO_ERRNO
+                , _("Unable to start %s stage thread."), name.c_str());
+            break;
+        }
+        handler_thread.push_back(thrd);
+        handler_running++;
+    }
+    if ((p_threads > 0) && (handler_running == 0)) {
+        MOTION_LOG(ERR, TYPE_ALL, NO_ERRNO
+            , _("Running the %s stage on the camera thread."), name.c_str());
+    }
+}
+
+cls_stage::~cls_stage()
+{
+    int indx;
+
+    if (handler_running > 0) {
+        pthread_mutex_lock(&mutex);
+            handler_stop = true;
+            pthread_cond_broadcast(&cond_job);
+        pthread_mutex_unlock(&mutex);
+        for (indx = 0; indx < handler_running; indx++) {
+            pthread_join(handler_thread[(uint)indx], NULL);
+        }
+    }
+    stats_log();
+    handler_running = 0;
+    handler_thread.clear();
+    pthread_cond_destroy(&cond_room);
+    pthread_cond_destroy(&cond_job);
+    pthread_mutex_destroy(&mutex);
+}
@@ -0,0 +1,118 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * stage.hpp - Output stages of the camera loop
+ *
+ * The camera thread captures, detects and decides on the events.  The
+ * frames which are to be encoded or sent to the other outputs are handed
+ * to a stage which has its own threads and a bounded queue of jobs.  Each
+ * movie has a stage for its encoder and the camera has one each for the
+ * loopback, the streams and the pictures.  Each job holds a reference on
+ * the image buffers of its frame so the ring slot may be reused by the
+ * camera thread while the stage is still working.  With one thread the
+ * jobs are run in the order they were queued.  The pictures use a stage
+ * which may have several threads since their order does not matter.  When
+ * the queue is full the push waits for room or, with drop_full, discards
+ * the frame.  With keep_latest the oldest queued frame is discarded
+ * instead so the stage always works on the newest one, as the streams
+ * want.  A stage with no threads runs the jobs on the thread which pushes
+ * them.
+ */
+
+#ifndef _INCLUDE_STAGE_HPP_
+#define _INCLUDE_STAGE_HPP_
+
+    #define STAGE_DEPTH 4
+
+    enum STAGE_JOB {
+        STAGE_JOB_MOVIE,        /* Put the image into a movie */
+        STAGE_JOB_MOVIE_MOTION, /* Put the motion image into a movie */
+        STAGE_JOB_LOOPBACK,     /* Write the images to the loopback devices */
+        STAGE_JOB_STREAM,       /* Copy and encode the images for the streams */
+        STAGE_JOB_PICTURE       /* Encode and write a picture file */
+    };
+
+    /* Picture file to write.  The names and commands are made when queued */
+    struct ctx_stage_pic {
+        u_char          *image;     /* Image of the held frame to save */
+        bool            roi;        /* Save only the area of the motion */
+        bool            replace;    /* Remove the old file first since it may be a link */
+        std::string     full_nm;
+        std::string     file_nm;
+        std::string     file_dir;
+        std::string     link_nm;    /* Symbolic link to update or empty */
+        std::string     cmd;        /* on_picture_save command or empty */
+        std::string     sql;        /* sql_pic_save query or empty */
+        uint64_t        diff_tot;   /* Motion stats of the camera for the file list */
+        uint64_t        diff_cnt;
+        uint64_t        sdev_tot;
+        int             sdev_min;
+        int             sdev_max;
+    };
+
+    struct ctx_stage_job {
+        enum STAGE_JOB  type;
+        ctx_image_data  img;        /* Copy of the ring slot when queued */
+        cls_movie       *movie;
+        ctx_stage_pic   pic;
+    };
+
+    class cls_stage {
+        public:
+            cls_stage(cls_camera *p_cam, std::string p_name, std::string p_abbr
+                , int p_threads, int p_size);
+            ~cls_stage();
+            void push(enum STAGE_JOB type, ctx_image_data *img, cls_movie *movie);
+            void push(ctx_image_data *img, ctx_stage_pic *pic);
+            void drain();
+            int pending();
+            void handler();
+
+            std::string name;
+            bool        drop_full;      /* Discard rather than wait when the queue is full */
+            bool        keep_latest;    /* Replace the oldest job when the queue is full */
+            int         size;           /* Jobs the queue can hold */
+            int         depth;          /* Jobs waiting in the queue */
+            int         depth_max;
+            int64_t     jobs;           /* Jobs completed */
+            int64_t     stall_cnt;      /* Pushes which waited for room in the queue */
+            int64_t     stall_ns;
+            int64_t     drop_cnt;       /* Pushes discarded since the queue was full */
+            int64_t     busy_ns;        /* Time spent running the jobs */
+
+        private:
+            cls_camera      *cam;
+            std::string     abbr;
+            int             out;            /* Index of the stage in the camera metrics */
+            std::vector<ctx_stage_job>  queue;
+            int             queue_head;
+            int             busy;           /* Threads running a job */
+            bool            handler_stop;
+            int             handler_running;    /* Threads started */
+            std::vector<pthread_t>  handler_thread;
+            pthread_mutex_t mutex;
+            pthread_cond_t  cond_job;
+            pthread_cond_t  cond_room;
+
+            void put(ctx_stage_job *job);
+            void run(ctx_stage_job *job);
+            void stats_log();
+    };
+
+#endif /* _INCLUDE_STAGE_HPP_ */
@@ -589,6 +589,37 @@ void mythreadname_get(std::string &threadname)
     #endif
 }
 
+/*
+ * Initialize a condition whose timed waits are against the monotonic
+ * clock so a change of the wall clock does not end or stretch the waits.
+ */
+void mycond_init(pthread_cond_t *cond)
+{
+    #if defined(__APPLE__)
+        pthread_cond_init(cond, NULL);
+    #else
+        pthread_condattr_t attr;
+
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(cond, &attr);
+        pthread_condattr_destroy(&attr);
+    #endif
+}
+
+/* Deadline wait_ns from now for a condition made by mycond_init */
+void mycond_deadline(struct timespec *ts, int64_t wait_ns)
+{
+    #if defined(__APPLE__)
+        clock_gettime(CLOCK_REALTIME, ts);
+    #else
+        clock_gettime(CLOCK_MONOTONIC, ts);
+    #endif
+    wait_ns += ts->tv_nsec;
+    ts->tv_sec += (time_t)(wait_ns / 1000000000L);
+    ts->tv_nsec = (long)(wait_ns % 1000000000L);
+}
+
 void mythreadname_get(char *threadname)
 {
     #if ((!defined(BSD) && HAVE_PTHREAD_GETNAME_NP) || defined(__APPLE__))
@@ -719,30 +750,37 @@ AVPacket *mypacket_alloc(AVPacket *pkt)
 void util_exec_command(cls_camera *cam, const char *command, const char *filename)
 {
     char stamp[PATH_MAX];
-    int pid;
 
     mystrftime(cam, stamp, sizeof(stamp), command, filename);
 
+    util_exec_stamp(stamp);
+}
+
+/* Start a command which already has its conversion specifiers replaced */
+void util_exec_stamp(std::string stamp)
+{
+    int pid;
+
     pid = fork();
     if (!pid) {
         /* Detach from parent */
         setsid();
 
-        execl("/bin/sh", "sh", "-c", stamp, " &",(char*)NULL);
+        execl("/bin/sh", "sh", "-c", stamp.c_str(), " &",(char*)NULL);
 
         /* if above function succeeds the program never reach here */
         MOTION_LOG(ALR, TYPE_EVENTS, SHOW_ERRNO
-            ,_("Unable to start external command '%s'"), stamp);
+            ,_("Unable to start external command '%s'"), stamp.c_str());
 
         exit(1);
     }
 
     if (pid == 0) {
         MOTION_LOG(ALR, TYPE_EVENTS, SHOW_ERRNO
-            ,_("Unable to start external command '%s'"), stamp);
+            ,_("Unable to start external command '%s'"), stamp.c_str());
     } else {
         MOTION_LOG(DBG, TYPE_EVENTS, NO_ERRNO
-            ,_("Executing external command '%s'"), stamp);
+            ,_("Executing external command '%s'"), stamp.c_str());
     }
 }
 
@@ -1277,109 +1315,63 @@ std::string mtok(std::string &parm, std::string tok)
     return tmp;
 }
 
+/*
+ * Scale a YUV420P image into dst.  The scaling context is kept by the
+ * caller in swsctx and is only made again when the sizes change.
+ */
 void util_resize(uint8_t *src, int src_w, int src_h
-    , uint8_t *dst, int dst_w, int dst_h)
+    , uint8_t *dst, int dst_w, int dst_h, struct SwsContext **swsctx)
 {
-    int     retcd, img_sz;
+    int     retcd;
     char    errstr[128];
-    uint8_t *buf;
-    AVFrame *frm_in, *frm_out;
-    struct SwsContext *swsctx;
-
-    img_sz = (dst_h * dst_w * 3)/2;
-    memset(dst, 0x00, (size_t)img_sz);
-
-    frm_in = av_frame_alloc();
-    if (frm_in == NULL) {
-        MOTION_LOG(ERR, TYPE_NETCAM, NO_ERRNO
-            , _("Unable to allocate frm_in."));
-        return;
-    }
-
-    frm_out = av_frame_alloc();
-    if (frm_out == NULL) {
-        MOTION_LOG(ERR, TYPE_NETCAM, NO_ERRNO
-            , _("Unable to allocate frm_out."));
-        av_frame_free(&frm_in);
-        return;
-    }
+    uint8_t *data_in[4], *data_out[4];
+    int     line_in[4], line_out[4];
 
     retcd = av_image_fill_arrays(
-        frm_in->data, frm_in->linesize
+        data_in, line_in
         , src, AV_PIX_FMT_YUV420P
         , src_w, src_h, 1);
     if (retcd < 0) {
         av_strerror(retcd, errstr, sizeof(errstr));
         MOTION_LOG(ERR, TYPE_NETCAM, NO_ERRNO
             , "Error filling arrays: %s", errstr);
-        av_frame_free(&frm_in);
-        av_frame_free(&frm_out);
+        memset(dst, 0x00, (size_t)((dst_h * dst_w * 3)/2));
         return;
     }
 
-    buf = (uint8_t *)mymalloc((size_t)img_sz);
-
     retcd = av_image_fill_arrays(
-        frm_out->data, frm_out->linesize
-        , buf, AV_PIX_FMT_YUV420P
+        data_out, line_out
+        , dst, AV_PIX_FMT_YUV420P
         , dst_w, dst_h, 1);
     if (retcd < 0) {
         av_strerror(retcd, errstr, sizeof(errstr));
         MOTION_LOG(ERR, TYPE_NETCAM, NO_ERRNO
             , "Error Filling array 2: %s", errstr);
-        free(buf);
-        av_frame_free(&frm_in);
-        av_frame_free(&frm_out);
+        memset(dst, 0x00, (size_t)((dst_h * dst_w * 3)/2));
         return;
     }
 
-    swsctx = sws_getContext(
-            src_w, src_h, AV_PIX_FMT_YUV420P
-            ,dst_w, dst_h, AV_PIX_FMT_YUV420P
-            ,SWS_BICUBIC, NULL, NULL, NULL);
-    if (swsctx == NULL) {
+    *swsctx = sws_getCachedContext(*swsctx
+        , src_w, src_h, AV_PIX_FMT_YUV420P
+        , dst_w, dst_h, AV_PIX_FMT_YUV420P
+        , SWS_BICUBIC, NULL, NULL, NULL);
+    if (*swsctx == NULL) {
         MOTION_LOG(ERR, TYPE_NETCAM, NO_ERRNO
             , _("Unable to allocate scaling context."));
-        free(buf);
-        av_frame_free(&frm_in);
-        av_frame_free(&frm_out);
+        memset(dst, 0x00, (size_t)((dst_h * dst_w * 3)/2));
         return;
     }
 
-    retcd = sws_scale(swsctx
-        , (const uint8_t* const *)frm_in->data, frm_in->linesize
-        , 0, src_h, frm_out->data, frm_out->linesize);
+    /* Scaled straight into dst since the planes are packed with no padding */
+    retcd = sws_scale(*swsctx
+        , (const uint8_t* const *)data_in, line_in
+        , 0, src_h, data_out, line_out);
     if (retcd < 0) {
         av_strerror(retcd, errstr, sizeof(errstr));
         MOTION_LOG(ERR, TYPE_NETCAM, NO_ERRNO
             ,_("Error resizing/reformatting: %s"), errstr);
-        free(buf);
-        av_frame_free(&frm_in);
-        av_frame_free(&frm_out);
-        sws_freeContext(swsctx);
+        memset(dst, 0x00, (size_t)((dst_h * dst_w * 3)/2));
         return;
     }
-
-    retcd = av_image_copy_to_buffer(
-        (uint8_t *)dst, img_sz
-        , (const uint8_t * const*)frm_out
-        , frm_out->linesize
-        , AV_PIX_FMT_YUV420P, dst_w, dst_h, 1);
-
-    if (retcd < 0) {
-        av_strerror(retcd, errstr, sizeof(errstr));
-        MOTION_LOG(ERR, TYPE_NETCAM, NO_ERRNO
-            ,_("Error putting frame into output buffer: %s"), errstr);
-        free(buf);
-        av_frame_free(&frm_in);
-        av_frame_free(&frm_out);
-        sws_freeContext(swsctx);
-        return;
-    }
-
-    free(buf);
-    av_frame_free(&frm_in);
-    av_frame_free(&frm_out);
-    sws_freeContext(swsctx);
 }
 
@@ -76,10 +76,13 @@ struct ctx_params {
     void util_exec_command(cls_camera *cam, const char *command, const char *filename);
     void util_exec_command(cls_sound *snd, std::string cmd);
     void util_exec_command(cls_camera *cam, std::string cmd);
+    void util_exec_stamp(std::string stamp);
 
     void mythreadname_set(const char *abbr, int threadnbr, const char *threadname);
     void mythreadname_get(char *threadname);
     void mythreadname_get(std::string &threadname);
+    void mycond_init(pthread_cond_t *cond);
+    void mycond_deadline(struct timespec *ts, int64_t wait_ns);
 
     char* mytranslate_text(const char *msgid, int setnls);
     void mytranslate_init(void);
@@ -115,6 +118,6 @@ struct ctx_params {
     std::string mtok(std::string &parm, std::string tok);
 
     void util_resize(uint8_t *src, int src_w, int src_h
-        , uint8_t *dst, int dst_w, int dst_h);
+        , uint8_t *dst, int dst_w, int dst_h, struct SwsContext **swsctx);
 
 #endif /* _INCLUDE_UTIL_HPP_ */
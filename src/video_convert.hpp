@@ -26,6 +26,7 @@ typedef struct {
 } sonix_table;
 
 class cls_convert {
+    friend class cls_bench;
     public:
         cls_convert(cls_camera *p_cam, int p_pix, int p_w, int p_h);
         ~cls_convert();
@@ -238,14 +238,14 @@ int vlp_startpipe(const char *dev_name, int width, int height)
 
 #endif /* HAVE_V4L2 && !BSD */
 
-void vlp_putpipe(cls_camera *cam)
+void vlp_putpipe(cls_camera *cam, ctx_image_data *img)
 {
     #if (defined(HAVE_V4L2)) && (!defined(BSD))
         ssize_t retcd;
 
         if (cam->pipe >= 0) {
             retcd = write(cam->pipe
-                , cam->current_image->image_norm
+                , img->image_norm
                 , (uint)cam->imgs.size_norm);
             if (retcd < 0) {
                 MOTION_LOG(ERR, TYPE_EVENTS, SHOW_ERRNO
@@ -254,7 +254,7 @@ void vlp_putpipe(cls_camera *cam)
         }
         if (cam->mpipe >= 0) {
             retcd = write(cam->mpipe
-                , cam->imgs.image_motion.image_norm
+                , img->image_motion
                 , (uint)cam->imgs.size_norm);
             if (retcd < 0) {
                 MOTION_LOG(ERR, TYPE_EVENTS, SHOW_ERRNO
@@ -263,6 +263,7 @@ void vlp_putpipe(cls_camera *cam)
         }
     #else
         (void)cam;
+        (void)img;
     #endif
 }
 
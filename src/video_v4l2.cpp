@@ -24,13 +24,21 @@
 #include "rotate.hpp"
 #include "video_convert.hpp"
 #include "video_v4l2.hpp"
+#include "framepool.hpp"
 #include <sys/mman.h>
+#include <poll.h>
 
 #define MMAP_BUFFERS            4
 #define MIN_MMAP_BUFFERS        2
 
 #ifdef HAVE_V4L2
 
+static void *v4l2_handler(void *arg)
+{
+    ((cls_v4l2cam *)arg)->handler();
+    return nullptr;
+}
+
 void cls_v4l2cam::palette_add(uint p_v4l2id)
 {
     char    tmp4cc[5];
@@ -824,6 +832,8 @@ void cls_v4l2cam::set_mmap()
 /* Assign the resulting sizes to the camera context items */
 void cls_v4l2cam::set_imgs()
 {
+    int indx;
+
     if (fd_device == -1) {
         return;
     }
@@ -834,13 +844,22 @@ void cls_v4l2cam::set_imgs()
 
     convert = new cls_convert(cam, pixfmt_src, cam->cfg->width, cam->cfg->height);
 
+    for (indx = 0; indx < V4L2_RING_SIZE; indx++) {
+        ring[indx] = cam->pool->get((size_t)cam->imgs.size_norm);
+    }
+
 }
 
-/* Capture the image into the buffer */
+/*
+ * Capture the image into the buffer.  This runs on the capture thread so
+ * the ioctls are not done with xioctl which resets the camera watchdog.
+ * Returns 1 when no image arrived within a second.
+ */
 int cls_v4l2cam::capture()
 {
     int retcd;
     sigset_t set, old;
+    struct pollfd pfd;
 
     /* Block signals during IOCTL */
     sigemptyset(&set);
@@ -853,12 +872,27 @@ int cls_v4l2cam::capture()
     pthread_sigmask(SIG_BLOCK, &set, &old);
 
     if (pframe >= 0) {
-        retcd = xioctl(VIDIOC_QBUF, &vidbuf);
+        do {
+            retcd = ioctl(fd_device, VIDIOC_QBUF, &vidbuf);
+        } while ((retcd == -1) && (errno == EINTR));
         if (retcd == -1) {
-            MOTION_LOG(ERR, TYPE_VIDEO, SHOW_ERRNO, "VIDIOC_QBUF");
+            if ((cap_errs % 100) == 0) {
+                MOTION_LOG(ERR, TYPE_VIDEO, SHOW_ERRNO, "VIDIOC_QBUF");
+            }
             pthread_sigmask(SIG_UNBLOCK, &old, nullptr);
             return -1;
         }
+        pframe = -1;
+    }
+
+    /* Wait with a timeout so a stopped device does not block shutdown */
+    pfd.fd = fd_device;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    retcd = poll(&pfd, 1, 1000);
+    if ((retcd == 0) || ((retcd == -1) && (errno == EINTR))) {
+        pthread_sigmask(SIG_UNBLOCK, &old, nullptr);
+        return 1;
     }
 
     memset(&vidbuf, 0, sizeof(struct v4l2_buffer));
@@ -867,9 +901,13 @@ int cls_v4l2cam::capture()
     vidbuf.memory = V4L2_MEMORY_MMAP;
     vidbuf.bytesused = 0;
 
-    retcd = xioctl(VIDIOC_DQBUF, &vidbuf);
+    do {
+        retcd = ioctl(fd_device, VIDIOC_DQBUF, &vidbuf);
+    } while ((retcd == -1) && (errno == EINTR));
     if (retcd == -1) {
-        MOTION_LOG(ERR, TYPE_VIDEO, SHOW_ERRNO, "VIDIOC_DQBUF");
+        if ((cap_errs % 100) == 0) {
+            MOTION_LOG(ERR, TYPE_VIDEO, SHOW_ERRNO, "VIDIOC_DQBUF");
+        }
         pthread_sigmask(SIG_UNBLOCK, &old, nullptr);
         return -1;
     }
@@ -883,13 +921,146 @@ int cls_v4l2cam::capture()
 
 }
 
+/* Capture and convert images until stopped */
+void cls_v4l2cam::handler()
+{
+    int retcd, prev;
+
+    mythreadname_set("vc", cam->cfg->device_id, cam->cfg->device_name.c_str());
+
+    MOTION_LOG(INF, TYPE_VIDEO, NO_ERRNO, _("Capture thread started"));
+
+    while (handler_stop == false) {
+        retcd = capture();
+        if (retcd == 1) {
+            continue;
+        } else if (retcd != 0) {
+            /* capture() logs every 100th error.  Back off up to 0.8 seconds */
+            cap_errs++;
+            SLEEP(0, 100000000L << MIN(cap_errs - 1, 3));
+            continue;
+        }
+        if (cap_errs > 0) {
+            MOTION_LOG(NTC, TYPE_VIDEO, NO_ERRNO
+                , _("Capture resumed after %d errors"), cap_errs);
+            cap_errs = 0;
+        }
+
+        retcd = convert->process(ring[ring_back]
+            , buffers[vidbuf.index].ptr
+            , buffers[vidbuf.index].content_length);
+        if (retcd != 0) {
+            continue;
+        }
+
+        prev = ring_mid.exchange(ring_back | V4L2_RING_FRESH
+            , std::memory_order_acq_rel);
+        if ((prev & V4L2_RING_FRESH) != 0) {
+            /* The camera loop fell behind so give up the unread image */
+            drop_cnt.fetch_add(1, std::memory_order_relaxed);
+        }
+        ring_back = prev & ~V4L2_RING_FRESH;
+
+        pthread_mutex_lock(&mutex);
+            pthread_cond_signal(&cond_image);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    MOTION_LOG(INF, TYPE_VIDEO, NO_ERRNO, _("Capture thread stopped"));
+}
+
+void cls_v4l2cam::handler_startup()
+{
+    int retcd;
+
+    if (handler_running) {
+        return;
+    }
+
+    ring_back = 0;
+    ring_mid = 1;
+    ring_front = 2;
+    cap_errs = 0;
+    handler_stop = false;
+    retcd = pthread_create(&handler_thread, NULL, &v4l2_handler, this);
+    if (retcd != 0) {
+        MOTION_LOG(ERR, TYPE_VIDEO, NO_ERRNO, _("Unable to start capture thread."));
+        return;
+    }
+    handler_running = true;
+}
+
+void cls_v4l2cam::handler_shutdown()
+{
+    if (handler_running == false) {
+        return;
+    }
+    handler_stop = true;
+    pthread_join(handler_thread, NULL);
+    handler_running = false;
+}
+
+/* Wait up to a second for the capture thread to publish an image */
+int cls_v4l2cam::ring_wait()
+{
+    struct timespec ts;
+
+    if ((ring_mid.load(std::memory_order_acquire) & V4L2_RING_FRESH) != 0) {
+        return 0;
+    }
+    if (handler_running == false) {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec++;
+    pthread_mutex_lock(&mutex);
+        while ((ring_mid.load(std::memory_order_acquire) & V4L2_RING_FRESH) == 0) {
+            if (pthread_cond_timedwait(&cond_image, &mutex, &ts) == ETIMEDOUT) {
+                break;
+            }
+        }
+    pthread_mutex_unlock(&mutex);
+
+    if ((ring_mid.load(std::memory_order_acquire) & V4L2_RING_FRESH) == 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Report the images dropped because the camera loop fell behind */
+void cls_v4l2cam::ring_drops()
+{
+    uint64_t drops;
+
+    drops = drop_cnt.load(std::memory_order_relaxed);
+    if ((drops - drop_logged) >= 100) {
+        MOTION_LOG(INF, TYPE_VIDEO, NO_ERRNO
+            ,_("Dropped %llu images since the device was opened")
+            ,(unsigned long long)drops);
+        drop_logged = drops;
+    }
+}
+
 void cls_v4l2cam::init_vars()
 {
+    int indx;
+
     buffer_count= 0;
     pframe = -1;
     buffers = nullptr;
     convert = nullptr;
 
+    for (indx = 0; indx < V4L2_RING_SIZE; indx++) {
+        ring[indx] = nullptr;
+    }
+    ring_back = 0;
+    ring_mid = 1;
+    ring_front = 2;
+    drop_cnt = 0;
+    drop_logged = 0;
+    cap_errs = 0;
+
     params = new ctx_params;
     params->params_cnt = 0;
     util_parms_parse(params, "v4l2_params", cam->cfg->v4l2_params);
@@ -1082,6 +1253,14 @@ void cls_v4l2cam::stop_cam()
     MOTION_LOG(NTC, TYPE_VIDEO, NO_ERRNO
         ,_("Closing video device %s"), cam->cfg->v4l2_device.c_str());
 
+    handler_shutdown();
+
+    if (drop_cnt > 0) {
+        MOTION_LOG(INF, TYPE_VIDEO, NO_ERRNO
+            ,_("Dropped %llu images since the device was opened")
+            ,(unsigned long long)drop_cnt.load(std::memory_order_relaxed));
+    }
+
     p_type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
     if (fd_device != -1) {
@@ -1100,6 +1279,10 @@ void cls_v4l2cam::stop_cam()
         mydelete(convert);
     }
 
+    for (indx = 0; indx < V4L2_RING_SIZE; indx++) {
+        cam->pool->put(ring[indx]);
+    }
+
     mydelete(params);
 }
 
@@ -1126,6 +1309,7 @@ void cls_v4l2cam::start_cam()
     }
     cam->device_status = STATUS_OPENED;
 
+    handler_startup();
 }
 
 #endif /* HAVE_V4L2 */
@@ -1164,21 +1348,25 @@ void cls_v4l2cam::noimage()
 int cls_v4l2cam::next(ctx_image_data *img_data)
 {
     #ifdef HAVE_V4L2
-        int retcd;
+        u_char *img;
 
         cam->watchdog = cam->cfg->watchdog_tmo;
-        retcd = capture();
-        if (retcd != 0) {
+        if (ring_wait() != 0) {
             return CAPTURE_FAILURE;
         }
 
-        retcd = convert->process(
-            img_data->image_norm
-            , buffers[vidbuf.index].ptr
-            , buffers[vidbuf.index].content_length);
-        if (retcd != 0) {
-            return CAPTURE_FAILURE;
-        }
+        /*
+         * Take the newest image.  The ring buffers come from the camera
+         * pool so the slot keeps the image buffer given in exchange.
+         */
+        ring_front = ring_mid.exchange(ring_front, std::memory_order_acq_rel)
+            & ~V4L2_RING_FRESH;
+        img = ring[ring_front];
+        ring[ring_front] = img_data->image_norm;
+        img_data->image_norm = img;
+        img_data->buf->image_norm = img;
+
+        ring_drops();
 
         cam->rotate->process(img_data);
 
@@ -1192,6 +1380,10 @@ int cls_v4l2cam::next(ctx_image_data *img_data)
 cls_v4l2cam::cls_v4l2cam(cls_camera *p_cam)
 {
     cam = p_cam;
+    handler_running = false;
+    handler_stop = true;
+    pthread_mutex_init(&mutex, nullptr);
+    pthread_cond_init(&cond_image, nullptr);
     #ifdef HAVE_V4L2
         cam->watchdog = cam->cfg->watchdog_tmo * 3;
         start_cam();
@@ -1205,5 +1397,7 @@ cls_v4l2cam::~cls_v4l2cam()
     #ifdef HAVE_V4L2
         stop_cam();
     #endif
+    pthread_cond_destroy(&cond_image);
+    pthread_mutex_destroy(&mutex);
     cam->device_status = STATUS_CLOSED;
 }
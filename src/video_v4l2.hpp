@@ -19,6 +19,11 @@
 #ifndef _INCLUDE_VIDEO_V4L2_HPP_
 #define _INCLUDE_VIDEO_V4L2_HPP_
 
+#include <atomic>
+
+#define V4L2_RING_SIZE  3       /* Slots written, published and read */
+#define V4L2_RING_FRESH 4       /* Flag on ring_mid for an image not yet read */
+
 struct video_buff {
     unsigned char   *ptr;
     int             content_length;
@@ -53,6 +58,7 @@ class cls_v4l2cam {
         ~cls_v4l2cam();
         int next(ctx_image_data *img_data);
         void noimage();
+        void handler();
     private:
         cls_camera *cam;
         cls_convert *convert;
@@ -71,6 +77,30 @@ class cls_v4l2cam {
         int     pframe;
         int     reconnect_count;
 
+        /*
+         * Ring of converted images.  The capture thread converts into the
+         * ring_back slot and then swaps it with ring_mid.  The camera loop
+         * swaps ring_front with ring_mid when it is fresh and takes the
+         * buffer of the slot in exchange for its own image buffer so the
+         * image is not copied.  Each thread only touches its own slot and
+         * the swaps of ring_mid publish the buffers.  An image that is not
+         * read before the next one is published is dropped so the newest
+         * always wins.  The mutex and cond are only for the wait on an
+         * empty ring.
+         */
+        u_char                  *ring[V4L2_RING_SIZE];
+        std::atomic<int>        ring_mid;       /* Published slot and V4L2_RING_FRESH */
+        int                     ring_back;      /* Slot of the capture thread */
+        int                     ring_front;     /* Slot of the camera loop */
+        std::atomic<uint64_t>   drop_cnt;       /* Images replaced before they were read */
+        uint64_t                drop_logged;
+        std::atomic<bool>       handler_stop;
+        bool                    handler_running;
+        pthread_t               handler_thread;
+        int                     cap_errs;       /* Consecutive capture errors */
+        pthread_mutex_t         mutex;          /* For the wait on cond_image */
+        pthread_cond_t          cond_image;
+
         #ifdef HAVE_V4L2
             struct v4l2_capability      vidcap;
             struct v4l2_format          vidfmt;
@@ -103,6 +133,10 @@ class cls_v4l2cam {
             void set_mmap();
             void set_imgs();
             int capture();
+            void handler_startup();
+            void handler_shutdown();
+            int ring_wait();
+            void ring_drops();
             void log_types();
             void log_formats();
             void set_fps();
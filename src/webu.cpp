@@ -28,6 +28,7 @@
 #include "webu_post.hpp"
 #include "webu_file.hpp"
 #include "webu_stream.hpp"
+#include "webu_tsenc.hpp"
 #include "webu_mpegts.hpp"
 #include "video_v4l2.hpp"
 #include <cstdio>
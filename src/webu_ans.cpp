@@ -26,12 +26,15 @@
 #include "webu_ans.hpp"
 #include "webu_html.hpp"
 #include "webu_stream.hpp"
+#include "webu_tsenc.hpp"
 #include "webu_mpegts.hpp"
 #include "webu_json.hpp"
 #include "webu_text.hpp"
 #include "webu_post.hpp"
 #include "webu_file.hpp"
+#include "webu_getimg.hpp"
 #include "video_v4l2.hpp"
+#include "framepool.hpp"
 
 static mhdrslt webua_connection_values (void *cls
     , enum MHD_ValueKind kind, const char *src_key, const char *src_val)
@@ -1173,7 +1176,8 @@ void cls_webu_ans::answer_get()
         }
         webu_json->main();
 
-    } else if ((uri_cmd1 == "detection") || (uri_cmd1 == "action")) {
+    } else if ((uri_cmd1 == "detection") || (uri_cmd1 == "action") ||
+        (uri_cmd1 == "metrics")) {
         if (webu_text == nullptr) {
             webu_text = new cls_webu_text(this);
         }
@@ -1448,8 +1452,8 @@ void cls_webu_ans::deinit_counter()
                 (strm->jpg_cnct == 0) &&
                 (strm->ts_cnct == 0) &&
                 (p_cam->passflag)) {
-                    myfree(strm->img_data);
-                    myfree(strm->jpg_data);
+                    p_cam->pool->put(strm->img_data);
+                    webu_getimg_jpg_unref(strm->jpg);
             }
         pthread_mutex_unlock(&p_cam->stream.mutex);
     }
@@ -23,49 +23,124 @@
 #include "camera.hpp"
 #include "picture.hpp"
 #include "alg_sec.hpp"
+#include "framepool.hpp"
 #include "webu_getimg.hpp"
 
-/* NOTE:  These run on the camera thread. */
+/* NOTE:  The init and deinit run on the camera thread. */
+
+/* Get an image buffer for a jpg of up to jpg_max bytes */
+ctx_stream_jpg *webu_getimg_jpg_new(cls_framepool *pool, int jpg_max)
+{
+    ctx_stream_jpg *jpg;
+
+    jpg = new ctx_stream_jpg;
+    jpg->refcnt = 1;
+    jpg->pool = pool;
+    jpg->buf = pool->get((size_t)(STREAM_JPG_HDR + jpg_max + 2));
+    jpg->jpg_sz = 0;
+    jpg->part_off = STREAM_JPG_HDR;
+    jpg->part_sz = 0;
+
+    return jpg;
+}
+
+/* Put the multipart header and trailer around the encoded jpg */
+void webu_getimg_jpg_done(ctx_stream_jpg *jpg, int jpg_sz)
+{
+    char resp_head[STREAM_JPG_HDR];
+    int  header_len;
+
+    header_len = snprintf(resp_head, STREAM_JPG_HDR
+        ,"--BoundaryString\r\n"
+        "Content-type: image/jpeg\r\n"
+        "Content-Length: %9d\r\n\r\n"
+        ,jpg_sz);
+    jpg->jpg_sz = jpg_sz;
+    jpg->part_off = STREAM_JPG_HDR - header_len;
+    memcpy(jpg->buf + jpg->part_off, resp_head, (uint)header_len);
+    memcpy(jpg->buf + STREAM_JPG_HDR + jpg_sz, "\r\n", 2);
+    jpg->part_sz = header_len + jpg_sz + 2;
+}
+
+void webu_getimg_jpg_ref(ctx_stream_jpg *jpg)
+{
+    jpg->refcnt.fetch_add(1);
+}
+
+/* Drop the reference and clear the pointer */
+void webu_getimg_jpg_unref(ctx_stream_jpg *&jpg)
+{
+    if (jpg == nullptr) {
+        return;
+    }
+    if (jpg->refcnt.fetch_sub(1) == 1) {
+        jpg->pool->put(jpg->buf);
+        delete jpg;
+    }
+    jpg = nullptr;
+}
+
+/* Make the jpg the latest image of the stream and wake the connections */
+void webu_getimg_jpg_publish(ctx_stream *stream
+    , ctx_stream_data *strm, ctx_stream_jpg *jpg)
+{
+    ctx_stream_jpg *old;
+
+    pthread_mutex_lock(&stream->mutex);
+        old = strm->jpg;
+        strm->jpg = jpg;
+        strm->consumed = false;
+        strm->gen++;
+        pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->mutex);
+
+    webu_getimg_jpg_unref(old);
+}
 
 /* Initial the stream context items for the camera */
 void webu_getimg_init(cls_camera *cam)
 {
     cam->imgs.image_substream = NULL;
 
-    cam->stream.norm.jpg_sz = 0;
-    cam->stream.norm.jpg_data = NULL;
+    cam->stream.norm.jpg = NULL;
+    cam->stream.norm.gen = 0;
+    cam->stream.norm.tsenc = NULL;
     cam->stream.norm.jpg_cnct = 0;
     cam->stream.norm.ts_cnct = 0;
     cam->stream.norm.all_cnct = 0;
     cam->stream.norm.consumed = true;
     cam->stream.norm.img_data = NULL;
 
-    cam->stream.sub.jpg_sz = 0;
-    cam->stream.sub.jpg_data = NULL;
+    cam->stream.sub.jpg = NULL;
+    cam->stream.sub.gen = 0;
+    cam->stream.sub.tsenc = NULL;
     cam->stream.sub.jpg_cnct = 0;
     cam->stream.sub.ts_cnct = 0;
     cam->stream.sub.all_cnct = 0;
     cam->stream.sub.consumed = true;
     cam->stream.sub.img_data = NULL;
 
-    cam->stream.motion.jpg_sz = 0;
-    cam->stream.motion.jpg_data = NULL;
+    cam->stream.motion.jpg = NULL;
+    cam->stream.motion.gen = 0;
+    cam->stream.motion.tsenc = NULL;
     cam->stream.motion.jpg_cnct = 0;
     cam->stream.motion.ts_cnct = 0;
     cam->stream.motion.all_cnct = 0;
     cam->stream.motion.consumed = true;
     cam->stream.motion.img_data = NULL;
 
-    cam->stream.source.jpg_sz = 0;
-    cam->stream.source.jpg_data = NULL;
+    cam->stream.source.jpg = NULL;
+    cam->stream.source.gen = 0;
+    cam->stream.source.tsenc = NULL;
     cam->stream.source.jpg_cnct = 0;
     cam->stream.source.ts_cnct = 0;
     cam->stream.source.all_cnct = 0;
     cam->stream.source.consumed = true;
     cam->stream.source.img_data = NULL;
 
-    cam->stream.secondary.jpg_sz = 0;
-    cam->stream.secondary.jpg_data = NULL;
+    cam->stream.secondary.jpg = NULL;
+    cam->stream.secondary.gen = 0;
+    cam->stream.secondary.tsenc = NULL;
     cam->stream.secondary.jpg_cnct = 0;
     cam->stream.secondary.ts_cnct = 0;
     cam->stream.secondary.all_cnct = 0;
@@ -78,247 +153,230 @@ void webu_getimg_init(cls_camera *cam)
 void webu_getimg_deinit(cls_camera *cam)
 {
     /* NOTE:  This runs on the camera thread. */
-    myfree(cam->imgs.image_substream);
+    cam->pool->put(cam->imgs.image_substream);
 
     pthread_mutex_lock(&cam->stream.mutex);
-        myfree(cam->stream.norm.jpg_data);
-        myfree(cam->stream.sub.jpg_data);
-        myfree(cam->stream.motion.jpg_data);
-        myfree(cam->stream.source.jpg_data);
-        myfree(cam->stream.secondary.jpg_data);
-
-        myfree(cam->stream.norm.img_data) ;
-        myfree(cam->stream.sub.img_data) ;
-        myfree(cam->stream.motion.img_data) ;
-        myfree(cam->stream.source.img_data) ;
-        myfree(cam->stream.secondary.img_data) ;
+        webu_getimg_jpg_unref(cam->stream.norm.jpg);
+        webu_getimg_jpg_unref(cam->stream.sub.jpg);
+        webu_getimg_jpg_unref(cam->stream.motion.jpg);
+        webu_getimg_jpg_unref(cam->stream.source.jpg);
+        webu_getimg_jpg_unref(cam->stream.secondary.jpg);
+
+        cam->pool->put(cam->stream.norm.img_data);
+        cam->pool->put(cam->stream.sub.img_data);
+        cam->pool->put(cam->stream.motion.img_data);
+        cam->pool->put(cam->stream.source.img_data);
+        cam->pool->put(cam->stream.secondary.img_data);
     pthread_mutex_unlock(&cam->stream.mutex);
 
 }
 
-/* Get a normal image from the motion loop and compress it*/
-static void webu_getimg_norm(cls_camera *cam)
+/* Whether the stream has a jpg connection waiting for a new image */
+static bool webu_getimg_want(cls_camera *cam, ctx_stream_data *strm)
+{
+    bool retcd;
+
+    pthread_mutex_lock(&cam->stream.mutex);
+        retcd = ((strm->jpg_cnct > 0) && strm->consumed);
+    pthread_mutex_unlock(&cam->stream.mutex);
+
+    return retcd;
+}
+
+/* Copy the image for the mpegts and all camera connections */
+static void webu_getimg_copy(cls_camera *cam, ctx_stream_data *strm
+    , u_char *image, int image_sz)
+{
+    pthread_mutex_lock(&cam->stream.mutex);
+        if ((strm->ts_cnct > 0) || (strm->all_cnct > 0)) {
+            if (strm->img_data == NULL) {
+                strm->img_data = cam->pool->get((size_t)cam->imgs.size_norm);
+                /* The all camera view waits for the first image */
+                pthread_cond_broadcast(&cam->stream.cond);
+            }
+            memcpy(strm->img_data, image, (uint)image_sz);
+        }
+    pthread_mutex_unlock(&cam->stream.mutex);
+}
+
+/* Encode the image into a new jpg and publish it */
+static void webu_getimg_jpg(cls_camera *cam, ctx_stream_data *strm
+    , u_char *image, int image_sz, int width, int height)
 {
-    if ((cam->stream.norm.jpg_cnct == 0) &&
-        (cam->stream.norm.ts_cnct == 0) &&
-        (cam->stream.norm.all_cnct == 0)) {
+    ctx_stream_jpg *jpg;
+    int jpg_sz;
+
+    jpg = webu_getimg_jpg_new(cam->pool, image_sz);
+    jpg_sz = cam->picture->put_memory(jpg->buf + STREAM_JPG_HDR, image_sz
+        , image, cam->cfg->stream_quality, width, height);
+    if (jpg_sz <= 0) {
+        webu_getimg_jpg_unref(jpg);
         return;
     }
+    webu_getimg_jpg_done(jpg, jpg_sz);
+    webu_getimg_jpg_publish(&cam->stream, strm, jpg);
+}
 
-    if (cam->stream.norm.jpg_cnct > 0) {
-        if (cam->stream.norm.jpg_data == NULL) {
-            cam->stream.norm.jpg_data =(unsigned char*)
-                mymalloc((uint)cam->imgs.size_norm);
-        }
-        if (cam->current_image->image_norm != NULL && cam->stream.norm.consumed) {
-            cam->stream.norm.jpg_sz = cam->picture->put_memory(
-                cam->stream.norm.jpg_data
-                ,cam->imgs.size_norm
-                ,cam->current_image->image_norm
-                ,cam->cfg->stream_quality
-                ,cam->imgs.width
-                ,cam->imgs.height);
-            cam->stream.norm.consumed = false;
-        }
+/* Get a normal image from the motion loop and compress it*/
+static void webu_getimg_norm(cls_camera *cam, ctx_image_data *img)
+{
+    if (img->image_norm == NULL) {
+        return;
     }
-    if ((cam->stream.norm.ts_cnct > 0) || (cam->stream.norm.all_cnct > 0)) {
-        if (cam->stream.norm.img_data == NULL) {
-            cam->stream.norm.img_data =(unsigned char*)
-                mymalloc((uint)cam->imgs.size_norm);
-        }
-        memcpy(cam->stream.norm.img_data, cam->current_image->image_norm
-            , (uint)cam->imgs.size_norm);
+    if (webu_getimg_want(cam, &cam->stream.norm)) {
+        webu_getimg_jpg(cam, &cam->stream.norm, img->image_norm
+            , cam->imgs.size_norm, cam->imgs.width, cam->imgs.height);
     }
+    webu_getimg_copy(cam, &cam->stream.norm, img->image_norm
+        , cam->imgs.size_norm);
 }
 
 /* Get a substream image from the motion loop and compress it*/
-static void webu_getimg_sub(cls_camera *cam)
+static void webu_getimg_sub(cls_camera *cam, ctx_image_data *img)
 {
     int subsize;
+    bool want;
 
-    if ((cam->stream.sub.jpg_cnct == 0) &&
-        (cam->stream.sub.ts_cnct == 0) &&
-        (cam->stream.sub.all_cnct == 0)) {
+    if (img->image_norm == NULL) {
         return;
     }
 
-    if (cam->stream.sub.jpg_cnct > 0) {
-        if (cam->stream.sub.jpg_data == NULL) {
-            cam->stream.sub.jpg_data =(unsigned char*)
-                mymalloc((uint)cam->imgs.size_norm);
-        }
-        if (cam->current_image->image_norm != NULL && cam->stream.sub.consumed) {
-            /* Resulting substream image must be multiple of 8 */
-            if (((cam->imgs.width  % 16) == 0)  &&
-                ((cam->imgs.height % 16) == 0)) {
-
-                subsize = ((cam->imgs.width / 2) * (cam->imgs.height / 2) * 3 / 2);
-                if (cam->imgs.image_substream == NULL) {
-                    cam->imgs.image_substream =(unsigned char*)
-                        mymalloc((uint)subsize);
-                }
-                cam->picture->scale_img(cam->imgs.width
-                    ,cam->imgs.height
-                    ,cam->current_image->image_norm
-                    ,cam->imgs.image_substream);
-                cam->stream.sub.jpg_sz = cam->picture->put_memory(
-                    cam->stream.sub.jpg_data
-                    ,subsize
-                    ,cam->imgs.image_substream
-                    ,cam->cfg->stream_quality
-                    ,(cam->imgs.width / 2)
-                    ,(cam->imgs.height / 2));
-            } else {
-                /* Substream was not multiple of 8 so send full image*/
-                cam->stream.sub.jpg_sz = cam->picture->put_memory(
-                    cam->stream.sub.jpg_data
-                    ,cam->imgs.size_norm
-                    ,cam->current_image->image_norm
-                    ,cam->cfg->stream_quality
-                    ,cam->imgs.width
-                    ,cam->imgs.height);
-            }
-            cam->stream.sub.consumed = false;
-        }
+    pthread_mutex_lock(&cam->stream.mutex);
+        want = ((cam->stream.sub.jpg_cnct > 0) ||
+            (cam->stream.sub.ts_cnct > 0) ||
+            (cam->stream.sub.all_cnct > 0));
+    pthread_mutex_unlock(&cam->stream.mutex);
+    if (want == false) {
+        return;
     }
 
-    if ((cam->stream.sub.ts_cnct > 0) || (cam->stream.sub.all_cnct > 0)) {
-        if (cam->stream.sub.img_data == NULL) {
-            cam->stream.sub.img_data =(unsigned char*)mymalloc((uint)cam->imgs.size_norm);
+    /* Resulting substream image must be multiple of 8 */
+    if (((cam->imgs.width  % 16) == 0)  &&
+        ((cam->imgs.height % 16) == 0)) {
+        subsize = ((cam->imgs.width / 2) * (cam->imgs.height / 2) * 3 / 2);
+        if (cam->imgs.image_substream == NULL) {
+            cam->imgs.image_substream = cam->pool->get((size_t)subsize);
         }
-        if (((cam->imgs.width  % 16) == 0)  &&
-            ((cam->imgs.height % 16) == 0)) {
-            subsize = ((cam->imgs.width / 2) * (cam->imgs.height / 2) * 3 / 2);
-            if (cam->imgs.image_substream == NULL) {
-                cam->imgs.image_substream =(unsigned char*)mymalloc((uint)subsize);
-            }
-            cam->picture->scale_img(cam->imgs.width
-                ,cam->imgs.height
-                ,cam->current_image->image_norm
-                ,cam->imgs.image_substream);
-            memcpy(cam->stream.sub.img_data, cam->imgs.image_substream, (uint)subsize);
-        } else {
-            memcpy(cam->stream.sub.img_data, cam->current_image->image_norm
-                , (uint)cam->imgs.size_norm);
+        cam->picture->scale_img(cam->imgs.width
+            ,cam->imgs.height
+            ,img->image_norm
+            ,cam->imgs.image_substream);
+        if (webu_getimg_want(cam, &cam->stream.sub)) {
+            webu_getimg_jpg(cam, &cam->stream.sub, cam->imgs.image_substream
+                , subsize, (cam->imgs.width / 2), (cam->imgs.height / 2));
         }
+        webu_getimg_copy(cam, &cam->stream.sub, cam->imgs.image_substream
+            , subsize);
+    } else {
+        /* Substream was not multiple of 8 so send full image*/
+        if (webu_getimg_want(cam, &cam->stream.sub)) {
+            webu_getimg_jpg(cam, &cam->stream.sub, img->image_norm
+                , cam->imgs.size_norm, cam->imgs.width, cam->imgs.height);
+        }
+        webu_getimg_copy(cam, &cam->stream.sub, img->image_norm
+            , cam->imgs.size_norm);
     }
-
 }
 
 /* Get a motion image from the motion loop and compress it*/
-static void webu_getimg_motion(cls_camera *cam)
+static void webu_getimg_motion(cls_camera *cam, ctx_image_data *img)
 {
-    if ((cam->stream.motion.jpg_cnct == 0) &&
-        (cam->stream.motion.ts_cnct == 0) &&
-        (cam->stream.motion.all_cnct == 0)) {
+    if (img->image_motion == NULL) {
         return;
     }
-
-    if (cam->stream.motion.jpg_cnct > 0) {
-        if (cam->stream.motion.jpg_data == NULL) {
-            cam->stream.motion.jpg_data =(unsigned char*)mymalloc((uint)cam->imgs.size_norm);
-        }
-        if (cam->imgs.image_motion.image_norm != NULL  && cam->stream.motion.consumed) {
-            cam->stream.motion.jpg_sz = cam->picture->put_memory(
-                cam->stream.motion.jpg_data
-                ,cam->imgs.size_norm
-                ,cam->imgs.image_motion.image_norm
-                ,cam->cfg->stream_quality
-                ,cam->imgs.width
-                ,cam->imgs.height);
-            cam->stream.motion.consumed = false;
-        }
-    }
-    if ((cam->stream.motion.ts_cnct > 0) || (cam->stream.motion.all_cnct > 0)) {
-        if (cam->stream.motion.img_data == NULL) {
-            cam->stream.motion.img_data =(unsigned char*)mymalloc((uint)cam->imgs.size_norm);
-        }
-        memcpy(cam->stream.motion.img_data
-            , cam->imgs.image_motion.image_norm
-            , (uint)cam->imgs.size_norm);
+    if (webu_getimg_want(cam, &cam->stream.motion)) {
+        webu_getimg_jpg(cam, &cam->stream.motion, img->image_motion
+            , cam->imgs.size_norm, cam->imgs.width, cam->imgs.height);
     }
+    webu_getimg_copy(cam, &cam->stream.motion, img->image_motion
+        , cam->imgs.size_norm);
 }
 
 /* Get a source image from the motion loop and compress it*/
-static void webu_getimg_source(cls_camera *cam)
+static void webu_getimg_source(cls_camera *cam, ctx_image_data *img)
 {
-    if ((cam->stream.source.jpg_cnct == 0) &&
-        (cam->stream.source.ts_cnct == 0) &&
-        (cam->stream.source.all_cnct == 0)) {
+    if (img->image_virgin == NULL) {
         return;
     }
-
-    if (cam->stream.source.jpg_cnct > 0) {
-        if (cam->stream.source.jpg_data == NULL) {
-            cam->stream.source.jpg_data =(unsigned char*)mymalloc((uint)cam->imgs.size_norm);
-        }
-        if (cam->imgs.image_virgin != NULL && cam->stream.source.consumed) {
-            cam->stream.source.jpg_sz = cam->picture->put_memory(
-                cam->stream.source.jpg_data
-                ,cam->imgs.size_norm
-                ,cam->imgs.image_virgin
-                ,cam->cfg->stream_quality
-                ,cam->imgs.width
-                ,cam->imgs.height);
-            cam->stream.source.consumed = false;
-        }
-    }
-    if ((cam->stream.source.ts_cnct > 0) || (cam->stream.source.all_cnct > 0)) {
-        if (cam->stream.source.img_data == NULL) {
-            cam->stream.source.img_data =(unsigned char*)mymalloc((uint)cam->imgs.size_norm);
-        }
-        memcpy(cam->stream.source.img_data
-            , cam->imgs.image_virgin
-            , (uint)cam->imgs.size_norm);
+    if (webu_getimg_want(cam, &cam->stream.source)) {
+        webu_getimg_jpg(cam, &cam->stream.source, img->image_virgin
+            , cam->imgs.size_norm, cam->imgs.width, cam->imgs.height);
     }
+    webu_getimg_copy(cam, &cam->stream.source, img->image_virgin
+        , cam->imgs.size_norm);
 }
 
 /* Get a secondary image from the motion loop and compress it*/
-static void webu_getimg_secondary(cls_camera *cam)
+static void webu_getimg_secondary(cls_camera *cam, ctx_image_data *img)
 {
-     if ((cam->stream.secondary.jpg_cnct == 0) &&
-         (cam->stream.secondary.ts_cnct == 0) &&
-         (cam->stream.secondary.all_cnct == 0)) {
-        return;
-    }
+    ctx_stream_jpg *jpg;
+    int jpg_sz;
+    bool want;
+
+    pthread_mutex_lock(&cam->stream.mutex);
+        want = (cam->stream.secondary.jpg_cnct > 0);
+    pthread_mutex_unlock(&cam->stream.mutex);
 
-    if (cam->stream.secondary.jpg_cnct > 0) {
+    if (want) {
         if (cam->imgs.size_secondary>0) {
+            jpg = webu_getimg_jpg_new(cam->pool, cam->imgs.size_norm);
             pthread_mutex_lock(&cam->algsec->mutex);
-                if (cam->stream.secondary.jpg_data == NULL) {
-                    cam->stream.secondary.jpg_data =(unsigned char*)
-                        mymalloc((uint)cam->imgs.size_norm);
-                }
-
-                memcpy(cam->stream.secondary.jpg_data
-                    , cam->imgs.image_secondary
-                    , (uint)cam->imgs.size_secondary);
-                cam->stream.secondary.jpg_sz = cam->imgs.size_secondary;
+                jpg_sz = cam->imgs.size_secondary;
+                memcpy(jpg->buf + STREAM_JPG_HDR
+                    , cam->imgs.image_secondary, (uint)jpg_sz);
             pthread_mutex_unlock(&cam->algsec->mutex);
+            webu_getimg_jpg_done(jpg, jpg_sz);
+            webu_getimg_jpg_publish(&cam->stream
+                , &cam->stream.secondary, jpg);
         } else {
-            myfree(cam->stream.secondary.jpg_data);
+            webu_getimg_jpg_publish(&cam->stream
+                , &cam->stream.secondary, nullptr);
         }
     }
-    if ((cam->stream.secondary.ts_cnct > 0) || (cam->stream.secondary.all_cnct > 0)) {
-        if (cam->stream.secondary.img_data == NULL) {
-            cam->stream.secondary.img_data =(unsigned char*)
-                mymalloc((uint)cam->imgs.size_norm);
-        }
-        memcpy(cam->stream.secondary.img_data
-            , cam->current_image->image_norm, (uint)cam->imgs.size_norm);
+    if (img->image_norm != NULL) {
+        webu_getimg_copy(cam, &cam->stream.secondary, img->image_norm
+            , cam->imgs.size_norm);
     }
 
 }
 
-/* Get image from the motion loop and compress it*/
-void webu_getimg_main(cls_camera *cam)
+/* Whether any connection is using the images of the camera */
+bool webu_getimg_active(cls_camera *cam)
 {
-    /*This is on the camera thread */
+    ctx_stream_data *strm[5];
+    int indx;
+    bool active;
+
+    strm[0] = &cam->stream.norm;
+    strm[1] = &cam->stream.sub;
+    strm[2] = &cam->stream.motion;
+    strm[3] = &cam->stream.source;
+    strm[4] = &cam->stream.secondary;
+    active = false;
     pthread_mutex_lock(&cam->stream.mutex);
-        webu_getimg_norm(cam);
-        webu_getimg_sub(cam);
-        webu_getimg_motion(cam);
-        webu_getimg_source(cam);
-        webu_getimg_secondary(cam);
+        for (indx = 0; indx < 5; indx++) {
+            if ((strm[indx]->jpg_cnct > 0) ||
+                (strm[indx]->ts_cnct > 0) ||
+                (strm[indx]->all_cnct > 0)) {
+                active = true;
+                break;
+            }
+        }
     pthread_mutex_unlock(&cam->stream.mutex);
+    return active;
+}
+
+/*
+ * Get image from the motion loop and compress it.  This runs on the
+ * stream stage of the camera.  The stream mutex is only held to check
+ * the connections and to publish the results so the web threads do not
+ * wait for the encoding.
+ */
+void webu_getimg_main(cls_camera *cam, ctx_image_data *img)
+{
+    webu_getimg_norm(cam, img);
+    webu_getimg_sub(cam, img);
+    webu_getimg_motion(cam, img);
+    webu_getimg_source(cam, img);
+    webu_getimg_secondary(cam, img);
 }
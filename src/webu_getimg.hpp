@@ -21,6 +21,13 @@
 
     void webu_getimg_init(cls_camera *cam);
     void webu_getimg_deinit(cls_camera *cam);
-    void webu_getimg_main(cls_camera *cam);
+    void webu_getimg_main(cls_camera *cam, ctx_image_data *img);
+    bool webu_getimg_active(cls_camera *cam);
+    ctx_stream_jpg *webu_getimg_jpg_new(cls_framepool *pool, int jpg_max);
+    void webu_getimg_jpg_done(ctx_stream_jpg *jpg, int jpg_sz);
+    void webu_getimg_jpg_ref(ctx_stream_jpg *jpg);
+    void webu_getimg_jpg_unref(ctx_stream_jpg *&jpg);
+    void webu_getimg_jpg_publish(ctx_stream *stream
+        , ctx_stream_data *strm, ctx_stream_jpg *jpg);
 
 #endif
@@ -28,6 +28,8 @@
 #include "dbse.hpp"
 #include "libcam.hpp"
 #include "json_parse.hpp"
+#include "metrics.hpp"
+#include "pacer.hpp"
 #include <map>
 #include <algorithm>
 #include <vector>
@@ -148,6 +150,8 @@ void cls_webu_json::parms_item_detail(cls_config *conf, std::string pNm)
         util_parms_parse(params, pNm, conf->cleandir_params);
     } else if (pNm == "secondary_params") {
         util_parms_parse(params, pNm, conf->secondary_params);
+    } else if (pNm == "detect_params") {
+        util_parms_parse(params, pNm, conf->parm_cam.detect_params);
     } else if (pNm == "webcontrol_actions") {
         util_parms_parse(params, pNm, conf->webcontrol_actions);
     } else if (pNm == "webcontrol_headers") {
@@ -522,6 +526,11 @@ void cls_webu_json::status_vars(int indx_cam)
     webua->resp_page += ",\"width\":" + std::to_string(cam->imgs.width);
     webua->resp_page += ",\"height\":" + std::to_string(cam->imgs.height);
     webua->resp_page += ",\"fps\":" + std::to_string(cam->lastrate);
+    snprintf(buf, sizeof(buf), "%.2f"
+        , cam->pacer->fps.load(std::memory_order_relaxed));
+    webua->resp_page += ",\"fps_actual\":" + std::string(buf);
+    webua->resp_page += ",\"deadlines_missed\":" +
+        std::to_string(cam->pacer->missed.load(std::memory_order_relaxed));
 
     clock_gettime(CLOCK_REALTIME, &curr_ts);
     localtime_r(&curr_ts.tv_sec, &timestamp_tm);
@@ -558,6 +567,9 @@ void cls_webu_json::status_vars(int indx_cam)
 
     webua->resp_page += ",\"user_pause\":\"" + cam->user_pause +"\"";
 
+    webua->resp_page += ",\"metrics\":";
+    cam->metrics->json(webua->resp_page);
+
     /* Add supportedControls for libcamera capability discovery */
     #ifdef HAVE_LIBCAM
     if (cam->has_libcam()) {
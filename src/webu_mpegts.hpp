@@ -23,7 +23,6 @@
         public:
             cls_webu_mpegts(cls_webu_ans *p_webua, cls_webu_stream *p_webus);
             ~cls_webu_mpegts();
-            int avio_buf(myuint *buf, int buf_size);
             ssize_t response(char *buf, size_t max);
             mhdrslt main();
 
@@ -32,19 +31,8 @@
             cls_webu        *webu;
             cls_webu_ans    *webua;
             cls_webu_stream *webus;
-
-            AVFrame         *picture;
-            AVFormatContext *fmtctx;
-            AVCodecContext  *ctx_codec;
-            size_t          stream_pos;     /* Stream position of sent image */
-            struct timespec start_time;     /* Start time of the stream*/
-            struct timespec st_mono_time;
-
-            int pic_send(unsigned char *img);
-            int pic_get();
-            void resetpos();
-            int getimg();
-            int open_mpegts();
+            cls_webu_tsenc  *tsenc;     /* Encoder shared with the other connections */
+            ctx_tsenc_rd    rd;
     };
 
 #endif /* _INCLUDE_WEBU_MPEGTS_HPP_ */
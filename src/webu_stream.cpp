@@ -26,9 +26,12 @@
 #include "webu.hpp"
 #include "webu_ans.hpp"
 #include "webu_stream.hpp"
+#include "webu_getimg.hpp"
+#include "webu_tsenc.hpp"
 #include "webu_mpegts.hpp"
 #include "alg_sec.hpp"
 #include "jpegutils.hpp"
+#include "pacer.hpp"
 
 static ssize_t webu_mjpeg_response (void *cls, uint64_t pos, char *buf, size_t max)
 {
@@ -56,68 +59,16 @@ void cls_webu_stream::set_fps()
 /* Sleep required time to get to the user requested framerate for the stream */
 void cls_webu_stream::delay()
 {
-    long   stream_rate;
-    struct timespec time_curr;
-    long   stream_delay;
-
     if (check_finish()) {
         return;
     }
 
-    clock_gettime(CLOCK_MONOTONIC, &time_curr);
-
-    /* The stream rate MUST be less than 1000000000 otherwise undefined behaviour
-     * will occur with the SLEEP function.
-     */
-    stream_delay = ((time_curr.tv_nsec - time_last.tv_nsec)) +
-        ((time_curr.tv_sec - time_last.tv_sec)*1000000000);
-    if (stream_delay < 0)  {
-        stream_delay = 0;
-    }
-    if (stream_delay > 1000000000 ) {
-        stream_delay = 1000000000;
-    }
-
     if (stream_fps >= 1) {
-        stream_rate = ( (1000000000 / stream_fps) - stream_delay);
-        if ((stream_rate > 0) && (stream_rate < 1000000000)) {
-            SLEEP(0,stream_rate);
-        } else if (stream_rate == 1000000000) {
-            SLEEP(1,0);
-        }
+        pacer->wait(stream_fps);
     }
     clock_gettime(CLOCK_MONOTONIC, &time_last);
 }
 
-void cls_webu_stream::one_buffer()
-{
-    if (webua->cam == NULL) {
-        return;
-    }
-    if (resp_size < (size_t)webua->cam->imgs.size_norm) {
-        if (resp_image != NULL) {
-            myfree(resp_image);
-        }
-        resp_image = (unsigned char*) mymalloc((uint)webua->cam->imgs.size_norm);
-        memset(resp_image,'\0', (uint)webua->cam->imgs.size_norm);
-        resp_size = (uint)webua->cam->imgs.size_norm;
-        resp_used = 0;
-    }
-}
-
-void cls_webu_stream::all_buffer()
-{
-    if (resp_size < (size_t)app->allcam->all_sizes.dst_sz) {
-        if (resp_image != nullptr) {
-            myfree(resp_image);
-        }
-        resp_size = (uint)app->allcam->all_sizes.dst_sz;
-        resp_image = (unsigned char*) mymalloc(resp_size);
-        memset(resp_image, '\0', resp_size);
-        resp_used = 0;
-    }
-}
-
 bool cls_webu_stream::check_finish()
 {
     if (webu->finish){
@@ -134,23 +85,46 @@ bool cls_webu_stream::check_finish()
     return false;
 }
 
+/*
+ * Wait with the stream mutex held until an image newer than the last one
+ * sent is published.  Gives up after a second so the caller can check
+ * whether the connection or camera has finished.
+ */
+bool cls_webu_stream::wait_img(ctx_stream *stream, ctx_stream_data *strm)
+{
+    struct timespec ts;
+
+    mycond_deadline(&ts, 1000000000L);
+    while (strm->gen == gen_sent) {
+        if (webu->finish) {
+            return false;
+        }
+        if (pthread_cond_timedwait(&stream->cond, &stream->mutex, &ts) == ETIMEDOUT) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool cls_webu_stream::all_ready()
 {
-    int indx, indx1;
+    int indx;
+    struct timespec ts;
     cls_camera *p_cam;
 
+    mycond_deadline(&ts, 1000000000L);
     for (indx=0; indx<app->cam_cnt; indx++) {
         p_cam = app->cam_list[indx];
         if ((p_cam->device_status == STATUS_OPENED) &&
             (p_cam->passflag == false)) {
-            indx1 = 0;
-            while (indx1 < 1000) {
-                SLEEP(0, 1000);
-                if (p_cam->passflag) {
-                    break;
+            pthread_mutex_lock(&p_cam->stream.mutex);
+                while (p_cam->passflag == false) {
+                    if (pthread_cond_timedwait(&p_cam->stream.cond
+                        , &p_cam->stream.mutex, &ts) == ETIMEDOUT) {
+                        break;
+                    }
                 }
-                indx1++;
-            }
+            pthread_mutex_unlock(&p_cam->stream.mutex);
             if (p_cam->passflag == false) {
                 MOTION_LOG(DBG, TYPE_STREAM, NO_ERRNO
                     , "Camera %d not ready", p_cam->cfg->device_id);
@@ -169,8 +143,6 @@ bool cls_webu_stream::all_ready()
 
 void cls_webu_stream::mjpeg_all_img()
 {
-    char resp_head[80];
-    int  header_len;
     ctx_stream_data *strm;
 
     if (check_finish()) {
@@ -181,10 +153,6 @@ void cls_webu_stream::mjpeg_all_img()
         return;
     }
 
-    all_buffer();
-
-    memset(resp_image, '\0', resp_size);
-
     /* Assign to a local pointer the stream we want */
     if (webua->app == NULL) {
         return;
@@ -202,42 +170,32 @@ void cls_webu_stream::mjpeg_all_img()
         return;
     }
 
-    /* Copy jpg from the motion loop thread */
+    /* Take a reference on the next jpg from the all camera thread */
     pthread_mutex_lock(&webua->app->allcam->stream.mutex);
         set_fps();
-        if (strm->jpg_data == NULL) {
+        if ((wait_img(&webua->app->allcam->stream, strm) == false) ||
+            (strm->jpg == NULL)) {
             pthread_mutex_unlock(&webua->app->allcam->stream.mutex);
             return;
         }
-        header_len = snprintf(resp_head, 80
-            ,"--BoundaryString\r\n"
-            "Content-type: image/jpeg\r\n"
-            "Content-Length: %9d\r\n\r\n"
-            ,strm->jpg_sz);
-        memcpy(resp_image, resp_head, (uint)header_len);
-        memcpy(resp_image + header_len
-            , strm->jpg_data
-            , (uint)strm->jpg_sz);
-        /* Copy in the terminator after the jpg data at the end*/
-        memcpy(resp_image + header_len + strm->jpg_sz,"\r\n",2);
-        resp_used =(uint)(header_len + strm->jpg_sz + 2);
+        webu_getimg_jpg_ref(strm->jpg);
+        resp_jpg = strm->jpg;
+        gen_sent = strm->gen;
         strm->consumed = true;
     pthread_mutex_unlock(&webua->app->allcam->stream.mutex);
 
+    resp_used = (uint)resp_jpg->part_sz;
+
 }
 
 void cls_webu_stream::mjpeg_one_img()
 {
-    char resp_head[80];
-    int  header_len;
     ctx_stream_data *strm;
 
     if (check_finish()) {
         return;
     }
 
-    memset(resp_image, '\0', resp_size);
-
     /* Assign to a local pointer the stream we want */
     if (webua->cam == NULL) {
         return;
@@ -255,28 +213,22 @@ void cls_webu_stream::mjpeg_one_img()
         return;
     }
 
-    /* Copy jpg from the motion loop thread */
+    /* Take a reference on the next jpg from the motion loop thread */
     pthread_mutex_lock(&webua->cam->stream.mutex);
         set_fps();
-        if (strm->jpg_data == NULL) {
+        if ((wait_img(&webua->cam->stream, strm) == false) ||
+            (strm->jpg == NULL)) {
             pthread_mutex_unlock(&webua->cam->stream.mutex);
             return;
         }
-        header_len = snprintf(resp_head, 80
-            ,"--BoundaryString\r\n"
-            "Content-type: image/jpeg\r\n"
-            "Content-Length: %9d\r\n\r\n"
-            ,strm->jpg_sz);
-        memcpy(resp_image, resp_head, (uint)header_len);
-        memcpy(resp_image + header_len
-            , strm->jpg_data
-            , (uint)strm->jpg_sz);
-        /* Copy in the terminator after the jpg data at the end*/
-        memcpy(resp_image + header_len + strm->jpg_sz,"\r\n",2);
-        resp_used =(uint)(header_len + strm->jpg_sz + 2);
+        webu_getimg_jpg_ref(strm->jpg);
+        resp_jpg = strm->jpg;
+        gen_sent = strm->gen;
         strm->consumed = true;
     pthread_mutex_unlock(&webua->cam->stream.mutex);
 
+    resp_used = (uint)resp_jpg->part_sz;
+
 }
 
 ssize_t cls_webu_stream::mjpeg_response (char *buf, size_t max)
@@ -293,6 +245,7 @@ ssize_t cls_webu_stream::mjpeg_response (char *buf, size_t max)
 
         stream_pos = 0;
         resp_used = 0;
+        webu_getimg_jpg_unref(resp_jpg);
 
         if (webua->device_id == 0) {
             mjpeg_all_img();
@@ -311,7 +264,7 @@ ssize_t cls_webu_stream::mjpeg_response (char *buf, size_t max)
         sent_bytes = resp_used - stream_pos;
     }
 
-    memcpy(buf, resp_image + stream_pos, sent_bytes);
+    memcpy(buf, resp_jpg->buf + resp_jpg->part_off + stream_pos, sent_bytes);
 
     stream_pos = stream_pos + sent_bytes;
     if (stream_pos >= resp_used) {
@@ -373,10 +326,8 @@ void cls_webu_stream::static_all_img()
         return;
     }
 
-    all_buffer();
-
     resp_used = 0;
-    memset(resp_image, '\0', resp_size);
+    webu_getimg_jpg_unref(resp_jpg);
 
     /* Assign to a local pointer the stream we want */
     if (webua->cnct_type == WEBUI_CNCT_JPG_FULL) {
@@ -394,17 +345,21 @@ void cls_webu_stream::static_all_img()
     }
 
     pthread_mutex_lock(&webua->app->allcam->stream.mutex);
-        if (strm->jpg_data == NULL) {
+        if (strm->jpg == NULL) {
+            gen_sent = strm->gen;
+            wait_img(&webua->app->allcam->stream, strm);
+        }
+        if (strm->jpg == NULL) {
             pthread_mutex_unlock(&webua->app->allcam->stream.mutex);
             return;
         }
-        memcpy(resp_image
-            , strm->jpg_data
-            , (uint)strm->jpg_sz);
-        resp_used =(uint)strm->jpg_sz;
+        webu_getimg_jpg_ref(strm->jpg);
+        resp_jpg = strm->jpg;
         strm->consumed = true;
     pthread_mutex_unlock(&webua->app->allcam->stream.mutex);
 
+    resp_used = (uint)resp_jpg->jpg_sz;
+
 }
 
 /* Increment the jpg stream counters */
@@ -430,14 +385,6 @@ void cls_webu_stream::jpg_cnct()
         strm->jpg_cnct++;
     pthread_mutex_unlock(&webua->cam->stream.mutex);
 
-
-    if (strm->jpg_cnct == 1) {
-        /* This is the first connection so we need to wait half a sec
-         * so that the motion loop on the other thread can update image
-         */
-        SLEEP(0,500000000L);
-    }
-
 }
 
 /* Obtain the current image for the camera.*/
@@ -445,10 +392,8 @@ void cls_webu_stream::static_one_img()
 {
     ctx_stream_data *strm;
 
-    one_buffer();
-
     resp_used = 0;
-    memset(resp_image, '\0', resp_size);
+    webu_getimg_jpg_unref(resp_jpg);
 
     /* Assign to a local pointer the stream we want */
     if (webua->cam == NULL) {
@@ -468,17 +413,21 @@ void cls_webu_stream::static_one_img()
     }
 
     pthread_mutex_lock(&webua->cam->stream.mutex);
-        if (strm->jpg_data == NULL) {
+        if (strm->jpg == NULL) {
+            gen_sent = strm->gen;
+            wait_img(&webua->cam->stream, strm);
+        }
+        if (strm->jpg == NULL) {
             pthread_mutex_unlock(&webua->cam->stream.mutex);
             return;
         }
-        memcpy(resp_image
-            , strm->jpg_data
-            , (uint)strm->jpg_sz);
-        resp_used =(uint)strm->jpg_sz;
+        webu_getimg_jpg_ref(strm->jpg);
+        resp_jpg = strm->jpg;
         strm->consumed = true;
     pthread_mutex_unlock(&webua->cam->stream.mutex);
 
+    resp_used = (uint)resp_jpg->jpg_sz;
+
 }
 
 /* Increment the transport stream counters */
@@ -502,13 +451,6 @@ void cls_webu_stream::ts_cnct()
     pthread_mutex_lock(&webua->cam->stream.mutex);
         strm->ts_cnct++;
     pthread_mutex_unlock(&webua->cam->stream.mutex);
-
-    if (strm->ts_cnct == 1) {
-        /* This is the first connection so we need to wait half a sec
-         * so that the motion loop on the other thread can update image
-         */
-        SLEEP(0,500000000L);
-    }
 }
 
 /* Assign the type of stream that is being answered*/
@@ -611,8 +553,9 @@ mhdrslt cls_webu_stream::stream_static()
     }
 
     response = MHD_create_response_from_buffer (
-            resp_size,(void *)resp_image
+            resp_used,(void *)(resp_jpg->buf + STREAM_JPG_HDR)
             , MHD_RESPMEM_MUST_COPY);
+    webu_getimg_jpg_unref(resp_jpg);
     if (response == NULL) {
         MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO, _("Invalid response"));
         return MHD_NO;
@@ -659,10 +602,8 @@ void cls_webu_stream::main()
     } else if (webua->uri_cmd1 == "mjpg") {
         if (webua->device_id > 0) {
             jpg_cnct();
-            one_buffer();
         } else {
             all_cnct();
-            all_buffer();
         }
         retcd = stream_mjpeg();
     } else if (webua->uri_cmd1 == "mpegts") {
@@ -693,19 +634,21 @@ cls_webu_stream::cls_webu_stream(cls_webu_ans *p_webua)
     webua  = p_webua;
     webu_mpegts = nullptr;
 
-    resp_image    = nullptr;
-    resp_size     = 0;
+    resp_jpg      = nullptr;
     resp_used     = 0;
 
     stream_pos = 0;
     stream_fps = 1;
+    gen_sent = 0;
+    pacer = new cls_pacer();
 
 }
 
 cls_webu_stream::~cls_webu_stream()
 {
     mydelete(webu_mpegts);
+    mydelete(pacer);
 
-    myfree(resp_image);
+    webu_getimg_jpg_unref(resp_jpg);
 
 }
@@ -24,19 +24,18 @@
             ~cls_webu_stream();
 
             int     stream_fps;
-            size_t  resp_size;      /* The allocated size of the response */
             size_t  resp_used;      /* The amount of the response page used */
-            u_char  *resp_image;    /* Response image to provide to user */
+            ctx_stream_jpg *resp_jpg;   /* Shared jpg being sent to user */
 
             void main();
             ssize_t mjpeg_response (char *buf, size_t max);
             bool check_finish();
             void delay();
             void set_fps();
-            void one_buffer();
-            void all_buffer();
             bool all_ready();
+            bool wait_img(ctx_stream *stream, ctx_stream_data *strm);
             struct timespec time_last;      /* Keep track of processing time for stream thread*/
+            cls_pacer       *pacer;         /* Schedule of the stream images */
 
         private:
             cls_motapp      *app;
@@ -45,6 +44,7 @@
             cls_webu_mpegts *webu_mpegts;
 
             size_t          stream_pos;
+            int64_t         gen_sent;       /* Generation of the last image sent */
 
             void mjpeg_all_img();
             void mjpeg_one_img();
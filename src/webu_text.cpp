@@ -26,6 +26,7 @@
 #include "webu_text.hpp"
 #include "webu_post.hpp"
 #include "dbse.hpp"
+#include "metrics.hpp"
 
 void cls_webu_text::status_vars(int indx_cam)
 {
@@ -151,6 +152,24 @@ void cls_webu_text::connection()
 
 }
 
+/* Loop timing and counters in the Prometheus text format */
+void cls_webu_text::metrics()
+{
+    int st, en;
+
+    if (webua->device_id == 0) {
+        st = 0;
+        en = app->cam_cnt;
+    } else {
+        st = webua->camindx;
+        en = webua->camindx+1;
+    }
+
+    webua->resp_type = WEBUI_RESP_TEXT;
+    webua->resp_page = "";
+    metrics_prom(app, st, en, webua->resp_page);
+}
+
 void cls_webu_text::main()
 {
     /* Check if this is a state-changing operation that requires POST method */
@@ -181,6 +200,8 @@ void cls_webu_text::main()
         if ((webua->uri_cmd1 == "detection") &&
             (webua->uri_cmd2 == "status")) {
             status();
+        } else if (webua->uri_cmd1 == "metrics") {
+            metrics();
         } else if (
             (webua->uri_cmd1 == "detection") &&
             (webua->uri_cmd2 == "connection")) {
@@ -31,6 +31,7 @@
             void status_vars(int indx_cam);
             void status();
             void connection();
+            void metrics();
     };
 
 #endif /* _INCLUDE_WEBU_TEXT_HPP_ */
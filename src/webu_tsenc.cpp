@@ -0,0 +1,605 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "motion.hpp"
+#include "util.hpp"
+#include "camera.hpp"
+#include "allcam.hpp"
+#include "conf.hpp"
+#include "logger.hpp"
+#include "webu.hpp"
+#include "webu_ans.hpp"
+#include "webu_tsenc.hpp"
+#include "framepool.hpp"
+#include "pacer.hpp"
+
+static int webu_tsenc_avio_buf(void *opaque, myuint *buf, int buf_size)
+{
+    return ((cls_webu_tsenc *)opaque)->avio_buf(buf, buf_size);
+}
+
+static void *webu_tsenc_handler(void *arg)
+{
+    ((cls_webu_tsenc *)arg)->handler();
+    return nullptr;
+}
+
+/* Size of the images encoded for the stream */
+void cls_webu_tsenc::getsize(int *w, int *h)
+{
+    if (cam == nullptr) {
+        *w = app->allcam->all_sizes.dst_w;
+        *h = app->allcam->all_sizes.dst_h;
+    } else if (sub &&
+        ((cam->imgs.width  % 16) == 0) &&
+        ((cam->imgs.height % 16) == 0)) {
+        *w = (cam->imgs.width/2);
+        *h = (cam->imgs.height/2);
+    } else {
+        *w = cam->imgs.width;
+        *h = cam->imgs.height;
+    }
+}
+
+/* Run fast for the first seconds so the players fill their buffers */
+int cls_webu_tsenc::getfps()
+{
+    struct timespec curr_ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &curr_ts);
+    if ((curr_ts.tv_sec - st_mono_time.tv_sec) < 2) {
+        return 30;
+    }
+    if (cam == nullptr) {
+        return app->cfg->stream_maxrate;
+    }
+    if ((cam->detecting_motion == false) && (cam->cfg->stream_motion)) {
+        return 1;
+    }
+    return cam->cfg->stream_maxrate;
+}
+
+int cls_webu_tsenc::pic_send(unsigned char *img)
+{
+    int retcd;
+    char errstr[128];
+    struct timespec curr_ts;
+    int64_t pts_interval;
+
+    if (picture == NULL) {
+        picture = av_frame_alloc();
+        picture->linesize[0] = ctx_codec->width;
+        picture->linesize[1] = ctx_codec->width / 2;
+        picture->linesize[2] = ctx_codec->width / 2;
+
+        picture->format = ctx_codec->pix_fmt;
+        picture->width  = ctx_codec->width;
+        picture->height = ctx_codec->height;
+
+        picture->pict_type = AV_PICTURE_TYPE_I;
+        myframe_key(picture);
+        picture->pts = 1;
+    }
+
+    picture->data[0] = img;
+    picture->data[1] = picture->data[0] +
+        (ctx_codec->width * ctx_codec->height);
+    picture->data[2] = picture->data[1] +
+        ((ctx_codec->width * ctx_codec->height) / 4);
+
+    clock_gettime(CLOCK_REALTIME, &curr_ts);
+    pts_interval = ((1000000L * (curr_ts.tv_sec - start_time.tv_sec)) +
+        (curr_ts.tv_nsec/1000) - (start_time.tv_nsec/1000));
+    picture->pts = av_rescale_q(pts_interval
+        ,av_make_q(1,1000000L), ctx_codec->time_base);
+
+    retcd = avcodec_send_frame(ctx_codec, picture);
+    if (retcd < 0 ) {
+        av_strerror(retcd, errstr, sizeof(errstr));
+        MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            , _("Error sending frame for encoding:%s"), errstr);
+        av_frame_free(&picture);
+        picture = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Mux one packet from the encoder.  Returns 1 when there are none ready */
+int cls_webu_tsenc::pic_get()
+{
+    int retcd;
+    char errstr[128];
+    AVPacket *pkt;
+
+    pkt = NULL;
+    pkt = mypacket_alloc(pkt);
+
+    retcd = avcodec_receive_packet(ctx_codec, pkt);
+    if (retcd == AVERROR(EAGAIN)) {
+        av_packet_free(&pkt);
+        return 1;
+    }
+    if (retcd < 0 ) {
+        av_strerror(retcd, errstr, sizeof(errstr));
+        MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            ,_("Error receiving encoded packet video:%s"), errstr);
+        av_packet_free(&pkt);
+        return -1;
+    }
+
+    pkt->pts = picture->pts;
+
+    if (pkt->flags & AV_PKT_FLAG_KEY) {
+        /* Connections start here so they need the tables */
+        av_opt_set(fmtctx->priv_data, "mpegts_flags", "+resend_headers", 0);
+        key_pend = true;
+    }
+
+    retcd =  av_interleaved_write_frame(fmtctx, pkt);
+    av_packet_free(&pkt);
+    if (retcd < 0 ) {
+        av_strerror(retcd, errstr, sizeof(errstr));
+        MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            ,_("Error while writing video frame. %s"), errstr);
+        return -1;
+    }
+    /* Keep each packet in its own chunks */
+    avio_flush(fmtctx->pb);
+
+    return 0;
+}
+
+/* Encode the latest image of the stream */
+int cls_webu_tsenc::encode()
+{
+    int w, h, img_sz, retcd;
+    u_char *img;
+
+    if ((cam != nullptr) && (cam->passflag == false)) {
+        return 0;
+    }
+
+    getsize(&w, &h);
+    if ((w != img_w) || (h != img_h)) {
+        MOTION_LOG(NTC, TYPE_STREAM, NO_ERRNO
+            , _("Image size changed.  Closing the transport stream."));
+        return -1;
+    }
+
+    img_sz = (img_w * img_h * 3) / 2;
+    img = pool->get((size_t)img_sz);
+    pthread_mutex_lock(&stream->mutex);
+        if (strm->img_data == nullptr) {
+            pthread_mutex_unlock(&stream->mutex);
+            pool->put(img);
+            return 0;
+        }
+        memcpy(img, strm->img_data, (uint)img_sz);
+        strm->consumed = true;
+    pthread_mutex_unlock(&stream->mutex);
+
+    retcd = pic_send(img);
+    pool->put(img);
+    if (retcd < 0) {
+        return -1;
+    }
+    frames++;
+
+    do {
+        retcd = pic_get();
+    } while (retcd == 0);
+
+    return (retcd < 0) ? -1 : 0;
+}
+
+/* Add the output of the muxer to the ring.  Called on the encoder thread */
+int cls_webu_tsenc::avio_buf(myuint *buf, int buf_size)
+{
+    ctx_tsenc_chunk *chunk;
+
+    if (buf_size > TSENC_AVIO_SZ) {
+        buf_size = TSENC_AVIO_SZ;
+    }
+
+    pthread_mutex_lock(&mutex);
+        chunk = &ring[(uint)(head % TSENC_RING)];
+        if (chunk->buf == nullptr) {
+            chunk->buf = (u_char *)mymalloc(TSENC_AVIO_SZ);
+        }
+        memcpy(chunk->buf, buf, (uint)buf_size);
+        chunk->used = buf_size;
+        if (key_pend) {
+            key_seq = head;
+            key_pend = false;
+        }
+        head++;
+        pthread_cond_broadcast(&cond_chunk);
+    pthread_mutex_unlock(&mutex);
+
+    return buf_size;
+}
+
+/*
+ * Copy the next part of the stream for the connection.  Waits up to a
+ * second for the encoder and returns 0 when there is nothing new.
+ */
+ssize_t cls_webu_tsenc::read(ctx_tsenc_rd *rd, char *buf, size_t max)
+{
+    struct timespec ts;
+    ctx_tsenc_chunk *chunk;
+    size_t sent_bytes;
+
+    mycond_deadline(&ts, 1000000000L);
+
+    pthread_mutex_lock(&mutex);
+        while (true) {
+            if (finish) {
+                pthread_mutex_unlock(&mutex);
+                return -1;
+            }
+            if ((rd->seq >= 0) && ((head - rd->seq) > TSENC_RING)) {
+                /* Fell behind the ring.  Start again at a key frame */
+                if (rd->pos != 0) {
+                    pthread_mutex_unlock(&mutex);
+                    return -1;
+                }
+                rd->seq = -1;
+            }
+            if ((rd->seq < 0) && (key_seq >= 0) &&
+                ((head - key_seq) <= TSENC_RING)) {
+                rd->seq = key_seq;
+                rd->pos = 0;
+            }
+            if ((rd->seq >= 0) && (rd->seq < head)) {
+                break;
+            }
+            if (pthread_cond_timedwait(&cond_chunk, &mutex, &ts) == ETIMEDOUT) {
+                pthread_mutex_unlock(&mutex);
+                return 0;
+            }
+        }
+
+        chunk = &ring[(uint)(rd->seq % TSENC_RING)];
+        sent_bytes = (size_t)(chunk->used - rd->pos);
+        if (sent_bytes > max) {
+            sent_bytes = max;
+        }
+        memcpy(buf, chunk->buf + rd->pos, sent_bytes);
+        rd->pos += (int)sent_bytes;
+        if (rd->pos >= chunk->used) {
+            rd->seq++;
+            rd->pos = 0;
+        }
+    pthread_mutex_unlock(&mutex);
+
+    return (ssize_t)sent_bytes;
+}
+
+void cls_webu_tsenc::handler()
+{
+    if (cam == nullptr) {
+        mythreadname_set("ts", 0, "allcam");
+    } else {
+        mythreadname_set("ts", cam->cfg->device_id, cam->cfg->device_name.c_str());
+    }
+
+    while (handler_stop == false) {
+        pacer->wait(getfps());
+        if (handler_stop) {
+            break;
+        }
+        if (encode() < 0) {
+            pthread_mutex_lock(&mutex);
+                finish = true;
+                pthread_cond_broadcast(&cond_chunk);
+            pthread_mutex_unlock(&mutex);
+            break;
+        }
+    }
+}
+
+int cls_webu_tsenc::open_mpegts()
+{
+    int retcd;
+    char errstr[128];
+    unsigned char   *buf_image;
+    AVStream        *avstrm;
+    const AVCodec   *codec;
+    AVDictionary    *opts;
+
+    opts = NULL;
+    clock_gettime(CLOCK_REALTIME, &start_time);
+    clock_gettime(CLOCK_MONOTONIC, &st_mono_time);
+
+    fmtctx = avformat_alloc_context();
+    fmtctx->oformat = av_guess_format("mpegts", NULL, NULL);
+    fmtctx->video_codec_id = AV_CODEC_ID_H264;
+
+    codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    avstrm = avformat_new_stream(fmtctx, codec);
+
+    getsize(&img_w, &img_h);
+
+    ctx_codec = avcodec_alloc_context3(codec);
+    ctx_codec->gop_size      = 15;
+    ctx_codec->codec_id      = AV_CODEC_ID_H264;
+    ctx_codec->codec_type    = AVMEDIA_TYPE_VIDEO;
+    ctx_codec->bit_rate      = 400000;
+    ctx_codec->width         = img_w;
+    ctx_codec->height        = img_h;
+    ctx_codec->time_base.num = 1;
+    ctx_codec->time_base.den = 90000;
+    ctx_codec->pix_fmt       = AV_PIX_FMT_YUV420P;
+    ctx_codec->max_b_frames  = 1;
+    ctx_codec->flags         |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    ctx_codec->framerate.num  = 1;
+    ctx_codec->framerate.den  = 1;
+    av_opt_set(ctx_codec->priv_data, "profile", "main", 0);
+    av_opt_set(ctx_codec->priv_data, "crf", "22", 0);
+    av_opt_set(ctx_codec->priv_data, "tune", "zerolatency", 0);
+    av_opt_set(ctx_codec->priv_data, "preset", "superfast",0);
+    av_dict_set(&opts, "movflags", "empty_moov", 0);
+
+    retcd = avcodec_open2(ctx_codec, codec, &opts);
+    if (retcd < 0) {
+        av_strerror(retcd, errstr, sizeof(errstr));
+        MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            ,_("Failed to open codec context for %dx%d transport stream: %s")
+            , img_w, img_h, errstr);
+        av_dict_free(&opts);
+        return -1;
+    }
+
+    retcd = avcodec_parameters_from_context(avstrm->codecpar, ctx_codec);
+    if (retcd < 0) {
+        av_strerror(retcd, errstr, sizeof(errstr));
+        MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            ,_("Failed to copy decoder parameters!: %s"), errstr);
+        av_dict_free(&opts);
+        return -1;
+    }
+
+    buf_image = (unsigned char*)av_malloc(TSENC_AVIO_SZ);
+    fmtctx->pb = avio_alloc_context(
+        buf_image, TSENC_AVIO_SZ, 1, this
+        , NULL, &webu_tsenc_avio_buf, NULL);
+    fmtctx->flags = AVFMT_FLAG_CUSTOM_IO;
+
+    retcd = avformat_write_header(fmtctx, &opts);
+    if (retcd < 0) {
+        av_strerror(retcd, errstr, sizeof(errstr));
+        MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            ,_("Failed to write header!: %s"), errstr);
+        av_dict_free(&opts);
+        return -1;
+    }
+    avio_flush(fmtctx->pb);
+
+    av_dict_free(&opts);
+
+    return 0;
+}
+
+void cls_webu_tsenc::close_mpegts()
+{
+    if (picture != nullptr) {
+        av_frame_free(&picture);
+        picture = nullptr;
+    }
+    if (ctx_codec != nullptr) {
+        avcodec_free_context(&ctx_codec);
+        ctx_codec = nullptr;
+    }
+    if (fmtctx != nullptr) {
+        if (fmtctx->pb != nullptr) {
+            if (fmtctx->pb->buffer != nullptr) {
+                av_free(fmtctx->pb->buffer);
+                fmtctx->pb->buffer = nullptr;
+            }
+            avio_context_free(&fmtctx->pb);
+            fmtctx->pb = nullptr;
+        }
+        avformat_free_context(fmtctx);
+        fmtctx = nullptr;
+    }
+}
+
+/* Open the encoder and start its thread */
+int cls_webu_tsenc::start()
+{
+    int retcd;
+
+    if (open_mpegts() < 0) {
+        return -1;
+    }
+
+    retcd = pthread_create(&handler_thread, NULL, &webu_tsenc_handler, this);
+    if (retcd != 0) {
+        MOTION_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            , _("Unable to start transport stream encoder thread."));
+        return -1;
+    }
+    handler_running = true;
+
+    MOTION_LOG(INF, TYPE_STREAM, NO_ERRNO
+        , _("Started %dx%d transport stream encoder"), img_w, img_h);
+
+    return 0;
+}
+
+/* Join the shared encoder of the stream, starting it for the first connection */
+cls_webu_tsenc *webu_tsenc_subscribe(cls_webu_ans *webua)
+{
+    ctx_stream *stream;
+    ctx_stream_data *strm;
+    cls_webu_tsenc *tsenc, *tsenc_new;
+    bool sub;
+
+    if (webua->device_id > 0) {
+        if (webua->cam == NULL) {
+            return nullptr;
+        }
+        stream = &webua->cam->stream;
+    } else {
+        stream = &webua->app->allcam->stream;
+    }
+
+    sub = false;
+    if (webua->cnct_type == WEBUI_CNCT_TS_FULL) {
+        strm = &stream->norm;
+    } else if (webua->cnct_type == WEBUI_CNCT_TS_SUB) {
+        strm = &stream->sub;
+        sub = true;
+    } else if (webua->cnct_type == WEBUI_CNCT_TS_MOTION) {
+        strm = &stream->motion;
+    } else if (webua->cnct_type == WEBUI_CNCT_TS_SOURCE) {
+        strm = &stream->source;
+    } else if (webua->cnct_type == WEBUI_CNCT_TS_SECONDARY) {
+        strm = &stream->secondary;
+    } else {
+        return nullptr;
+    }
+
+    pthread_mutex_lock(&stream->mutex);
+        tsenc = strm->tsenc;
+        if ((tsenc != nullptr) && tsenc->finish) {
+            /* Left to the connections which are closing */
+            strm->tsenc = nullptr;
+            tsenc = nullptr;
+        }
+        if (tsenc != nullptr) {
+            tsenc->clients++;
+        }
+    pthread_mutex_unlock(&stream->mutex);
+    if (tsenc != nullptr) {
+        return tsenc;
+    }
+
+    /* Opened without the lock so the camera is not held up */
+    if (webua->device_id > 0) {
+        tsenc_new = new cls_webu_tsenc(webua->app, webua->cam, stream, strm, sub);
+    } else {
+        tsenc_new = new cls_webu_tsenc(webua->app, nullptr, stream, strm, sub);
+    }
+    if (tsenc_new->start() < 0) {
+        delete tsenc_new;
+        return nullptr;
+    }
+
+    pthread_mutex_lock(&stream->mutex);
+        tsenc = strm->tsenc;
+        if ((tsenc == nullptr) || tsenc->finish) {
+            strm->tsenc = tsenc_new;
+            tsenc = tsenc_new;
+            tsenc_new = nullptr;
+        }
+        tsenc->clients++;
+    pthread_mutex_unlock(&stream->mutex);
+
+    /* Another connection started one first */
+    if (tsenc_new != nullptr) {
+        delete tsenc_new;
+    }
+
+    return tsenc;
+}
+
+/* Leave the shared encoder and stop it with the last connection */
+void webu_tsenc_unsubscribe(cls_webu_tsenc *&tsenc)
+{
+    ctx_stream *stream;
+    bool last;
+
+    if (tsenc == nullptr) {
+        return;
+    }
+
+    stream = tsenc->stream;
+    pthread_mutex_lock(&stream->mutex);
+        tsenc->clients--;
+        last = (tsenc->clients <= 0);
+        if (last && (tsenc->strm->tsenc == tsenc)) {
+            tsenc->strm->tsenc = nullptr;
+        }
+    pthread_mutex_unlock(&stream->mutex);
+
+    if (last) {
+        delete tsenc;
+    }
+    tsenc = nullptr;
+}
+
+cls_webu_tsenc::cls_webu_tsenc(cls_motapp *p_app, cls_camera *p_cam
+    , ctx_stream *p_stream, ctx_stream_data *p_strm, bool p_sub)
+{
+    app = p_app;
+    cam = p_cam;
+    stream = p_stream;
+    strm = p_strm;
+    sub = p_sub;
+    if (cam == nullptr) {
+        pool = app->allcam->pool;
+    } else {
+        pool = cam->pool;
+    }
+    pacer = new cls_pacer();
+
+    clients = 0;
+    finish = false;
+    picture = nullptr;
+    fmtctx = nullptr;
+    ctx_codec = nullptr;
+    img_w = 0;
+    img_h = 0;
+    frames = 0;
+
+    ring.assign(TSENC_RING, {nullptr, 0});
+    head = 0;
+    key_seq = -1;
+    key_pend = false;
+    pthread_mutex_init(&mutex, NULL);
+    mycond_init(&cond_chunk);
+
+    handler_running = false;
+    handler_stop = false;
+}
+
+cls_webu_tsenc::~cls_webu_tsenc()
+{
+    uint indx;
+
+    if (handler_running) {
+        handler_stop = true;
+        pthread_join(handler_thread, NULL);
+        handler_running = false;
+        MOTION_LOG(INF, TYPE_STREAM, NO_ERRNO
+            , _("Stopped transport stream encoder after %lld images")
+            , (long long)frames);
+    }
+    close_mpegts();
+
+    for (indx = 0; indx < ring.size(); indx++) {
+        myfree(ring[indx].buf);
+    }
+    ring.clear();
+    pthread_cond_destroy(&cond_chunk);
+    pthread_mutex_destroy(&mutex);
+    mydelete(pacer);
+}
@@ -0,0 +1,109 @@
+/*
+ *    This file is part of Motion.
+ *
+ *    Motion is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    Motion is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with Motion.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * webu_tsenc.hpp - Shared transport stream encoder
+ *
+ * There is one encoder for each stream of a camera (or of the all camera
+ * view) which has mpegts connections.  It is started by the first
+ * connection and runs on its own thread at the stream rate.  The muxed
+ * output is kept in a ring of chunks and every connection reads the ring
+ * from its own position.  The output of each packet is flushed to its own
+ * chunks so a new connection starts at the chunk of the latest key frame.
+ * A connection which fell behind by more than the ring does the same when
+ * it is between chunks and is closed when it is in the middle of a chunk
+ * since the rest of that chunk is gone.  The encoder stops with its last
+ * connection.  If the image size changes the encoder finishes so its
+ * connections close and the next one gets a new encoder.
+ */
+
+#ifndef _INCLUDE_WEBU_TSENC_HPP_
+#define _INCLUDE_WEBU_TSENC_HPP_
+
+    #include <atomic>
+
+    #define TSENC_RING      256
+    #define TSENC_AVIO_SZ   65536
+
+    struct ctx_tsenc_chunk {
+        u_char  *buf;       /* TSENC_AVIO_SZ bytes */
+        int     used;
+    };
+
+    /* Position of a connection in the ring */
+    struct ctx_tsenc_rd {
+        int64_t seq;        /* Chunk to send next or -1 to wait for a key frame */
+        int     pos;        /* Bytes of the chunk already sent */
+    };
+
+    class cls_webu_tsenc {
+        public:
+            cls_webu_tsenc(cls_motapp *p_app, cls_camera *p_cam
+                , ctx_stream *p_stream, ctx_stream_data *p_strm, bool p_sub);
+            ~cls_webu_tsenc();
+
+            int     clients;        /* Connections reading.  Uses the stream mutex */
+            std::atomic<bool>   finish;     /* Set on the encoder thread when it fails */
+            ctx_stream      *stream;
+            ctx_stream_data *strm;
+
+            int start();
+            ssize_t read(ctx_tsenc_rd *rd, char *buf, size_t max);
+            int avio_buf(myuint *buf, int buf_size);
+            void handler();
+
+        private:
+            cls_motapp      *app;
+            cls_camera      *cam;           /* Null for the all camera view */
+            cls_framepool   *pool;
+            cls_pacer       *pacer;
+            bool            sub;
+
+            AVFrame         *picture;
+            AVFormatContext *fmtctx;
+            AVCodecContext  *ctx_codec;
+            int             img_w;
+            int             img_h;
+            struct timespec start_time;
+            struct timespec st_mono_time;
+
+            pthread_mutex_t mutex;          /* Protects the ring */
+            pthread_cond_t  cond_chunk;
+            std::vector<ctx_tsenc_chunk> ring;
+            int64_t         head;           /* Sequence of the next chunk written */
+            int64_t         key_seq;        /* First chunk of the latest key frame */
+            bool            key_pend;
+
+            pthread_t       handler_thread;
+            bool            handler_running;
+            bool            handler_stop;
+            int64_t         frames;
+
+            void getsize(int *w, int *h);
+            int getfps();
+            int open_mpegts();
+            void close_mpegts();
+            int pic_send(unsigned char *img);
+            int pic_get();
+            int encode();
+    };
+
+    cls_webu_tsenc *webu_tsenc_subscribe(cls_webu_ans *webua);
+    void webu_tsenc_unsubscribe(cls_webu_tsenc *&tsenc);
+
+#endif /* _INCLUDE_WEBU_TSENC_HPP_ */